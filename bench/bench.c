@@ -0,0 +1,407 @@
+//
+// Created by leonv on 5/24/2024.
+//
+
+// Emulator throughput on a fixed set of guest workloads. Every workload is a hand-assembled
+// endless loop that is run for the same number of T-states under each execution engine, so
+// the figures only change when the emulator does. Each workload is then also run by a fleet
+// of FLEET_SIZE machines with data of their own, once one machine at a time with run_cycles()
+// and once in a lockstep group, for the same total work. Usage: bench [cycles] [repetitions]
+//
+// Every run is checked against single-stepping with emulate_cycle(), and a JIT build fails
+// unless some block was translated, so a short run doubles as a test of the engines.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "i8080_block.h"
+#include "i8080_pool.h"
+#include "i8080_snapshot.h"
+#include "i8080_lockstep.h"
+#include "file_reader.h"
+
+#define DEFAULT_CYCLES 200000000ULL
+#define DEFAULT_REPETITIONS 5 // Best of, to filter out scheduling noise
+#define FLEET_SIZE 256
+
+typedef struct {
+    const char *name;
+    const uint8_t *image;
+    size_t size;
+} workload_t;
+
+// Flag-heavy register arithmetic
+static const uint8_t alu_loop[] = {
+    0x80,             // 0100 ADD B
+    0x89,             // 0101 ADC C
+    0x92,             // 0102 SUB D
+    0xA3,             // 0103 ANA E
+    0xAC,             // 0104 XRA H
+    0xB5,             // 0105 ORA L
+    0xB8,             // 0106 CMP B
+    0x04,             // 0107 INR B
+    0x0D,             // 0108 DCR C
+    0x07,             // 0109 RLC
+    0x27,             // 010A DAA
+    0x9A,             // 010B SBB D
+    0x3C,             // 010C INR A
+    0xEA, 0x00, 0x01, // 010D JPE 0100
+    0xC3, 0x00, 0x01, // 0110 JMP 0100
+};
+
+// Copies 4 KB from 0x2000 to 0x4000, over and over
+static const uint8_t memory_copy[] = {
+    0x21, 0x00, 0x20, // 0100 LXI H,2000
+    0x11, 0x00, 0x40, // 0103 LXI D,4000
+    0x01, 0x00, 0x10, // 0106 LXI B,1000
+    0x7E,             // 0109 MOV A,M
+    0x12,             // 010A STAX D
+    0x23,             // 010B INX H
+    0x13,             // 010C INX D
+    0x0B,             // 010D DCX B
+    0x78,             // 010E MOV A,B
+    0xB1,             // 010F ORA C
+    0xC2, 0x09, 0x01, // 0110 JNZ 0109
+    0xC3, 0x00, 0x01, // 0113 JMP 0100
+};
+
+// Binary tree of recursive calls 12 deep: f(n) = n ? f(n-1), f(n-1) : return
+static const uint8_t recursion[] = {
+    0x31, 0x00, 0x00, // 0100 LXI SP,0000
+    0x3E, 0x0C,       // 0103 MVI A,12
+    0xCD, 0x0B, 0x01, // 0105 CALL 010B
+    0xC3, 0x03, 0x01, // 0108 JMP 0103
+    0xB7,             // 010B ORA A
+    0xC8,             // 010C RZ
+    0x3D,             // 010D DCR A
+    0xF5,             // 010E PUSH PSW
+    0xCD, 0x0B, 0x01, // 010F CALL 010B
+    0xF1,             // 0112 POP PSW
+    0xCD, 0x0B, 0x01, // 0113 CALL 010B
+    0xC9,             // 0116 RET
+};
+
+// Four-way branch on the low bits of a 16-bit shift register, poorly predictable on the host
+static const uint8_t branches[] = {
+    0x21, 0xE1, 0xAC, // 0100 LXI H,ACE1
+    0x29,             // 0103 DAD H
+    0xD2, 0x0B, 0x01, // 0104 JNC 010B
+    0x7D,             // 0107 MOV A,L
+    0xEE, 0x2D,       // 0108 XRI 2D
+    0x6F,             // 010A MOV L,A
+    0x7D,             // 010B MOV A,L
+    0xE6, 0x03,       // 010C ANI 03
+    0xCA, 0x1F, 0x01, // 010E JZ 011F
+    0xFE, 0x01,       // 0111 CPI 01
+    0xCA, 0x23, 0x01, // 0113 JZ 0123
+    0xFE, 0x02,       // 0116 CPI 02
+    0xCA, 0x27, 0x01, // 0118 JZ 0127
+    0x14,             // 011B INR D
+    0xC3, 0x03, 0x01, // 011C JMP 0103
+    0x1C,             // 011F INR E
+    0xC3, 0x03, 0x01, // 0120 JMP 0103
+    0x04,             // 0123 INR B
+    0xC3, 0x03, 0x01, // 0124 JMP 0103
+    0x0C,             // 0127 INR C
+    0xC3, 0x03, 0x01, // 0128 JMP 0103
+};
+
+// Mixes B, C and E into a hash in 64 rounds. The trip count is fixed, so machines hashing
+// different data still branch alike.
+static const uint8_t hash_rounds[] = {
+    0x16, 0x40,       // 0100 MVI D,40
+    0x78,             // 0102 MOV A,B
+    0x81,             // 0103 ADD C
+    0x07,             // 0104 RLC
+    0xAB,             // 0105 XRA E
+    0x47,             // 0106 MOV B,A
+    0x79,             // 0107 MOV A,C
+    0x8C,             // 0108 ADC H
+    0x0F,             // 0109 RRC
+    0xA8,             // 010A XRA B
+    0x4F,             // 010B MOV C,A
+    0x83,             // 010C ADD E
+    0x5F,             // 010D MOV E,A
+    0x15,             // 010E DCR D
+    0xC2, 0x02, 0x01, // 010F JNZ 0102
+    0xC3, 0x00, 0x01, // 0112 JMP 0100
+};
+
+// Bumps the immediate of a subroutine before every call, so cached code keeps being dropped
+// and decoded again
+static const uint8_t self_modifying[] = {
+    0x31, 0x00, 0x00, // 0100 LXI SP,0000
+    0x21, 0x0E, 0x01, // 0103 LXI H,010E
+    0x34,             // 0106 INR M
+    0xCD, 0x0D, 0x01, // 0107 CALL 010D
+    0xC3, 0x06, 0x01, // 010A JMP 0106
+    0x3E, 0x00,       // 010D MVI A,00
+    0x80,             // 010F ADD B
+    0x47,             // 0110 MOV B,A
+    0xC9,             // 0111 RET
+};
+
+static const workload_t workloads[] = {
+    { "alu", alu_loop, sizeof(alu_loop) },
+    { "memcpy", memory_copy, sizeof(memory_copy) },
+    { "recursion", recursion, sizeof(recursion) },
+    { "branches", branches, sizeof(branches) },
+    { "smc", self_modifying, sizeof(self_modifying) },
+    { "hash", hash_rounds, sizeof(hash_rounds) },
+};
+
+typedef struct {
+    const char *name;
+    bool blocks;
+} engine_t;
+
+static const engine_t engines[] = {
+    { "interpreter", false },
+#ifdef I8080_JIT
+    { "jit", true },
+#else
+    { "blocks", true },
+#endif
+};
+
+static double now(void){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+static bool load(i8080_t *cpu, const workload_t *workload, bool blocks){
+    if(!reset_to_image(cpu, workload->image, workload->size, COM_ORIGIN)){
+        return false;
+    }
+    if(blocks){
+        return enable_block_cache(cpu);
+    }
+    disable_block_cache(cpu);
+    return true;
+}
+
+// Instructions the workload executes within `cycles`, counted by single-stepping
+static uint64_t count_instructions(i8080_t *cpu, const workload_t *workload, uint64_t cycles){
+    uint64_t instructions = 0;
+    if(!load(cpu, workload, false)){
+        return 0;
+    }
+    while(cpu->cycles < cycles){
+        emulate_cycle(cpu);
+        instructions++;
+    }
+    return instructions;
+}
+
+static bool same_state(const i8080_t *a, const i8080_t *b){
+    return a->PSW == b->PSW && a->BC == b->BC && a->DE == b->DE && a->HL == b->HL &&
+           a->SP == b->SP && a->PC == b->PC && a->cycles == b->cycles &&
+           memcmp(a->memory, b->memory, MEMORY_SIZE) == 0;
+}
+
+static void print_row(const char *workload, const char *engine, uint64_t spent, uint64_t instructions, double best){
+    printf("%-10s %-12s %10.1f %8.1f %10.2f %10.3e\n", workload, engine,
+           (double)spent / best / 1e6, (double)instructions / best / 1e6,
+           best * 1e9 / (double)instructions, (double)spent / best);
+}
+
+static void destroy_fleet(i8080_t **fleet, size_t count){
+    for(size_t i = 0; i < count; i++){
+        destroy_i8080(fleet[i]);
+    }
+}
+
+// Machines forked from `base`, sharing its code, each with registers of its own so that their
+// data and, sooner or later, their branches differ
+static bool make_fleet(i8080_t *base, i8080_t **fleet){
+    for(size_t i = 0; i < FLEET_SIZE; i++){
+        fleet[i] = fork_i8080(base);
+        if(fleet[i] == NULL){
+            destroy_fleet(fleet, i);
+            return false;
+        }
+        fleet[i]->BC = (uint16_t)(i * 0x9E37);
+        fleet[i]->DE = (uint16_t)(i * 0x79B9 + 1);
+        fleet[i]->HL = (uint16_t)(i * 0x5851 + 2);
+    }
+    return true;
+}
+
+static bool same_memory(i8080_t *a, i8080_t *b){
+    for(uint32_t address = 0; address < MEMORY_SIZE; address++){
+        if(read_memory(a, (uint16_t)address) != read_memory(b, (uint16_t)address)){
+            return false;
+        }
+    }
+    return true;
+}
+
+// `steps` instructions on every machine of a fleet, in a lockstep group and then one machine
+// at a time with run_cycles() for as many cycles as each one spent in the group
+static bool bench_fleet(i8080_t *base, const workload_t *workload, uint64_t steps, int repetitions){
+    i8080_t *fleet[FLEET_SIZE];
+    i8080_t *check[FLEET_SIZE];
+    uint64_t spent[FLEET_SIZE];
+    uint64_t total = 0;
+    double best_group = 0, best_alone = 0, vectorised = 0;
+    lockstep_t group;
+
+    if(!load(base, workload, false)){
+        return false;
+    }
+    for(int r = 0; r < repetitions; r++){
+        double start, elapsed;
+        if(!make_fleet(base, fleet)){
+            return false;
+        }
+        if(!lockstep_init(&group, fleet, FLEET_SIZE)){
+            destroy_fleet(fleet, FLEET_SIZE);
+            return false;
+        }
+        start = now();
+        lockstep_run(&group, steps);
+        elapsed = now() - start;
+        if(r == 0 || elapsed < best_group){
+            best_group = elapsed;
+        }
+        vectorised = (double)group.vector_steps / (double)(group.vector_steps + group.scalar_steps);
+        lockstep_release(&group);
+        if(r > 0){
+            destroy_fleet(fleet, FLEET_SIZE);
+            continue;
+        }
+
+        // Every machine has to end up exactly where single-stepping takes it
+        if(!make_fleet(base, check)){
+            destroy_fleet(fleet, FLEET_SIZE);
+            return false;
+        }
+        for(size_t i = 0; i < FLEET_SIZE; i++){
+            for(uint64_t step = 0; step < steps; step++){
+                emulate_cycle(check[i]);
+            }
+            spent[i] = fleet[i]->cycles;
+            total += spent[i];
+            if(!same_state(fleet[i], check[i]) || !same_memory(fleet[i], check[i])){
+                printf("%-10s %-12s machine %zu differs from single-stepping\n", workload->name, "lockstep", i);
+                destroy_fleet(fleet, FLEET_SIZE);
+                destroy_fleet(check, FLEET_SIZE);
+                return false;
+            }
+        }
+        destroy_fleet(fleet, FLEET_SIZE);
+        destroy_fleet(check, FLEET_SIZE);
+    }
+
+    for(int r = 0; r < repetitions; r++){
+        double start, elapsed;
+        if(!make_fleet(base, fleet)){
+            return false;
+        }
+        start = now();
+        for(size_t i = 0; i < FLEET_SIZE; i++){
+            run_cycles(fleet[i], spent[i]);
+        }
+        elapsed = now() - start;
+        if(r == 0 || elapsed < best_alone){
+            best_alone = elapsed;
+        }
+        destroy_fleet(fleet, FLEET_SIZE);
+    }
+
+    print_row(workload->name, "run_cycles", total, steps * FLEET_SIZE, best_alone);
+    print_row(workload->name, "lockstep", total, steps * FLEET_SIZE, best_group);
+    printf("%-10s %-12s %9.1f%% of instructions vectorised\n", "", "", vectorised * 100);
+    return true;
+}
+
+int main(int argc, char *argv[]){
+    uint64_t cycles = argc > 1 ? strtoull(argv[1], NULL, 0) : DEFAULT_CYCLES;
+    int repetitions = argc > 2 ? atoi(argv[2]) : DEFAULT_REPETITIONS;
+    i8080_t *cpu = init_i8080();
+    i8080_t *reference = init_i8080();
+#ifdef I8080_JIT
+    uint64_t translated = 0;
+#endif
+    bool failed = false;
+
+    if(cpu == NULL || reference == NULL || cycles == 0 || repetitions < 1){
+        printf("Usage: %s [cycles] [repetitions]\n", argv[0]);
+        destroy_i8080(cpu);
+        destroy_i8080(reference);
+        return 1;
+    }
+
+    printf("dispatch: %s, flags: %s, %llu cycles, best of %d\n",
+#ifdef I8080_COMPUTED_GOTO
+           "computed goto",
+#else
+           "switch",
+#endif
+#ifdef I8080_LAZY_FLAGS
+           "lazy",
+#else
+           "eager",
+#endif
+           (unsigned long long)cycles, repetitions);
+    printf("%-10s %-12s %10s %8s %10s %10s\n", "workload", "engine", "MHz", "MIPS", "ns/instr", "cycles/s");
+
+    for(size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++){
+        const workload_t *workload = &workloads[w];
+        uint64_t instructions = count_instructions(reference, workload, cycles);
+
+        for(size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++){
+            double best = 0;
+            uint64_t spent = 0;
+            bool loaded = true;
+            for(int r = 0; r < repetitions; r++){
+                double start, elapsed;
+                if(!load(cpu, workload, engines[e].blocks)){
+                    printf("%-10s %-12s failed to load\n", workload->name, engines[e].name);
+                    loaded = false;
+                    failed = true;
+                    break;
+                }
+                start = now();
+                spent = run_cycles(cpu, cycles);
+                elapsed = now() - start;
+                if(r == 0 || elapsed < best){
+                    best = elapsed;
+                }
+            }
+            if(!loaded){
+                continue;
+            }
+#ifdef I8080_JIT
+            if(engines[e].blocks){
+                translated += cpu->blocks->translated;
+            }
+#endif
+            // Every engine has to end up exactly where single-stepping did
+            if(!same_state(cpu, reference)){
+                printf("%-10s %-12s state differs from the interpreter\n", workload->name, engines[e].name);
+                failed = true;
+                continue;
+            }
+            print_row(workload->name, engines[e].name, spent, instructions, best);
+        }
+        if(!bench_fleet(reference, workload, instructions / FLEET_SIZE, repetitions)){
+            printf("%-10s %-12s failed\n", workload->name, "lockstep");
+            failed = true;
+        }
+    }
+
+#ifdef I8080_JIT
+    if(translated == 0){
+        printf("no block was translated\n");
+        failed = true;
+    }
+#endif
+
+    destroy_i8080(cpu);
+    destroy_i8080(reference);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+//
+// Created by leonv on 5/31/2024.
+//
+
+// Regression test for breakpoints and watchpoints, run by CTest.
+//
+//   debugtest [interpreter|blocks]
+//
+// Runs a loop that counts in A and stores it to 0x2000, and checks that a run stops at a
+// breakpoint and the next one resumes past it, that a watched write stops the run right after
+// the store with the value written, and that a fetch from a watched code byte counts as a
+// read. Once everything is cleared the loop has to run to the end of its budget. Exit status
+// is 0 on success.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "i8080_block.h"
+#include "i8080_debug.h"
+#include "i8080_pool.h"
+
+#define BUDGET 1000
+
+static const uint8_t counter[] = {
+    0x3E, 0x00,       // 0100 MVI A,00
+    0x3C,             // 0102 INR A
+    0x32, 0x00, 0x20, // 0103 STA 2000
+    0xC3, 0x02, 0x01, // 0106 JMP 0102
+};
+
+// Runs one budget and checks where it stopped
+static bool expect(i8080_t *cpu, const char *step, debug_event_t event, uint16_t address, uint8_t value,
+                   uint16_t pc, uint8_t a, uint8_t stored){
+    const debug_t *debug;
+    run_cycles(cpu, BUDGET);
+    debug = cpu->debug;
+    if(debug->event != event || (event != DEBUG_NONE && debug->address != address) ||
+       ((event == DEBUG_READ || event == DEBUG_WRITE) && debug->value != value) ||
+       cpu->PC != pc || cpu->A != a || read_memory(cpu, 0x2000) != stored){
+        printf("FAIL: %s: event %d at %04X value %02X, PC %04X A %02X [2000] %02X\n", step, debug->event,
+               debug->address, debug->value, cpu->PC, cpu->A, read_memory(cpu, 0x2000));
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]){
+    bool blocks = argc > 1 && strcmp(argv[1], "blocks") == 0;
+    i8080_t *cpu = init_i8080();
+    bool passed;
+
+    if(argc > 2 || (argc == 2 && !blocks && strcmp(argv[1], "interpreter") != 0)){
+        printf("Usage: %s [interpreter|blocks]\n", argv[0]);
+        destroy_i8080(cpu);
+        return 2;
+    }
+    if(cpu == NULL || !reset_to_image(cpu, counter, sizeof(counter), 0x100) ||
+       (blocks && !enable_block_cache(cpu)) || !set_breakpoint(cpu, 0x0103)){
+        printf("Out of memory\n");
+        destroy_i8080(cpu);
+        return 1;
+    }
+
+    // Stops before the STA, then resumes through it and stops there on the next pass
+    passed = expect(cpu, "breakpoint", DEBUG_BREAKPOINT, 0x0103, 0, 0x0103, 1, 0) &&
+             expect(cpu, "resume", DEBUG_BREAKPOINT, 0x0103, 0, 0x0103, 2, 1);
+
+    // Resuming from the breakpoint stores 2, which the watchpoint catches straight after the STA
+    passed = passed && clear_breakpoint(cpu, 0x0103) && set_watchpoint(cpu, 0x2000, 1, false, true) &&
+             expect(cpu, "write", DEBUG_WRITE, 0x2000, 2, 0x0106, 2, 2) &&
+             expect(cpu, "next write", DEBUG_WRITE, 0x2000, 3, 0x0106, 3, 3);
+
+    // The STA's operand is fetched from a watched byte
+    passed = passed && clear_watchpoint(cpu, 0x2000, 1, false, true) &&
+             set_watchpoint(cpu, 0x0104, 1, true, false) &&
+             expect(cpu, "fetch", DEBUG_READ, 0x0104, 0x00, 0x0106, 4, 4);
+
+    if(passed){
+        uint64_t start = cpu->cycles;
+        clear_watchpoint(cpu, 0x0104, 1, true, false);
+        run_cycles(cpu, BUDGET);
+        if(cpu->debug->event != DEBUG_NONE || cpu->cycles - start < BUDGET){
+            printf("FAIL: the run stopped early with nothing armed\n");
+            passed = false;
+        }
+    }
+    if(passed){
+        printf("breakpoints and watchpoints stop and resume as expected\n");
+    }
+    destroy_i8080(cpu);
+    return passed ? 0 : 1;
+}
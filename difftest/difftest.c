@@ -0,0 +1,295 @@
+//
+// Created by leonv on 5/25/2024.
+//
+
+// Differential test harness. Runs a CP/M program (e.g. the 8080PRE, TST8080, CPUTEST and
+// 8080EXM exercisers) on the high-level BDOS in i8080_cpm.h and either records its register
+// state after every `stride` instructions, or checks a machine against such a recording.
+//
+//   difftest record <program.com> <trace> [stride] [max-instructions]
+//   difftest check <program.com> <trace> [interpreter|blocks] [min-block-percent]
+//
+// Recording single-steps the interpreter. Checking runs the chosen engine at full speed up to
+// the cycle count of each record, so a sparse trace checks an engine at close to its normal
+// speed and a stride of 1 checks every instruction. Exit status is 0 on a match. The block
+// engine falls back to the interpreter for code it cannot cache, so with `min-block-percent` a
+// check also fails if fewer of its records than that ended in a decoded block.
+//
+// exerciser.asm (assembled in exerciser.hex) is a small ALU exerciser whose expected results
+// come from the 8080 datasheet; CTest runs it and checks both engines against its trace.
+//
+// A trace is a 16-byte header, "I80T", u8 version, 3 reserved bytes, u32 stride, 4 reserved
+// bytes, followed by 24-byte records, all little-endian:
+//
+//   u64     cycles elapsed after the instruction
+//   u16     PC of the instruction, then PC, SP, PSW (A << 8 | F), BC, DE and HL after it
+//   u8      opcode
+//   u8      reserved
+//
+// Traces from another emulator can be converted to this format to serve as the reference. It is
+// not the execution trace format of i8080_trace.h, so its names carry a REFERENCE_ prefix.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "i8080_block.h"
+#include "i8080_cpm.h"
+#include "file_reader.h"
+
+#define REFERENCE_MAGIC "I80T"
+#define REFERENCE_VERSION 1
+#define REFERENCE_HEADER_SIZE 16
+#define REFERENCE_RECORD_SIZE 24
+#define REFERENCE_BATCH 4096 // Records read or written at a time
+
+#define DEFAULT_MAX_INSTRUCTIONS 100000000000ULL
+
+typedef struct {
+    uint64_t cycles;
+    uint16_t pc;
+    uint16_t next_pc;
+    uint16_t sp;
+    uint16_t psw;
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+    uint8_t opcode;
+} reference_record_t;
+
+static void put16(uint8_t *out, uint16_t value){
+    out[0] = LOW_BYTE(value);
+    out[1] = HIGH_BYTE(value);
+}
+
+static uint16_t get16(const uint8_t *in){
+    return TO16BIT(in[1], in[0]);
+}
+
+static void put32(uint8_t *out, uint32_t value){
+    put16(out, value & 0xFFFF);
+    put16(out + 2, value >> 16);
+}
+
+static uint32_t get32(const uint8_t *in){
+    return get16(in) | ((uint32_t)get16(in + 2) << 16);
+}
+
+static void put64(uint8_t *out, uint64_t value){
+    put32(out, value & 0xFFFFFFFF);
+    put32(out + 4, value >> 32);
+}
+
+static uint64_t get64(const uint8_t *in){
+    return get32(in) | ((uint64_t)get32(in + 4) << 32);
+}
+
+static void encode_record(uint8_t *out, const reference_record_t *record){
+    put64(out, record->cycles);
+    put16(out + 8, record->pc);
+    put16(out + 10, record->next_pc);
+    put16(out + 12, record->sp);
+    put16(out + 14, record->psw);
+    put16(out + 16, record->bc);
+    put16(out + 18, record->de);
+    put16(out + 20, record->hl);
+    out[22] = record->opcode;
+    out[23] = 0;
+}
+
+static void decode_record(const uint8_t *in, reference_record_t *record){
+    record->cycles = get64(in);
+    record->pc = get16(in + 8);
+    record->next_pc = get16(in + 10);
+    record->sp = get16(in + 12);
+    record->psw = get16(in + 14);
+    record->bc = get16(in + 16);
+    record->de = get16(in + 18);
+    record->hl = get16(in + 20);
+    record->opcode = in[22];
+}
+
+// Register state after an instruction; `pc` and `opcode` are filled in by the caller
+static void capture(const i8080_t *cpu, reference_record_t *record){
+    record->cycles = cpu->cycles;
+    record->next_pc = cpu->PC;
+    record->sp = cpu->SP;
+    record->psw = cpu->PSW;
+    record->bc = cpu->BC;
+    record->de = cpu->DE;
+    record->hl = cpu->HL;
+}
+
+// Loads the program at 0x100 on the high-level BDOS, with files in the current directory
+static bool setup(i8080_t *cpu, cpm_t *cpm, const char *program){
+    if(load_file(cpu, program, COM_ORIGIN) < 0){
+        printf("Failed to load %s\n", program);
+        return false;
+    }
+    return cpm_init(cpm, cpu, ".");
+}
+
+static double now(void){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+static int record_trace(const char *program, const char *path, uint32_t stride, uint64_t limit){
+    uint8_t header[REFERENCE_HEADER_SIZE] = { 0 };
+    uint8_t *batch = (uint8_t*)malloc(REFERENCE_BATCH * REFERENCE_RECORD_SIZE);
+    size_t buffered = 0;
+    uint64_t instructions = 0, records = 0;
+    i8080_t *cpu = init_i8080();
+    FILE *stream = fopen(path, "wb");
+    cpm_t cpm = { 0 };
+    bool ok;
+    double start;
+
+    ok = batch != NULL && cpu != NULL && stream != NULL && setup(cpu, &cpm, program);
+    memcpy(header, REFERENCE_MAGIC, 4);
+    header[4] = REFERENCE_VERSION;
+    put32(header + 8, stride);
+    ok = ok && fwrite(header, REFERENCE_HEADER_SIZE, 1, stream) == 1;
+
+    start = now();
+    while(ok && !cpm.done && !cpu->halted && instructions < limit){
+        reference_record_t record;
+        record.pc = cpu->PC;
+        record.opcode = read_memory(cpu, cpu->PC);
+        emulate_cycle(cpu);
+        if(++instructions % stride != 0){
+            continue;
+        }
+        capture(cpu, &record);
+        encode_record(batch + buffered * REFERENCE_RECORD_SIZE, &record);
+        records++;
+        if(++buffered == REFERENCE_BATCH){
+            ok = fwrite(batch, REFERENCE_RECORD_SIZE, buffered, stream) == buffered;
+            buffered = 0;
+        }
+    }
+    if(ok && buffered > 0){
+        ok = fwrite(batch, REFERENCE_RECORD_SIZE, buffered, stream) == buffered;
+    }
+    if(stream != NULL && fclose(stream) != 0){
+        ok = false;
+    }
+    if(ok){
+        printf("\nrecorded %llu instructions, %llu records in %.2fs\n", (unsigned long long)instructions,
+               (unsigned long long)records, now() - start);
+    }
+    else{
+        printf("\nFailed to record %s\n", path);
+    }
+    cpm_release(&cpm);
+    destroy_i8080(cpu);
+    free(batch);
+    return ok ? 0 : 1;
+}
+
+static void print_record(const char *label, const reference_record_t *record){
+    printf("%-8s cycles %llu PC %04X SP %04X A %02X F %02X BC %04X DE %04X HL %04X\n", label,
+           (unsigned long long)record->cycles, record->next_pc, record->sp, record->psw >> 8, record->psw & 0xFF,
+           record->bc, record->de, record->hl);
+}
+
+static bool same_record(const reference_record_t *expected, const reference_record_t *actual){
+    return expected->cycles == actual->cycles && expected->next_pc == actual->next_pc &&
+           expected->sp == actual->sp && expected->psw == actual->psw && expected->bc == actual->bc &&
+           expected->de == actual->de && expected->hl == actual->hl;
+}
+
+static int check_trace(const char *program, const char *path, bool blocks, unsigned min_block_percent){
+    uint8_t header[REFERENCE_HEADER_SIZE];
+    uint8_t *batch = (uint8_t*)malloc(REFERENCE_BATCH * REFERENCE_RECORD_SIZE);
+    uint64_t records = 0, decoded_records = 0;
+    uint32_t stride = 0;
+    i8080_t *cpu = init_i8080();
+    FILE *stream = fopen(path, "rb");
+    cpm_t cpm = { 0 };
+    bool ok, mismatch = false;
+    size_t count;
+    double start, elapsed;
+
+    ok = batch != NULL && cpu != NULL && stream != NULL && setup(cpu, &cpm, program);
+    if(ok && blocks){
+        ok = enable_block_cache(cpu);
+    }
+    if(ok){
+        ok = fread(header, REFERENCE_HEADER_SIZE, 1, stream) == 1 && memcmp(header, REFERENCE_MAGIC, 4) == 0 &&
+             header[4] == REFERENCE_VERSION;
+        stride = get32(header + 8);
+        ok = ok && stride != 0;
+    }
+
+    start = now();
+    while(ok && !mismatch && (count = fread(batch, REFERENCE_RECORD_SIZE, REFERENCE_BATCH, stream)) > 0){
+        for(size_t i = 0; i < count; i++){
+            reference_record_t expected, actual;
+            decode_record(batch + i * REFERENCE_RECORD_SIZE, &expected);
+            // Slices end on the first instruction boundary at or past the budget, which is
+            // exactly where the recorded instruction ended if the engine agrees so far
+            if(expected.cycles > cpu->cycles){
+                run_cycles(cpu, expected.cycles - cpu->cycles);
+            }
+            capture(cpu, &actual);
+            if(!same_record(&expected, &actual)){
+                printf("\nmismatch at record %llu (instruction %llu), after %02X at %04X\n",
+                       (unsigned long long)records, (unsigned long long)(records + 1) * stride,
+                       expected.opcode, expected.pc);
+                print_record("expected", &expected);
+                print_record("actual", &actual);
+                mismatch = true;
+                break;
+            }
+            if(blocks && cpu->blocks->running != &cpu->blocks->scratch){
+                decoded_records++;
+            }
+            records++;
+        }
+    }
+    elapsed = now() - start;
+    if(!ok){
+        printf("Failed to read %s\n", path);
+    }
+    else if(!mismatch){
+        printf("\nmatched %llu records (%llu instructions) in %.2fs, %.1f MIPS\n", (unsigned long long)records,
+               (unsigned long long)records * stride, elapsed,
+               elapsed > 0 ? (double)(records * stride) / elapsed / 1e6 : 0.0);
+        if(blocks){
+            printf("%llu records ended in a decoded block\n", (unsigned long long)decoded_records);
+            if(decoded_records * 100 < records * min_block_percent){
+                printf("fewer than %u%% of the records ran from decoded blocks\n", min_block_percent);
+                mismatch = true;
+            }
+        }
+    }
+    if(stream != NULL){
+        fclose(stream);
+    }
+    cpm_release(&cpm);
+    destroy_i8080(cpu);
+    free(batch);
+    return ok && !mismatch ? 0 : 1;
+}
+
+int main(int argc, char *argv[]){
+    if(argc >= 4 && strcmp(argv[1], "record") == 0){
+        uint32_t stride = argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 0) : 1;
+        uint64_t limit = argc > 5 ? strtoull(argv[5], NULL, 0) : DEFAULT_MAX_INSTRUCTIONS;
+        if(stride == 0){
+            stride = 1;
+        }
+        return record_trace(argv[2], argv[3], stride, limit);
+    }
+    if(argc >= 4 && strcmp(argv[1], "check") == 0){
+        bool blocks = argc > 4 && strcmp(argv[4], "blocks") == 0;
+        unsigned min_block_percent = argc > 5 ? (unsigned)strtoul(argv[5], NULL, 0) : 0;
+        return check_trace(argv[2], argv[3], blocks, min_block_percent);
+    }
+    printf("Usage: %s record <program.com> <trace> [stride] [max-instructions]\n", argv[0]);
+    printf("       %s check <program.com> <trace> [interpreter|blocks] [min-block-percent]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,403 @@
+; 8080 ALU exerciser for difftest. Runs each vector in TABLE through the instruction
+; patched into SLOT and compares A and F with the expected values, which come from the
+; flag rules in Intel's 8080 datasheet rather than from this emulator. Prints
+; "EXERCISER PASS" or "EXERCISER FAIL" through BDOS function 9 and returns to 0x0000.
+;
+; A vector is: opcode, A, B, F before, A after, F after. A zero opcode ends the table.
+; SLOT is a subroutine on a page of its own, so patching it leaves the driver loop cached
+; by the block engine.
+;
+; exerciser.hex is this file assembled at 0x100.
+
+        ORG     100H
+START:  LXI     H,TABLE
+LOOP:   MOV     A,M
+        ORA     A
+        JZ      PASS
+        STA     SLOT
+        INX     H
+        MOV     D,M
+        INX     H
+        MOV     B,M
+        INX     H
+        MOV     E,M
+        INX     H
+        PUSH    D
+        POP     PSW
+        CALL    SLOT
+        PUSH    PSW
+        POP     D
+        MOV     A,D
+        CMP     M
+        JNZ     FAIL
+        INX     H
+        MOV     A,E
+        CMP     M
+        JNZ     FAIL
+        INX     H
+        JMP     LOOP
+PASS:   LXI     D,PMSG
+        MVI     C,9
+        CALL    5
+        RET
+FAIL:   LXI     D,FMSG
+        MVI     C,9
+        CALL    5
+        RET
+PMSG:   DB      'EXERCISER PASS',13,10,'$'
+FMSG:   DB      'EXERCISER FAIL',13,10,'$'
+TABLE:
+        DB      080H,001H,07FH,003H,080H,092H ; ADD B
+        DB      080H,00FH,000H,012H,00FH,006H ; ADD B
+        DB      080H,00FH,001H,012H,010H,012H ; ADD B
+        DB      080H,07FH,000H,012H,07FH,002H ; ADD B
+        DB      080H,010H,099H,013H,0A9H,086H ; ADD B
+        DB      080H,0FFH,001H,013H,000H,057H ; ADD B
+        DB      080H,0FFH,000H,013H,0FFH,086H ; ADD B
+        DB      080H,00FH,010H,012H,01FH,002H ; ADD B
+        DB      080H,010H,001H,012H,011H,006H ; ADD B
+        DB      080H,000H,099H,002H,099H,086H ; ADD B
+        DB      080H,0FFH,0FFH,003H,0FEH,093H ; ADD B
+        DB      080H,099H,001H,013H,09AH,086H ; ADD B
+        DB      080H,001H,00FH,012H,010H,012H ; ADD B
+        DB      080H,000H,010H,013H,010H,002H ; ADD B
+        DB      080H,000H,000H,013H,000H,046H ; ADD B
+        DB      080H,0FFH,099H,013H,098H,093H ; ADD B
+        DB      080H,0FFH,080H,002H,07FH,003H ; ADD B
+        DB      080H,099H,080H,003H,019H,003H ; ADD B
+        DB      080H,0FFH,07FH,003H,07EH,017H ; ADD B
+        DB      080H,001H,099H,012H,09AH,086H ; ADD B
+        DB      080H,00FH,099H,013H,0A8H,092H ; ADD B
+        DB      080H,001H,000H,003H,001H,002H ; ADD B
+        DB      080H,099H,080H,013H,019H,003H ; ADD B
+        DB      080H,000H,001H,012H,001H,002H ; ADD B
+        DB      088H,00FH,00FH,012H,01EH,016H ; ADC B
+        DB      088H,00FH,000H,013H,010H,012H ; ADC B
+        DB      088H,07FH,099H,013H,019H,013H ; ADC B
+        DB      088H,000H,099H,003H,09AH,086H ; ADC B
+        DB      088H,07FH,000H,002H,07FH,002H ; ADC B
+        DB      088H,001H,001H,013H,003H,006H ; ADC B
+        DB      088H,010H,080H,013H,091H,082H ; ADC B
+        DB      088H,080H,07FH,003H,000H,057H ; ADC B
+        DB      088H,000H,000H,003H,001H,002H ; ADC B
+        DB      088H,07FH,001H,012H,080H,092H ; ADC B
+        DB      088H,099H,0FFH,002H,098H,093H ; ADC B
+        DB      088H,010H,00FH,002H,01FH,002H ; ADC B
+        DB      088H,099H,07FH,012H,018H,017H ; ADC B
+        DB      088H,080H,00FH,002H,08FH,082H ; ADC B
+        DB      088H,00FH,001H,002H,010H,012H ; ADC B
+        DB      088H,000H,0FFH,003H,000H,057H ; ADC B
+        DB      088H,000H,080H,013H,081H,086H ; ADC B
+        DB      088H,001H,07FH,013H,081H,096H ; ADC B
+        DB      088H,099H,080H,012H,019H,003H ; ADC B
+        DB      088H,000H,001H,012H,001H,002H ; ADC B
+        DB      088H,0FFH,099H,012H,098H,093H ; ADC B
+        DB      088H,010H,080H,002H,090H,086H ; ADC B
+        DB      088H,001H,080H,003H,082H,086H ; ADC B
+        DB      088H,099H,001H,003H,09BH,082H ; ADC B
+        DB      090H,000H,0FFH,012H,001H,003H ; SUB B
+        DB      090H,010H,000H,003H,010H,012H ; SUB B
+        DB      090H,000H,080H,012H,080H,093H ; SUB B
+        DB      090H,099H,00FH,012H,08AH,082H ; SUB B
+        DB      090H,001H,001H,013H,000H,056H ; SUB B
+        DB      090H,010H,001H,013H,00FH,006H ; SUB B
+        DB      090H,0FFH,000H,003H,0FFH,096H ; SUB B
+        DB      090H,07FH,0FFH,002H,080H,093H ; SUB B
+        DB      090H,080H,000H,012H,080H,092H ; SUB B
+        DB      090H,099H,07FH,013H,01AH,002H ; SUB B
+        DB      090H,00FH,07FH,002H,090H,097H ; SUB B
+        DB      090H,07FH,07FH,013H,000H,056H ; SUB B
+        DB      090H,000H,010H,002H,0F0H,097H ; SUB B
+        DB      090H,010H,07FH,003H,091H,083H ; SUB B
+        DB      090H,000H,00FH,013H,0F1H,083H ; SUB B
+        DB      090H,000H,00FH,003H,0F1H,083H ; SUB B
+        DB      090H,07FH,00FH,012H,070H,012H ; SUB B
+        DB      090H,010H,00FH,003H,001H,002H ; SUB B
+        DB      090H,001H,0FFH,002H,002H,003H ; SUB B
+        DB      090H,080H,001H,003H,07FH,002H ; SUB B
+        DB      090H,000H,099H,002H,067H,003H ; SUB B
+        DB      090H,000H,000H,002H,000H,056H ; SUB B
+        DB      090H,099H,0FFH,003H,09AH,087H ; SUB B
+        DB      090H,080H,00FH,002H,071H,006H ; SUB B
+        DB      098H,07FH,001H,013H,07DH,016H ; SBB B
+        DB      098H,099H,0FFH,012H,09AH,087H ; SBB B
+        DB      098H,000H,099H,013H,066H,007H ; SBB B
+        DB      098H,001H,010H,012H,0F1H,093H ; SBB B
+        DB      098H,010H,07FH,003H,090H,087H ; SBB B
+        DB      098H,0FFH,010H,002H,0EFH,092H ; SBB B
+        DB      098H,080H,07FH,003H,000H,046H ; SBB B
+        DB      098H,010H,080H,013H,08FH,083H ; SBB B
+        DB      098H,080H,099H,002H,0E7H,087H ; SBB B
+        DB      098H,010H,010H,012H,000H,056H ; SBB B
+        DB      098H,080H,099H,003H,0E6H,083H ; SBB B
+        DB      098H,080H,010H,003H,06FH,006H ; SBB B
+        DB      098H,010H,001H,002H,00FH,006H ; SBB B
+        DB      098H,07FH,07FH,013H,0FFH,087H ; SBB B
+        DB      098H,099H,07FH,012H,01AH,002H ; SBB B
+        DB      098H,07FH,000H,003H,07EH,016H ; SBB B
+        DB      098H,010H,001H,013H,00EH,002H ; SBB B
+        DB      098H,0FFH,001H,002H,0FEH,092H ; SBB B
+        DB      098H,00FH,07FH,012H,090H,097H ; SBB B
+        DB      098H,00FH,0FFH,003H,00FH,007H ; SBB B
+        DB      098H,099H,00FH,003H,089H,082H ; SBB B
+        DB      098H,099H,001H,002H,098H,092H ; SBB B
+        DB      098H,080H,010H,012H,070H,012H ; SBB B
+        DB      098H,099H,099H,012H,000H,056H ; SBB B
+        DB      0A0H,0FFH,001H,002H,001H,012H ; ANA B
+        DB      0A0H,080H,00FH,002H,000H,056H ; ANA B
+        DB      0A0H,010H,00FH,012H,000H,056H ; ANA B
+        DB      0A0H,099H,07FH,012H,019H,012H ; ANA B
+        DB      0A0H,010H,07FH,003H,010H,012H ; ANA B
+        DB      0A0H,099H,010H,013H,010H,012H ; ANA B
+        DB      0A0H,001H,000H,003H,000H,046H ; ANA B
+        DB      0A0H,010H,080H,002H,000H,046H ; ANA B
+        DB      0A0H,0FFH,080H,002H,080H,092H ; ANA B
+        DB      0A0H,0FFH,000H,003H,000H,056H ; ANA B
+        DB      0A0H,07FH,000H,003H,000H,056H ; ANA B
+        DB      0A0H,080H,0FFH,002H,080H,092H ; ANA B
+        DB      0A0H,000H,010H,003H,000H,046H ; ANA B
+        DB      0A0H,080H,099H,013H,080H,092H ; ANA B
+        DB      0A0H,010H,099H,002H,010H,012H ; ANA B
+        DB      0A0H,001H,07FH,013H,001H,012H ; ANA B
+        DB      0A0H,099H,0FFH,003H,099H,096H ; ANA B
+        DB      0A0H,00FH,00FH,013H,00FH,016H ; ANA B
+        DB      0A0H,0FFH,00FH,013H,00FH,016H ; ANA B
+        DB      0A0H,00FH,010H,012H,000H,056H ; ANA B
+        DB      0A0H,080H,07FH,012H,000H,056H ; ANA B
+        DB      0A0H,0FFH,099H,012H,099H,096H ; ANA B
+        DB      0A0H,0FFH,099H,003H,099H,096H ; ANA B
+        DB      0A0H,07FH,0FFH,002H,07FH,012H ; ANA B
+        DB      0A8H,07FH,080H,013H,0FFH,086H ; XRA B
+        DB      0A8H,001H,010H,013H,011H,006H ; XRA B
+        DB      0A8H,080H,00FH,012H,08FH,082H ; XRA B
+        DB      0A8H,099H,0FFH,003H,066H,006H ; XRA B
+        DB      0A8H,0FFH,001H,003H,0FEH,082H ; XRA B
+        DB      0A8H,000H,010H,012H,010H,002H ; XRA B
+        DB      0A8H,000H,000H,003H,000H,046H ; XRA B
+        DB      0A8H,00FH,099H,002H,096H,086H ; XRA B
+        DB      0A8H,000H,001H,012H,001H,002H ; XRA B
+        DB      0A8H,010H,001H,012H,011H,006H ; XRA B
+        DB      0A8H,0FFH,080H,013H,07FH,002H ; XRA B
+        DB      0A8H,080H,099H,013H,019H,002H ; XRA B
+        DB      0A8H,07FH,000H,002H,07FH,002H ; XRA B
+        DB      0A8H,07FH,080H,002H,0FFH,086H ; XRA B
+        DB      0A8H,001H,000H,002H,001H,002H ; XRA B
+        DB      0A8H,099H,001H,003H,098H,082H ; XRA B
+        DB      0A8H,001H,001H,002H,000H,046H ; XRA B
+        DB      0A8H,00FH,010H,013H,01FH,002H ; XRA B
+        DB      0A8H,099H,080H,013H,019H,002H ; XRA B
+        DB      0A8H,000H,001H,013H,001H,002H ; XRA B
+        DB      0A8H,000H,00FH,002H,00FH,006H ; XRA B
+        DB      0A8H,001H,0FFH,013H,0FEH,082H ; XRA B
+        DB      0A8H,07FH,001H,013H,07EH,006H ; XRA B
+        DB      0A8H,010H,080H,002H,090H,086H ; XRA B
+        DB      0B0H,080H,07FH,012H,0FFH,086H ; ORA B
+        DB      0B0H,07FH,0FFH,012H,0FFH,086H ; ORA B
+        DB      0B0H,07FH,080H,013H,0FFH,086H ; ORA B
+        DB      0B0H,000H,010H,002H,010H,002H ; ORA B
+        DB      0B0H,099H,000H,003H,099H,086H ; ORA B
+        DB      0B0H,080H,001H,002H,081H,086H ; ORA B
+        DB      0B0H,000H,00FH,012H,00FH,006H ; ORA B
+        DB      0B0H,07FH,07FH,013H,07FH,002H ; ORA B
+        DB      0B0H,001H,010H,013H,011H,006H ; ORA B
+        DB      0B0H,080H,099H,012H,099H,086H ; ORA B
+        DB      0B0H,080H,00FH,002H,08FH,082H ; ORA B
+        DB      0B0H,000H,000H,013H,000H,046H ; ORA B
+        DB      0B0H,0FFH,001H,003H,0FFH,086H ; ORA B
+        DB      0B0H,00FH,099H,013H,09FH,086H ; ORA B
+        DB      0B0H,000H,010H,003H,010H,002H ; ORA B
+        DB      0B0H,099H,010H,012H,099H,086H ; ORA B
+        DB      0B0H,000H,099H,013H,099H,086H ; ORA B
+        DB      0B0H,00FH,080H,002H,08FH,082H ; ORA B
+        DB      0B0H,099H,00FH,013H,09FH,086H ; ORA B
+        DB      0B0H,001H,000H,013H,001H,002H ; ORA B
+        DB      0B0H,0FFH,099H,003H,0FFH,086H ; ORA B
+        DB      0B0H,099H,080H,003H,099H,086H ; ORA B
+        DB      0B0H,001H,099H,003H,099H,086H ; ORA B
+        DB      0B0H,00FH,010H,013H,01FH,002H ; ORA B
+        DB      0B8H,000H,080H,013H,000H,093H ; CMP B
+        DB      0B8H,00FH,001H,002H,00FH,012H ; CMP B
+        DB      0B8H,0FFH,0FFH,012H,0FFH,056H ; CMP B
+        DB      0B8H,07FH,001H,002H,07FH,016H ; CMP B
+        DB      0B8H,001H,001H,012H,001H,056H ; CMP B
+        DB      0B8H,080H,07FH,002H,080H,002H ; CMP B
+        DB      0B8H,099H,080H,003H,099H,012H ; CMP B
+        DB      0B8H,010H,000H,013H,010H,012H ; CMP B
+        DB      0B8H,099H,00FH,003H,099H,082H ; CMP B
+        DB      0B8H,00FH,000H,003H,00FH,016H ; CMP B
+        DB      0B8H,00FH,00FH,003H,00FH,056H ; CMP B
+        DB      0B8H,00FH,0FFH,013H,00FH,013H ; CMP B
+        DB      0B8H,099H,099H,013H,099H,056H ; CMP B
+        DB      0B8H,000H,000H,002H,000H,056H ; CMP B
+        DB      0B8H,07FH,099H,012H,07FH,093H ; CMP B
+        DB      0B8H,00FH,010H,012H,00FH,097H ; CMP B
+        DB      0B8H,00FH,001H,013H,00FH,012H ; CMP B
+        DB      0B8H,010H,0FFH,003H,010H,007H ; CMP B
+        DB      0B8H,001H,07FH,012H,001H,087H ; CMP B
+        DB      0B8H,00FH,080H,002H,00FH,093H ; CMP B
+        DB      0B8H,00FH,000H,012H,00FH,016H ; CMP B
+        DB      0B8H,07FH,0FFH,003H,07FH,093H ; CMP B
+        DB      0B8H,080H,0FFH,003H,080H,087H ; CMP B
+        DB      0B8H,099H,000H,013H,099H,096H ; CMP B
+        DB      03CH,080H,000H,012H,081H,086H ; INR A
+        DB      03CH,080H,000H,003H,081H,087H ; INR A
+        DB      03CH,0FFH,000H,002H,000H,056H ; INR A
+        DB      03CH,010H,000H,003H,011H,007H ; INR A
+        DB      03CH,099H,000H,013H,09AH,087H ; INR A
+        DB      03CH,099H,000H,003H,09AH,087H ; INR A
+        DB      03CH,00FH,000H,012H,010H,012H ; INR A
+        DB      03CH,000H,000H,012H,001H,002H ; INR A
+        DB      03CH,010H,000H,013H,011H,007H ; INR A
+        DB      03CH,080H,000H,002H,081H,086H ; INR A
+        DB      03CH,099H,000H,002H,09AH,086H ; INR A
+        DB      03CH,0FFH,000H,003H,000H,057H ; INR A
+        DB      03DH,080H,000H,003H,07FH,003H ; DCR A
+        DB      03DH,0FFH,000H,013H,0FEH,093H ; DCR A
+        DB      03DH,001H,000H,013H,000H,057H ; DCR A
+        DB      03DH,099H,000H,012H,098H,092H ; DCR A
+        DB      03DH,07FH,000H,002H,07EH,016H ; DCR A
+        DB      03DH,010H,000H,012H,00FH,006H ; DCR A
+        DB      03DH,07FH,000H,003H,07EH,017H ; DCR A
+        DB      03DH,000H,000H,012H,0FFH,086H ; DCR A
+        DB      03DH,07FH,000H,013H,07EH,017H ; DCR A
+        DB      03DH,00FH,000H,002H,00EH,012H ; DCR A
+        DB      03DH,0FFH,000H,003H,0FEH,093H ; DCR A
+        DB      03DH,010H,000H,013H,00FH,007H ; DCR A
+        DB      027H,000H,000H,002H,000H,046H ; DAA
+        DB      027H,000H,000H,003H,060H,007H ; DAA
+        DB      027H,000H,000H,012H,006H,006H ; DAA
+        DB      027H,000H,000H,013H,066H,007H ; DAA
+        DB      027H,009H,000H,002H,009H,006H ; DAA
+        DB      027H,009H,000H,003H,069H,007H ; DAA
+        DB      027H,009H,000H,012H,00FH,006H ; DAA
+        DB      027H,009H,000H,013H,06FH,007H ; DAA
+        DB      027H,00AH,000H,002H,010H,012H ; DAA
+        DB      027H,00AH,000H,003H,070H,013H ; DAA
+        DB      027H,00AH,000H,012H,010H,012H ; DAA
+        DB      027H,00AH,000H,013H,070H,013H ; DAA
+        DB      027H,019H,000H,002H,019H,002H ; DAA
+        DB      027H,019H,000H,003H,079H,003H ; DAA
+        DB      027H,019H,000H,012H,01FH,002H ; DAA
+        DB      027H,019H,000H,013H,07FH,003H ; DAA
+        DB      027H,01AH,000H,002H,020H,012H ; DAA
+        DB      027H,01AH,000H,003H,080H,093H ; DAA
+        DB      027H,01AH,000H,012H,020H,012H ; DAA
+        DB      027H,01AH,000H,013H,080H,093H ; DAA
+        DB      027H,05FH,000H,002H,065H,016H ; DAA
+        DB      027H,05FH,000H,003H,0C5H,097H ; DAA
+        DB      027H,05FH,000H,012H,065H,016H ; DAA
+        DB      027H,05FH,000H,013H,0C5H,097H ; DAA
+        DB      027H,099H,000H,002H,099H,086H ; DAA
+        DB      027H,099H,000H,003H,0F9H,087H ; DAA
+        DB      027H,099H,000H,012H,09FH,086H ; DAA
+        DB      027H,099H,000H,013H,0FFH,087H ; DAA
+        DB      027H,09AH,000H,002H,000H,057H ; DAA
+        DB      027H,09AH,000H,003H,000H,057H ; DAA
+        DB      027H,09AH,000H,012H,000H,057H ; DAA
+        DB      027H,09AH,000H,013H,000H,057H ; DAA
+        DB      027H,0A0H,000H,002H,000H,047H ; DAA
+        DB      027H,0A0H,000H,003H,000H,047H ; DAA
+        DB      027H,0A0H,000H,012H,006H,007H ; DAA
+        DB      027H,0A0H,000H,013H,006H,007H ; DAA
+        DB      027H,0FAH,000H,002H,060H,017H ; DAA
+        DB      027H,0FAH,000H,003H,060H,017H ; DAA
+        DB      027H,0FAH,000H,012H,060H,017H ; DAA
+        DB      027H,0FAH,000H,013H,060H,017H ; DAA
+        DB      027H,0FFH,000H,002H,065H,017H ; DAA
+        DB      027H,0FFH,000H,003H,065H,017H ; DAA
+        DB      027H,0FFH,000H,012H,065H,017H ; DAA
+        DB      027H,0FFH,000H,013H,065H,017H ; DAA
+        DB      027H,042H,000H,002H,042H,006H ; DAA
+        DB      027H,042H,000H,003H,0A2H,083H ; DAA
+        DB      027H,042H,000H,012H,048H,006H ; DAA
+        DB      027H,042H,000H,013H,0A8H,083H ; DAA
+        DB      007H,080H,000H,002H,001H,003H ; RLC
+        DB      007H,0FFH,000H,012H,0FFH,013H ; RLC
+        DB      007H,001H,000H,013H,002H,012H ; RLC
+        DB      007H,000H,000H,003H,000H,002H ; RLC
+        DB      007H,07FH,000H,013H,0FEH,012H ; RLC
+        DB      007H,0FFH,000H,013H,0FFH,013H ; RLC
+        DB      007H,010H,000H,002H,020H,002H ; RLC
+        DB      007H,00FH,000H,013H,01EH,012H ; RLC
+        DB      007H,001H,000H,012H,002H,012H ; RLC
+        DB      007H,001H,000H,003H,002H,002H ; RLC
+        DB      007H,07FH,000H,002H,0FEH,002H ; RLC
+        DB      007H,001H,000H,002H,002H,002H ; RLC
+        DB      00FH,07FH,000H,002H,0BFH,003H ; RRC
+        DB      00FH,00FH,000H,003H,087H,003H ; RRC
+        DB      00FH,099H,000H,012H,0CCH,013H ; RRC
+        DB      00FH,010H,000H,002H,008H,002H ; RRC
+        DB      00FH,099H,000H,003H,0CCH,003H ; RRC
+        DB      00FH,00FH,000H,002H,087H,003H ; RRC
+        DB      00FH,0FFH,000H,002H,0FFH,003H ; RRC
+        DB      00FH,07FH,000H,012H,0BFH,013H ; RRC
+        DB      00FH,001H,000H,012H,080H,013H ; RRC
+        DB      00FH,0FFH,000H,012H,0FFH,013H ; RRC
+        DB      00FH,000H,000H,013H,000H,012H ; RRC
+        DB      00FH,07FH,000H,013H,0BFH,013H ; RRC
+        DB      017H,0FFH,000H,003H,0FFH,003H ; RAL
+        DB      017H,0FFH,000H,013H,0FFH,013H ; RAL
+        DB      017H,00FH,000H,013H,01FH,012H ; RAL
+        DB      017H,00FH,000H,012H,01EH,012H ; RAL
+        DB      017H,000H,000H,002H,000H,002H ; RAL
+        DB      017H,000H,000H,013H,001H,012H ; RAL
+        DB      017H,099H,000H,003H,033H,003H ; RAL
+        DB      017H,099H,000H,002H,032H,003H ; RAL
+        DB      017H,080H,000H,013H,001H,013H ; RAL
+        DB      017H,0FFH,000H,012H,0FEH,013H ; RAL
+        DB      017H,080H,000H,002H,000H,003H ; RAL
+        DB      017H,010H,000H,003H,021H,002H ; RAL
+        DB      01FH,001H,000H,002H,000H,003H ; RAR
+        DB      01FH,00FH,000H,012H,007H,013H ; RAR
+        DB      01FH,0FFH,000H,012H,07FH,013H ; RAR
+        DB      01FH,07FH,000H,012H,03FH,013H ; RAR
+        DB      01FH,07FH,000H,002H,03FH,003H ; RAR
+        DB      01FH,001H,000H,003H,080H,003H ; RAR
+        DB      01FH,010H,000H,012H,008H,012H ; RAR
+        DB      01FH,001H,000H,012H,000H,013H ; RAR
+        DB      01FH,001H,000H,013H,080H,013H ; RAR
+        DB      01FH,099H,000H,002H,04CH,003H ; RAR
+        DB      01FH,080H,000H,002H,040H,002H ; RAR
+        DB      01FH,080H,000H,003H,0C0H,002H ; RAR
+        DB      02FH,010H,000H,003H,0EFH,003H ; CMA
+        DB      02FH,000H,000H,002H,0FFH,002H ; CMA
+        DB      02FH,099H,000H,012H,066H,012H ; CMA
+        DB      02FH,001H,000H,012H,0FEH,012H ; CMA
+        DB      02FH,0FFH,000H,012H,000H,012H ; CMA
+        DB      02FH,001H,000H,013H,0FEH,013H ; CMA
+        DB      02FH,00FH,000H,012H,0F0H,012H ; CMA
+        DB      02FH,07FH,000H,013H,080H,013H ; CMA
+        DB      02FH,00FH,000H,003H,0F0H,003H ; CMA
+        DB      02FH,099H,000H,002H,066H,002H ; CMA
+        DB      02FH,0FFH,000H,002H,000H,002H ; CMA
+        DB      02FH,080H,000H,013H,07FH,013H ; CMA
+        DB      037H,0FFH,000H,013H,0FFH,013H ; STC
+        DB      037H,000H,000H,012H,000H,013H ; STC
+        DB      037H,00FH,000H,013H,00FH,013H ; STC
+        DB      037H,080H,000H,013H,080H,013H ; STC
+        DB      037H,010H,000H,012H,010H,013H ; STC
+        DB      037H,001H,000H,002H,001H,003H ; STC
+        DB      037H,0FFH,000H,002H,0FFH,003H ; STC
+        DB      037H,099H,000H,002H,099H,003H ; STC
+        DB      037H,099H,000H,003H,099H,003H ; STC
+        DB      037H,010H,000H,003H,010H,003H ; STC
+        DB      037H,0FFH,000H,003H,0FFH,003H ; STC
+        DB      037H,00FH,000H,003H,00FH,003H ; STC
+        DB      03FH,001H,000H,012H,001H,013H ; CMC
+        DB      03FH,010H,000H,003H,010H,002H ; CMC
+        DB      03FH,010H,000H,002H,010H,003H ; CMC
+        DB      03FH,07FH,000H,003H,07FH,002H ; CMC
+        DB      03FH,07FH,000H,012H,07FH,013H ; CMC
+        DB      03FH,001H,000H,013H,001H,012H ; CMC
+        DB      03FH,000H,000H,002H,000H,003H ; CMC
+        DB      03FH,07FH,000H,013H,07FH,012H ; CMC
+        DB      03FH,0FFH,000H,002H,0FFH,003H ; CMC
+        DB      03FH,080H,000H,003H,080H,002H ; CMC
+        DB      03FH,080H,000H,002H,080H,003H ; CMC
+        DB      03FH,001H,000H,002H,001H,003H ; CMC
+        DB      0
+
+        ORG     0A00H
+SLOT:   NOP
+        RET
+        END
@@ -0,0 +1,140 @@
+//
+// Created by leonv on 5/31/2024.
+//
+
+// Regression test for the fleet runner, run by CTest.
+//
+//   fleettest [jobs] [threads]
+//
+// Runs a mix of jobs that count down and halt, jobs that spin until their cycle cap and one
+// whose image does not fit, on a few worker threads so that the quick ones finish early and
+// steal the rest. Every job's status, cycle count and registers have to match the same
+// program single-stepped with emulate_cycle(), and `finish` has to have seen each job that
+// ran. Exit status is 0 on success.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "i8080_fleet.h"
+#include "i8080_pool.h"
+
+#define DEFAULT_JOBS 200
+#define DEFAULT_THREADS 4
+
+// Counts B down to zero and halts
+static const uint8_t countdown[] = {
+    0x05,             // 0100 DCR B
+    0xC2, 0x00, 0x01, // 0101 JNZ 0100
+    0x76,             // 0104 HLT
+};
+
+// Adds B into HL forever
+static const uint8_t spinner[] = {
+    0x09,             // 0100 DAD B
+    0xC3, 0x00, 0x01, // 0101 JMP 0100
+};
+
+typedef struct {
+    uint8_t B;
+    bool finished;
+} job_context_t;
+
+static void setup(i8080_t *cpu, fleet_job_t *job){
+    cpu->B = ((job_context_t*)job->context)->B;
+}
+
+static void finish(i8080_t *cpu, fleet_job_t *job){
+    (void)cpu;
+    ((job_context_t*)job->context)->finished = true;
+}
+
+// The job single-stepped on a machine of its own. Counts it in `halted` if it halts there.
+static bool check_job(i8080_t *cpu, const fleet_job_t *job, size_t index, size_t *halted){
+    fleet_status_t status = FLEET_CYCLE_CAP;
+    const job_context_t *context = (const job_context_t*)job->context;
+
+    if(!reset_to_image(cpu, job->image, job->size, job->origin)){
+        status = FLEET_ERROR;
+    }
+    else{
+        cpu->B = context->B;
+        while(cpu->cycles < job->cycle_cap){
+            emulate_cycle(cpu);
+            if(cpu->halted){
+                status = FLEET_HALTED;
+                break;
+            }
+        }
+    }
+    *halted += status == FLEET_HALTED;
+    if(job->status != status){
+        printf("FAIL: job %zu ended with status %d instead of %d\n", index, job->status, status);
+        return false;
+    }
+    if(status == FLEET_ERROR){
+        return true;
+    }
+    if(job->cycles != cpu->cycles || job->PSW != cpu->PSW || job->BC != cpu->BC || job->DE != cpu->DE ||
+       job->HL != cpu->HL || job->SP != cpu->SP || job->PC != cpu->PC || !context->finished){
+        printf("FAIL: job %zu: cycles %llu PC %04X PSW %04X BC %04X HL %04X, single-stepping gives "
+               "cycles %llu PC %04X PSW %04X BC %04X HL %04X%s\n", index, (unsigned long long)job->cycles,
+               job->PC, job->PSW, job->BC, job->HL, (unsigned long long)cpu->cycles, cpu->PC, cpu->PSW,
+               cpu->BC, cpu->HL, context->finished ? "" : ", finish() not called");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]){
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_JOBS;
+    fleet_options_t options = { argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : DEFAULT_THREADS, setup, finish };
+    fleet_job_t *jobs = (fleet_job_t*)calloc(count, sizeof(fleet_job_t));
+    job_context_t *contexts = (job_context_t*)calloc(count, sizeof(job_context_t));
+    i8080_t *cpu = init_i8080();
+    size_t halted, expected = 0;
+    bool passed = true;
+
+    if(count < 1 || jobs == NULL || contexts == NULL || cpu == NULL){
+        printf(count < 1 ? "Usage: %s [jobs] [threads]\n" : "Out of memory\n", argv[0]);
+        destroy_i8080(cpu);
+        free(jobs);
+        free(contexts);
+        return count < 1 ? 2 : 1;
+    }
+    for(size_t i = 0; i < count; i++){
+        contexts[i].B = (uint8_t)(i * 37 + 1);
+        jobs[i].context = &contexts[i];
+        jobs[i].origin = 0x100;
+        // Every third job spins, with caps spread out so the workers' shares come out uneven
+        if(i % 3 == 2){
+            jobs[i].image = spinner;
+            jobs[i].size = sizeof(spinner);
+            jobs[i].cycle_cap = 20000 + (i % 7) * 30011;
+        }
+        else{
+            jobs[i].image = countdown;
+            jobs[i].size = sizeof(countdown);
+            // Some countdowns hit a cap set partway through
+            jobs[i].cycle_cap = i % 5 == 0 ? contexts[i].B * 7 + 1 : 100000;
+        }
+    }
+    // An image that does not fit below the end of memory
+    jobs[count - 1].image = countdown;
+    jobs[count - 1].size = sizeof(countdown);
+    jobs[count - 1].origin = 0xFFFE;
+
+    halted = run_fleet(jobs, count, &options);
+    for(size_t i = 0; i < count; i++){
+        passed = check_job(cpu, &jobs[i], i, &expected) && passed;
+    }
+    if(halted != expected){
+        printf("FAIL: run_fleet() reported %zu halted jobs instead of %zu\n", halted, expected);
+        passed = false;
+    }
+    print_fleet_summary(jobs, count);
+
+    destroy_i8080(cpu);
+    free(jobs);
+    free(contexts);
+    return passed ? 0 : 1;
+}
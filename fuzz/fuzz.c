@@ -0,0 +1,211 @@
+//
+// Created by leonv on 5/28/2024.
+//
+
+// Coverage-guided fuzzing harness, built with I8080_FUZZ. Loads a CP/M-style program at
+// 0x100 that reads its input through the harness port (see i8080_fuzz.h) and runs inputs
+// against it, every one from the state right after loading.
+//
+//   fuzz [-p port] [-m address capacity] [-c cycles] [-n repetitions] [-b] <program.com> [input]...
+//
+// Under afl-fuzz (__AFL_SHM_ID set) edges go straight to AFL's shared bitmap and the harness
+// acts as its own fork server: every input is run in this process after a snapshot reset
+// rather than in a forked child. Give the input as @@, or leave it out to read stdin. A crash
+// is reported to AFL as SIGABRT; a hang is only caught by the cycle budget, which should end
+// well within afl-fuzz's -t. Example: afl-fuzz -i seeds -o findings -- ./fuzz parser.com @@
+//
+// Otherwise the inputs are replayed `repetitions` times and each one's status and edge count
+// printed, followed by the total edges and executions per second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/shm.h>
+
+#include "i8080_fuzz.h"
+#include "i8080_block.h"
+#include "file_reader.h"
+
+#define DEFAULT_PORT 0x10
+#define DEFAULT_MAX_CYCLES 10000000ULL
+#define MAX_INPUT_SIZE 0x10000 // More than a 64K machine can hold anyway
+
+#define AFL_SHM_ENV "__AFL_SHM_ID"
+#define FORKSRV_FD 198 // AFL's control pipe; status goes back on FORKSRV_FD + 1
+
+static const char *status_names[] = { "exit", "crash", "hang" };
+
+static double now(void){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+// Whole file, or stdin when `path` is NULL; returns the size or -1
+static long read_input(const char *path, uint8_t *buffer){
+    FILE *stream = path != NULL ? fopen(path, "rb") : stdin;
+    size_t size;
+    if(stream == NULL){
+        return -1;
+    }
+    if(path == NULL){
+        // afl-fuzz rewrites the same file behind stdin for every input
+        rewind(stream);
+        clearerr(stream);
+    }
+    size = fread(buffer, 1, MAX_INPUT_SIZE, stream);
+    if(path != NULL){
+        fclose(stream);
+    }
+    return (long)size;
+}
+
+// The program returns to 0x0000 when done, where a HLT ends the run; BDOS calls return at once
+static bool setup(i8080_t *cpu, const char *program){
+    if(load_file(cpu, program, COM_ORIGIN) < 0){
+        printf("Failed to load %s\n", program);
+        return false;
+    }
+    write_memory(cpu, 0x0000, 0x76); // HLT
+    write_memory(cpu, 0x0005, 0xC9); // RET
+    cpu->SP = 0xFFFE; // Holding a return address of 0x0000
+    return true;
+}
+
+static int run_afl(fuzz_t *fuzz, const char *path, uint8_t *buffer){
+    uint32_t message = 0;
+    long size;
+
+    // Without a fork server listening, run the one input and report like a native target
+    if(write(FORKSRV_FD + 1, &message, sizeof(message)) != sizeof(message)){
+        size = read_input(path, buffer);
+        if(size < 0){
+            return 1;
+        }
+        if(fuzz_run(fuzz, buffer, (size_t)size) == FUZZ_CRASH){
+            abort();
+        }
+        return 0;
+    }
+    while(read(FORKSRV_FD, &message, sizeof(message)) == sizeof(message)){
+        uint32_t pid = (uint32_t)getpid();
+        uint32_t status = 0;
+        if(write(FORKSRV_FD + 1, &pid, sizeof(pid)) != sizeof(pid)){
+            return 1;
+        }
+        size = read_input(path, buffer);
+        if(size >= 0 && fuzz_run(fuzz, buffer, (size_t)size) == FUZZ_CRASH){
+            status = SIGABRT; // As waitpid() reports a child killed by it
+        }
+        if(write(FORKSRV_FD + 1, &status, sizeof(status)) != sizeof(status)){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int replay(fuzz_t *fuzz, char **paths, int count, int repetitions, uint8_t *buffer){
+    uint64_t executions = 0;
+    double elapsed = 0;
+    bool failed = false;
+
+    for(int i = 0; i < count; i++){
+        long size = read_input(paths[i], buffer);
+        fuzz_status_t status = FUZZ_EXIT;
+        double start;
+        if(size < 0){
+            printf("Failed to read %s\n", paths[i]);
+            failed = true;
+            continue;
+        }
+        fuzz_clear_coverage(fuzz);
+        start = now();
+        for(int r = 0; r < repetitions; r++){
+            status = fuzz_run(fuzz, buffer, (size_t)size);
+        }
+        elapsed += now() - start;
+        executions += repetitions;
+        printf("%s: %s, %zu edges\n", paths[i], status_names[status], fuzz_edges(fuzz));
+        failed |= status == FUZZ_CRASH;
+    }
+    printf("%llu executions in %.2fs, %.0f execs/s\n", (unsigned long long)executions, elapsed,
+           elapsed > 0 ? (double)executions / elapsed : 0.0);
+    return failed ? 1 : 0;
+}
+
+static void usage(const char *name){
+    printf("Usage: %s [-p port] [-m address capacity] [-c cycles] [-n repetitions] [-b] <program.com> [input]...\n", name);
+}
+
+int main(int argc, char *argv[]){
+    uint8_t port = DEFAULT_PORT;
+    uint16_t address = 0, capacity = 0;
+    uint64_t cycles = DEFAULT_MAX_CYCLES;
+    int repetitions = 1;
+    bool blocks = false;
+    const char *shm = getenv(AFL_SHM_ENV);
+    uint8_t *coverage = NULL;
+    uint8_t *buffer;
+    i8080_t *cpu;
+    fuzz_t fuzz;
+    int arg = 1, result;
+
+    for(; arg < argc && argv[arg][0] == '-'; arg++){
+        if(strcmp(argv[arg], "-p") == 0 && arg + 1 < argc){
+            port = (uint8_t)strtoul(argv[++arg], NULL, 0);
+        }
+        else if(strcmp(argv[arg], "-m") == 0 && arg + 2 < argc){
+            address = (uint16_t)strtoul(argv[++arg], NULL, 0);
+            capacity = (uint16_t)strtoul(argv[++arg], NULL, 0);
+        }
+        else if(strcmp(argv[arg], "-c") == 0 && arg + 1 < argc){
+            cycles = strtoull(argv[++arg], NULL, 0);
+        }
+        else if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc){
+            repetitions = atoi(argv[++arg]);
+        }
+        else if(strcmp(argv[arg], "-b") == 0){
+            blocks = true;
+        }
+        else{
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(arg >= argc || cycles == 0 || repetitions < 1 || (shm == NULL && arg + 1 >= argc)){
+        usage(argv[0]);
+        return 2;
+    }
+
+    if(shm != NULL){
+        coverage = (uint8_t*)shmat(atoi(shm), NULL, 0);
+        if(coverage == (uint8_t*)-1){
+            printf("Failed to attach AFL's bitmap\n");
+            return 1;
+        }
+    }
+    buffer = (uint8_t*)malloc(MAX_INPUT_SIZE);
+    cpu = init_i8080();
+    if(buffer == NULL || cpu == NULL || !setup(cpu, argv[arg]) || (blocks && !enable_block_cache(cpu)) ||
+       !fuzz_init(&fuzz, cpu, coverage, port, cycles) || !fuzz_input_region(&fuzz, address, capacity)){
+        printf("Failed to set up the harness\n");
+        destroy_i8080(cpu);
+        free(buffer);
+        return 1;
+    }
+
+    if(shm != NULL){
+        result = run_afl(&fuzz, arg + 1 < argc ? argv[arg + 1] : NULL, buffer);
+    }
+    else{
+        result = replay(&fuzz, argv + arg + 1, argc - arg - 1, repetitions, buffer);
+    }
+
+    fuzz_release(&fuzz);
+    destroy_i8080(cpu);
+    free(buffer);
+    return result;
+}
@@ -0,0 +1,234 @@
+//
+// Created by leonv on 4/24/2024.
+//
+
+#include "file_reader.h"
+
+#include <ctype.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+#define ROUND_TO_PAGE(size) (((size) + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1))
+
+int read_file(const char* fileName, char **buffer){
+    FILE* file;
+    long size;
+
+    file = fopen(fileName, "rb");
+    if(file == NULL){
+        return -1;
+    }
+    if(fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0){
+        fclose(file);
+        return -1;
+    }
+    *buffer = (char*)malloc(size > 0 ? size : 1);
+    if(*buffer == NULL || fread(*buffer, 1, size, file) != (size_t)size){
+        free(*buffer);
+        *buffer = NULL;
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return (int)size;
+}
+
+bool open_image(const char *fileName, file_image_t *image){
+    image->data = NULL;
+    image->size = 0;
+    image->mapped = false;
+#ifdef HAVE_MMAP
+    int fd = open(fileName, O_RDONLY);
+    struct stat st;
+    if(fd < 0){
+        return false;
+    }
+    if(fstat(fd, &st) == 0 && st.st_size > 0){
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED){
+            image->data = (uint8_t*)data;
+            image->size = st.st_size;
+            image->mapped = true;
+        }
+    }
+    close(fd);
+    if(image->mapped){
+        return true;
+    }
+#endif
+    // No mmap (or an empty file): read it into a buffer padded to a whole number of pages
+    char *buffer = NULL;
+    int size = read_file(fileName, &buffer);
+    if(size < 0){
+        return false;
+    }
+    image->data = (uint8_t*)calloc(1, ROUND_TO_PAGE((size_t)size) + PAGE_SIZE);
+    if(image->data == NULL){
+        free(buffer);
+        return false;
+    }
+    memcpy(image->data, buffer, size);
+    image->size = size;
+    free(buffer);
+    return true;
+}
+
+void close_image(file_image_t *image){
+    if(image->data != NULL){
+#ifdef HAVE_MMAP
+        if(image->mapped){
+            munmap(image->data, image->size);
+        }
+        else
+#endif
+        {
+            free(image->data);
+        }
+    }
+    image->data = NULL;
+    image->size = 0;
+    image->mapped = false;
+}
+
+// Copies page by page, straight into the backing storage wherever the page is plain RAM.
+static void copy_to_memory(i8080_t *cpu, uint16_t origin, const uint8_t *data, size_t size){
+    size_t offset = 0;
+    while(offset < size){
+        uint16_t address = origin + offset;
+        size_t chunk = PAGE_SIZE - PAGE_OFFSET(address);
+        uint8_t *page = cpu->map.write[PAGE_OF(address)];
+        if(chunk > size - offset){
+            chunk = size - offset;
+        }
+        if(page != NULL){
+            memcpy(page + PAGE_OFFSET(address), data + offset, chunk);
+        }
+        else{
+            for(size_t i = 0; i < chunk; i++){
+                write_memory(cpu, address + i, data[offset + i]);
+            }
+        }
+        offset += chunk;
+    }
+}
+
+int load_binary(i8080_t *cpu, const file_image_t *image, uint16_t origin){
+    if(cpu == NULL || image == NULL || image->size > (size_t)(MEMORY_SIZE - origin)){
+        return -1;
+    }
+    copy_to_memory(cpu, origin, image->data, image->size);
+    return (int)image->size;
+}
+
+static int hex_digit(uint8_t c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static int hex_byte(const uint8_t *text){
+    int high = hex_digit(text[0]);
+    int low = hex_digit(text[1]);
+    return (high < 0 || low < 0) ? -1 : (high << 4) | low;
+}
+
+int load_hex(i8080_t *cpu, const file_image_t *image){
+    const uint8_t *text = image->data;
+    size_t size = image->size;
+    size_t pos = 0;
+    int loaded = 0;
+    uint8_t record[4 + 255 + 1];
+
+    if(cpu == NULL){
+        return -1;
+    }
+    while(pos < size){
+        if(isspace(text[pos])){
+            pos++;
+            continue;
+        }
+        if(text[pos] != ':' || pos + 11 > size){
+            return -1;
+        }
+        pos++;
+
+        // Byte count, address (2), type, data..., checksum
+        int count = hex_byte(&text[pos]);
+        if(count < 0 || pos + (size_t)(count + 5) * 2 > size){
+            return -1;
+        }
+        uint8_t checksum = 0;
+        for(int i = 0; i < count + 5; i++){
+            int value = hex_byte(&text[pos + i * 2]);
+            if(value < 0){
+                return -1;
+            }
+            record[i] = (uint8_t)value;
+            checksum += (uint8_t)value;
+        }
+        pos += (size_t)(count + 5) * 2;
+        if(checksum != 0){
+            return -1;
+        }
+
+        uint16_t address = TO16BIT(record[1], record[2]);
+        switch(record[3]){
+            case 0x00: // Data
+                if((uint32_t)address + count > MEMORY_SIZE){
+                    return -1;
+                }
+                copy_to_memory(cpu, address, &record[4], count);
+                loaded += count;
+                break;
+            case 0x01: // End of file
+                return loaded;
+            default: // Segment/linear addresses and start addresses don't apply to a 64 KiB space
+                break;
+        }
+    }
+    return loaded;
+}
+
+static bool has_extension(const char *fileName, const char *extension){
+    const char *dot = strrchr(fileName, '.');
+    if(dot == NULL){
+        return false;
+    }
+    for(dot++; *dot != '\0' && *extension != '\0'; dot++, extension++){
+        if(tolower((unsigned char)*dot) != *extension){
+            return false;
+        }
+    }
+    return *dot == '\0' && *extension == '\0';
+}
+
+int load_file(i8080_t *cpu, const char *fileName, uint16_t origin){
+    file_image_t image;
+    int loaded;
+
+    if(!open_image(fileName, &image)){
+        return -1;
+    }
+    if(has_extension(fileName, "hex") || has_extension(fileName, "ihx")){
+        loaded = load_hex(cpu, &image);
+    }
+    else{
+        loaded = load_binary(cpu, &image, origin);
+    }
+    close_image(&image);
+    return loaded;
+}
+
+bool map_rom_image(i8080_t *cpu, const file_image_t *image, uint16_t origin){
+    if(cpu == NULL || image == NULL || image->size == 0 || image->size > (size_t)(MEMORY_SIZE - origin)){
+        return false;
+    }
+    return memory_map_rom(&cpu->map, origin, ROUND_TO_PAGE(image->size), image->data);
+}
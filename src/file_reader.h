@@ -9,11 +9,35 @@
 #include <stdlib.h>
 #include <string.h>
 
-int read_file(const char* fileName, char **buffer){
-    FILE* file;
+#include "i8080_cpu.h"
 
+#define COM_ORIGIN 0x100 // CP/M transient program area
 
-}
+// Contents of a file, memory-mapped where the platform supports it
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    bool mapped;
+} file_image_t;
 
+// Reads a whole file into a newly allocated buffer. Returns its size, or -1 on error.
+int read_file(const char* fileName, char **buffer);
+
+bool open_image(const char *fileName, file_image_t *image);
+void close_image(file_image_t *image);
+
+// Copy a raw binary image into memory at `origin`. Returns the number of bytes loaded, or -1
+// if the image does not fit.
+int load_binary(i8080_t *cpu, const file_image_t *image, uint16_t origin);
+// Parse an Intel HEX image into memory. Returns the number of data bytes loaded, or -1 on a
+// malformed record or checksum mismatch.
+int load_hex(i8080_t *cpu, const file_image_t *image);
+// Load a file by extension: .hex/.ihx as Intel HEX, anything else as a raw binary at `origin`.
+// Returns what the loader returns, or -1 if the file cannot be opened; reporting is up to the caller.
+int load_file(i8080_t *cpu, const char *fileName, uint16_t origin);
+
+// Map a raw image as ROM without copying it. `origin` must be page aligned and the image must
+// stay open for as long as the mapping is in use. A partial last page reads as zero.
+bool map_rom_image(i8080_t *cpu, const file_image_t *image, uint16_t origin);
 
 #endif //INTEL8080_FILE_READER_H
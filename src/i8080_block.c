@@ -0,0 +1,295 @@
+//
+// Created by leonv on 5/20/2024.
+//
+
+#include "i8080_block.h"
+#include "i8080_jit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const uint8_t instruction_length[256] = {
+        1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+        1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+        1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+        1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1,
+        1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+        1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,
+        1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1
+};
+
+static bool ends_block(uint8_t opcode){
+    switch(opcode){
+        case 0x76: // HLT
+        case 0xFB: // EI, so the run loop can hold off interrupts for one instruction
+        case 0xE9: // PCHL
+        case 0xC3: case 0xCB: // JMP
+        case 0xCD: case 0xDD: case 0xED: case 0xFD: // CALL
+        case 0xC9: case 0xD9: // RET
+            return true;
+        default:
+            // Rcc, Jcc, Ccc and RST fill columns 0, 2, 4 and 7 of the top quarter
+            return opcode >= 0xC0 && ((opcode & 0x07) == 0 || (opcode & 0x07) == 2 ||
+                                      (opcode & 0x07) == 4 || (opcode & 0x07) == 7);
+    }
+}
+
+// ROM and the machine's own RAM can be cached; MMIO pages, mirrors and pages whose code keeps
+// being rewritten are read every time
+static bool is_cacheable(const block_cache_t *cache, uint8_t page){
+    const memory_map_t *map = &cache->cpu->map;
+    if(map->attributes[page] & PAGE_WATCH){
+        return false; // Every fetch has to be seen
+    }
+    if(cache->rewrites[page] > BLOCK_REWRITE_LIMIT){
+        return false;
+    }
+    return (map->attributes[page] & PAGE_ROM) || memory_map_is_ram(map, page);
+}
+
+static bool covers_code(const block_cache_t *cache, uint16_t address, uint16_t length){
+    for(uint32_t byte = address; byte < (uint32_t)address + length; byte++){
+        if(cache->code_bytes[byte >> 3] & (1 << (byte & 7))){
+            return true;
+        }
+    }
+    return false;
+}
+
+static void mark_bytes(block_cache_t *cache, uint32_t from, uint32_t to){
+    for(uint32_t byte = from; byte < to; byte++){
+        cache->code_bytes[byte >> 3] |= 1 << (byte & 7);
+    }
+}
+
+// Drops the blocks starting on `page` that overlap bytes [first, last]. Blocks dropped earlier
+// are unlinked on the way so the chain does not keep growing with code that is rewritten over
+// and over. Returns the number dropped.
+static uint32_t drop_blocks(block_cache_t *cache, uint8_t page, uint32_t first, uint32_t last){
+    uint16_t *link = &cache->page_blocks[page];
+    uint32_t dropped = 0;
+
+    while(*link != 0){
+        block_t *block = &cache->blocks[*link - 1];
+        if(cache->entry[block->start] == *link && block->start <= last && block->start + block->size > first){
+            cache->entry[block->start] = 0;
+            cache->invalidated++;
+            dropped++;
+            if(block == cache->running){
+                // The rest of the running block may be stale now
+                cache->cpu->deadline = 0;
+            }
+        }
+        if(cache->entry[block->start] == *link){
+            link = &block->next;
+        }
+        else {
+            *link = block->next;
+        }
+    }
+    return dropped;
+}
+
+// Rebuilds which bytes of `page` belong to a cached block, from the blocks starting on it and
+// on the page before (blocks are shorter than a page), and lets writes to the page take the
+// fast path again once none do
+static void remark_page(block_cache_t *cache, uint8_t page){
+    uint32_t start = page * PAGE_SIZE;
+    uint32_t end = start + PAGE_SIZE;
+    bool code = false;
+
+    memset(&cache->code_bytes[start / 8], 0, PAGE_SIZE / 8);
+    for(int from = page > 0 ? page - 1 : page; from <= page; from++){
+        for(uint16_t index = cache->page_blocks[from]; index != 0; index = cache->blocks[index - 1].next){
+            const block_t *block = &cache->blocks[index - 1];
+            uint32_t block_end = block->start + block->size;
+            if(cache->entry[block->start] == index && block_end > start){
+                mark_bytes(cache, block->start > start ? block->start : start, block_end < end ? block_end : end);
+                code = true;
+            }
+        }
+    }
+    if(!code && (cache->cpu->map.attributes[page] & PAGE_CODE)){
+        memory_map_clear_code(&cache->cpu->map, page);
+    }
+}
+
+// Drops every block overlapping bytes [first, last] of one page. A page whose code is written
+// to and decoded again more than BLOCK_REWRITE_LIMIT times is not cached any more.
+static void invalidate(block_cache_t *cache, uint32_t first, uint32_t last, bool written){
+    uint8_t page = PAGE_OF(first);
+    uint32_t dropped = drop_blocks(cache, page, first, last);
+
+    if(page > 0){
+        dropped += drop_blocks(cache, page - 1, first, last);
+    }
+    if(written && dropped > 0 && cache->decoded_since[page]){
+        // Overwriting code once, e.g. to load a program, only counts once
+        cache->decoded_since[page] = false;
+        if(++cache->rewrites[page] > BLOCK_REWRITE_LIMIT){
+            dropped += drop_blocks(cache, page, page * PAGE_SIZE, page * PAGE_SIZE + PAGE_SIZE - 1);
+            if(page > 0){
+                dropped += drop_blocks(cache, page - 1, page * PAGE_SIZE, page * PAGE_SIZE + PAGE_SIZE - 1);
+            }
+        }
+    }
+    // Dropped blocks may have reached into the pages either side
+    if(page > 0){
+        remark_page(cache, page - 1);
+    }
+    remark_page(cache, page);
+    if(page < PAGE_COUNT - 1){
+        remark_page(cache, page + 1);
+    }
+}
+
+static void code_written(void *context, uint16_t address, uint16_t length){
+    block_cache_t *cache = (block_cache_t*)context;
+    // Whole pages are reported when they are remapped or watched, which is not self-modifying code
+    if(covers_code(cache, address, length)){
+        invalidate(cache, address, (uint32_t)address + length - 1, length < PAGE_SIZE);
+    }
+}
+
+static void reset_cache(block_cache_t *cache){
+    memory_map_t *map = &cache->cpu->map;
+    for(int page = 0; page < PAGE_COUNT; page++){
+        if(map->attributes[page] & PAGE_CODE){
+            memory_map_clear_code(map, page);
+        }
+    }
+    memset(cache->entry, 0, sizeof(cache->entry));
+    memset(cache->page_blocks, 0, sizeof(cache->page_blocks));
+    memset(cache->code_bytes, 0, sizeof(cache->code_bytes));
+    memset(cache->rewrites, 0, sizeof(cache->rewrites));
+    memset(cache->decoded_since, 0, sizeof(cache->decoded_since));
+    cache->running = NULL;
+    cache->block_count = 0;
+    cache->code_count = 0;
+#ifdef I8080_JIT
+    jit_flush(cache);
+#endif
+}
+
+bool enable_block_cache(i8080_t *cpu){
+    block_cache_t *cache;
+    if(cpu == NULL){
+        return false;
+    }
+    if(cpu->blocks != NULL){
+        return true;
+    }
+    cache = (block_cache_t*)calloc(1, sizeof(block_cache_t));
+    if(cache == NULL){
+        return false;
+    }
+    cache->cpu = cpu;
+#ifdef I8080_JIT
+    jit_init(cache); // Without executable memory blocks are simply never translated
+#endif
+    cpu->blocks = cache;
+    cpu->map.code_write = code_written;
+    cpu->map.code_context = cache;
+    return true;
+}
+
+void disable_block_cache(i8080_t *cpu){
+    if(cpu != NULL && cpu->blocks != NULL){
+        reset_cache(cpu->blocks);
+        cpu->map.code_write = NULL;
+        cpu->map.code_context = NULL;
+#ifdef I8080_JIT
+        jit_release(cpu->blocks);
+#endif
+        free(cpu->blocks);
+        cpu->blocks = NULL;
+    }
+}
+
+void flush_block_cache(i8080_t *cpu){
+    if(cpu != NULL && cpu->blocks != NULL){
+        reset_cache(cpu->blocks);
+        cpu->map.code_write = code_written;
+        cpu->map.code_context = cpu->blocks;
+        cpu->blocks->flushes++;
+    }
+}
+
+block_t *decode_block(i8080_t *cpu){
+    block_cache_t *cache = cpu->blocks;
+    memory_map_t *map = &cpu->map;
+    uint32_t address = cpu->PC;
+    decoded_t *code;
+    block_t *block;
+    uint8_t count = 0;
+
+    if(!is_cacheable(cache, PAGE_OF(address))){
+        return &cache->scratch;
+    }
+    if(cache->block_count == BLOCK_CAPACITY || cache->code_count + BLOCK_MAX_INSTRUCTIONS > BLOCK_CODE_CAPACITY
+#ifdef I8080_JIT
+       || cache->jit_full
+#endif
+       ){
+        flush_block_cache(cpu);
+    }
+
+    code = &cache->code[cache->code_count];
+    while(count < BLOCK_MAX_INSTRUCTIONS && address < MEMORY_SIZE && is_cacheable(cache, PAGE_OF(address))){
+        uint8_t opcode = map->read[PAGE_OF(address)][PAGE_OFFSET(address)];
+        uint8_t length = instruction_length[opcode];
+        uint32_t last = address + length - 1;
+        // Operands may not wrap around the address space or reach into an uncacheable page
+        if(last >= MEMORY_SIZE || (PAGE_OF(last) != PAGE_OF(address) && !is_cacheable(cache, PAGE_OF(last)))){
+            break;
+        }
+        code[count].opcode = opcode;
+        code[count].operand = 0;
+        if(length == 2){
+            code[count].operand = map->read[PAGE_OF(address + 1)][PAGE_OFFSET(address + 1)];
+        }
+        else if(length == 3){
+            code[count].operand = TO16BIT(map->read[PAGE_OF(address + 2)][PAGE_OFFSET(address + 2)],
+                                          map->read[PAGE_OF(address + 1)][PAGE_OFFSET(address + 1)]);
+        }
+        count++;
+        address += length;
+        if(ends_block(opcode)){
+            break;
+        }
+    }
+    if(count == 0){
+        return &cache->scratch;
+    }
+
+    block = &cache->blocks[cache->block_count++];
+    block->code = code;
+    block->start = cpu->PC;
+    block->size = (uint16_t)(address - cpu->PC);
+    block->count = count;
+    block->next = cache->page_blocks[PAGE_OF(cpu->PC)];
+    cache->page_blocks[PAGE_OF(cpu->PC)] = (uint16_t)cache->block_count;
+#ifdef I8080_JIT
+    block->executions = 0;
+    block->native = NULL;
+#endif
+    cache->code_count += count;
+    cache->entry[cpu->PC] = (uint16_t)cache->block_count;
+    cache->decoded++;
+
+    mark_bytes(cache, cpu->PC, address);
+    for(uint32_t page = PAGE_OF(cpu->PC); page <= PAGE_OF(address - 1); page++){
+        memory_map_mark_code(map, page);
+        cache->decoded_since[page] = true;
+    }
+    return block;
+}
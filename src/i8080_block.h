@@ -0,0 +1,89 @@
+//
+// Created by leonv on 5/20/2024.
+//
+
+#ifndef INTEL8080_I8080_BLOCK_H
+#define INTEL8080_I8080_BLOCK_H
+
+#include "i8080_cpu.h"
+
+#define BLOCK_MAX_INSTRUCTIONS 32
+#define BLOCK_CAPACITY 0x4000 // Blocks decoded before the whole cache is flushed
+#define BLOCK_CODE_CAPACITY (BLOCK_CAPACITY * 8) // Instructions decoded before the cache is flushed
+#define BLOCK_REWRITE_LIMIT 16 // Times a page's code is rewritten and decoded again before it is no longer cached
+#define BLOCK_INTERPRET_CYCLES 64 // Cycles interpreted at a time from code that is not cached
+
+extern const uint8_t instruction_length[256];
+
+// One instruction with its immediate operand already assembled
+typedef struct {
+    uint16_t operand;
+    uint8_t opcode;
+} decoded_t;
+
+// Straight-line run of instructions ending at the first jump, call, return, RST, PCHL, HLT or
+// EI, or after BLOCK_MAX_INSTRUCTIONS
+typedef struct {
+    const decoded_t *code;
+    uint16_t start;
+    uint16_t size; // Bytes of memory the block was decoded from
+    uint16_t next; // 1 + index of the previous block decoded on the same start page, 0 for none
+    uint8_t count;
+#ifdef I8080_JIT
+    uint32_t executions;
+    void (*native)(i8080_t *cpu); // Translation, once the block is hot
+#endif
+} block_t;
+
+// Blocks are looked up by start address. Decoding marks the pages a block came from with
+// PAGE_CODE, so a write to one of its bytes drops the blocks decoded from that byte, and
+// remapping the page drops every block on it. Blocks are chained per start page, so that only
+// walks the blocks starting on the page and the one before it (blocks are shorter than a page).
+// Only a write into the running block ends the slice. Pages whose code keeps being rewritten
+// are interpreted, like MMIO. Storage is only reclaimed by flushing the whole
+// cache once it fills up, which also gives rewritten pages another chance.
+typedef struct block_cache {
+    i8080_t *cpu;
+    uint16_t entry[MEMORY_SIZE]; // 1 + index of the block starting at each address, 0 for none
+    uint16_t page_blocks[PAGE_COUNT]; // 1 + index of the last block decoded on each page
+    uint8_t code_bytes[MEMORY_SIZE / 8]; // Bitmap of bytes covered by a cached block
+    uint8_t rewrites[PAGE_COUNT]; // Times code on each page was written to after being decoded
+    bool decoded_since[PAGE_COUNT]; // A block was decoded from the page since it was last rewritten
+    block_t blocks[BLOCK_CAPACITY];
+    decoded_t code[BLOCK_CODE_CAPACITY];
+    size_t block_count;
+    size_t code_count;
+    block_t *running; // Block last looked up, the one execute_blocks() is in
+    block_t scratch; // Stands in for code that cannot be cached (MMIO, mirrors, rewritten code), which is interpreted
+
+    uint64_t decoded;
+    uint64_t invalidated;
+    uint64_t flushes;
+
+#ifdef I8080_JIT
+    uint8_t *jit_code; // Executable memory, NULL if the platform refused it
+    size_t jit_used;
+    uint64_t translated;
+    bool jit_full; // Flush at the next decode to make room
+#endif
+} block_cache_t;
+
+// Switch a machine between the interpreter and cached basic blocks. Both run the same core and
+// produce the same results.
+bool enable_block_cache(i8080_t *cpu);
+void disable_block_cache(i8080_t *cpu);
+// Drop every cached block, e.g. after the memory map was rebuilt from scratch
+void flush_block_cache(i8080_t *cpu);
+
+// Decodes the block at PC, or returns the scratch block if the code there cannot be cached
+block_t *decode_block(i8080_t *cpu);
+
+// Block starting at PC, decoding it on a miss
+static inline block_t *block_lookup(i8080_t *cpu){
+    block_cache_t *cache = cpu->blocks;
+    uint16_t index = cache->entry[cpu->PC];
+    cache->running = index != 0 ? &cache->blocks[index - 1] : decode_block(cpu);
+    return cache->running;
+}
+
+#endif //INTEL8080_I8080_BLOCK_H
@@ -0,0 +1,497 @@
+//
+// Created by leonv on 5/31/2024.
+//
+
+#include "i8080_cpm.h"
+
+#include <ctype.h>
+#include <string.h>
+
+// FCB fields
+#define FCB_EXTENT 12
+#define FCB_S2 14
+#define FCB_RECORDS 15
+#define FCB_CURRENT 32
+#define FCB_RANDOM 33
+#define FCB_SIZE 36
+
+#define EXTENT_RECORDS 128
+#define PATH_SIZE 1024
+#define EOF_MARK 0x1A // ^Z, pads the last record of a text file
+
+// BDOS results are returned in HL, with A = L and B = H
+static void set_result(i8080_t *cpu, uint16_t value){
+    cpu->HL = value;
+    cpu->A = LOW_BYTE(value);
+    cpu->B = HIGH_BYTE(value);
+}
+
+// Characters CP/M's CCP refuses in a file name, besides controls and space
+#define FCB_RESERVED "<>.,;:=?*[]%|()/\\"
+
+// "NAME.TYP" from the FCB at `fcb`; false if the name is blank or holds a character CP/M does
+// not allow, which also keeps the name from reaching outside the host directory
+static bool fcb_name(i8080_t *cpu, uint16_t fcb, char *name){
+    size_t length = 0;
+    for(int i = 1; i <= 11; i++){
+        char c = (char)(read_memory(cpu, fcb + i) & 0x7F); // Bit 7 of the type holds attributes
+        if(i == 9){
+            name[length++] = '.';
+        }
+        if(c != ' '){
+            if(c < ' ' || c == 0x7F || strchr(FCB_RESERVED, c) != NULL){
+                return false;
+            }
+            name[length++] = (char)toupper((unsigned char)c);
+        }
+    }
+    if(name[length - 1] == '.'){
+        length--;
+    }
+    name[length] = '\0';
+    return length > 0 && name[0] != '.';
+}
+
+// `name` in the host directory, optionally in lower case
+static void host_path(const cpm_t *cpm, const char *name, bool lower, char *path){
+    size_t length = (size_t)snprintf(path, PATH_SIZE, "%s/%s", cpm->directory, name);
+    for(size_t i = length - strlen(name); lower && i < length && i < PATH_SIZE - 1; i++){
+        path[i] = (char)tolower((unsigned char)path[i]);
+    }
+}
+
+// Opens `name` in the host directory as written, then in lower case, leaving the path it was
+// found at in `path`
+static FILE *host_open(const cpm_t *cpm, const char *name, const char *mode, char *path){
+    FILE *stream;
+    host_path(cpm, name, false, path);
+    stream = fopen(path, mode);
+    if(stream == NULL){
+        host_path(cpm, name, true, path);
+        stream = fopen(path, mode);
+    }
+    return stream;
+}
+
+static bool host_exists(const cpm_t *cpm, const char *name, char *path){
+    FILE *stream = host_open(cpm, name, "rb", path);
+    if(stream != NULL){
+        fclose(stream);
+    }
+    return stream != NULL;
+}
+
+static cpm_file_t *find_file(cpm_t *cpm, const char *name){
+    for(int i = 0; i < CPM_MAX_FILES; i++){
+        if(cpm->files[i].stream != NULL && strcmp(cpm->files[i].name, name) == 0){
+            return &cpm->files[i];
+        }
+    }
+    return NULL;
+}
+
+// The open file the FCB at DE names, or NULL
+static cpm_file_t *fcb_file(cpm_t *cpm){
+    char name[13];
+    if(!fcb_name(cpm->cpu, cpm->cpu->DE, name)){
+        return NULL;
+    }
+    return find_file(cpm, name);
+}
+
+static void close_file(cpm_file_t *file){
+    fclose(file->stream);
+    file->stream = NULL;
+    file->name[0] = '\0';
+}
+
+static long file_records(FILE *stream){
+    long size;
+    fseek(stream, 0, SEEK_END);
+    size = ftell(stream);
+    return size < 0 ? 0 : (size + CPM_RECORD_SIZE - 1) / CPM_RECORD_SIZE;
+}
+
+// Open (or, with `create`, make) the file the FCB at DE names. Returns the BDOS result.
+static uint8_t open_file(cpm_t *cpm, bool create){
+    i8080_t *cpu = cpm->cpu;
+    cpm_file_t *file;
+    char name[13], path[PATH_SIZE];
+    FILE *stream;
+    long records;
+
+    if(!fcb_name(cpu, cpu->DE, name)){
+        return 0xFF;
+    }
+    file = find_file(cpm, name);
+    if(file != NULL){
+        close_file(file); // Opened again through another FCB, or made anew
+    }
+    for(file = cpm->files; file < cpm->files + CPM_MAX_FILES && file->stream != NULL; file++);
+    if(file == cpm->files + CPM_MAX_FILES){
+        return 0xFF;
+    }
+    if(create){
+        if(host_exists(cpm, name, path)){
+            return 0xFF; // Making a file that exists is an error
+        }
+        host_path(cpm, name, true, path);
+        stream = fopen(path, "w+b");
+    }
+    else{
+        stream = host_open(cpm, name, "r+b", path);
+        if(stream == NULL){
+            stream = host_open(cpm, name, "rb", path); // Read-only on the host
+        }
+    }
+    if(stream == NULL){
+        return 0xFF;
+    }
+    strcpy(file->name, name);
+    file->stream = stream;
+
+    records = file_records(stream) - (long)read_memory(cpu, cpu->DE + FCB_EXTENT) * EXTENT_RECORDS;
+    write_memory(cpu, cpu->DE + FCB_RECORDS, records < 0 ? 0 : records > EXTENT_RECORDS ? EXTENT_RECORDS : (uint8_t)records);
+    write_memory(cpu, cpu->DE + FCB_S2, 0);
+    return 0;
+}
+
+static uint32_t sequential_record(i8080_t *cpu){
+    uint16_t fcb = cpu->DE;
+    return ((uint32_t)(read_memory(cpu, fcb + FCB_S2) & 0x3F) * 32 + (read_memory(cpu, fcb + FCB_EXTENT) & 0x1F)) *
+           EXTENT_RECORDS + (read_memory(cpu, fcb + FCB_CURRENT) & 0x7F);
+}
+
+static void set_sequential_record(i8080_t *cpu, uint32_t record){
+    uint16_t fcb = cpu->DE;
+    write_memory(cpu, fcb + FCB_CURRENT, record & 0x7F);
+    write_memory(cpu, fcb + FCB_EXTENT, (record >> 7) & 0x1F);
+    write_memory(cpu, fcb + FCB_S2, (record >> 12) & 0x3F);
+}
+
+static uint32_t random_record(i8080_t *cpu){
+    uint16_t fcb = cpu->DE;
+    return TO16BIT((uint32_t)read_memory(cpu, fcb + FCB_RANDOM + 1), read_memory(cpu, fcb + FCB_RANDOM));
+}
+
+static void set_random_record(i8080_t *cpu, uint32_t record){
+    uint16_t fcb = cpu->DE;
+    write_memory(cpu, fcb + FCB_RANDOM, record & 0xFF);
+    write_memory(cpu, fcb + FCB_RANDOM + 1, (record >> 8) & 0xFF);
+    write_memory(cpu, fcb + FCB_RANDOM + 2, (record >> 16) & 0xFF);
+}
+
+// Record `record` into the DMA buffer. Returns 0, or 1 past the end of the file.
+static uint8_t read_record(cpm_t *cpm, cpm_file_t *file, uint32_t record){
+    uint8_t buffer[CPM_RECORD_SIZE];
+    size_t size;
+    if(fseek(file->stream, (long)record * CPM_RECORD_SIZE, SEEK_SET) != 0){
+        return 1;
+    }
+    size = fread(buffer, 1, CPM_RECORD_SIZE, file->stream);
+    if(size == 0){
+        return 1;
+    }
+    memset(buffer + size, EOF_MARK, CPM_RECORD_SIZE - size);
+    for(size_t i = 0; i < CPM_RECORD_SIZE; i++){
+        write_memory(cpm->cpu, cpm->dma + i, buffer[i]);
+    }
+    return 0;
+}
+
+// The DMA buffer into record `record`. Returns 0, or 2 when the host write fails.
+static uint8_t write_record(cpm_t *cpm, cpm_file_t *file, uint32_t record){
+    uint8_t buffer[CPM_RECORD_SIZE];
+    for(size_t i = 0; i < CPM_RECORD_SIZE; i++){
+        buffer[i] = read_memory(cpm->cpu, cpm->dma + i);
+    }
+    if(fseek(file->stream, (long)record * CPM_RECORD_SIZE, SEEK_SET) != 0 ||
+       fwrite(buffer, 1, CPM_RECORD_SIZE, file->stream) != CPM_RECORD_SIZE){
+        return 2;
+    }
+    return 0;
+}
+
+// Host path of the file the FCB at `fcb` names, closing it first if it is open
+static bool named_path(cpm_t *cpm, uint16_t fcb, char *path){
+    char name[13];
+    cpm_file_t *file;
+    if(!fcb_name(cpm->cpu, fcb, name)){
+        return false;
+    }
+    file = find_file(cpm, name);
+    if(file != NULL){
+        close_file(file);
+    }
+    return host_exists(cpm, name, path);
+}
+
+static void read_line(cpm_t *cpm){
+    i8080_t *cpu = cpm->cpu;
+    uint8_t capacity = read_memory(cpu, cpu->DE);
+    uint8_t count = 0;
+    int c;
+    while(count < capacity && (c = fgetc(cpm->input)) != EOF && c != '\n'){
+        if(c != '\r'){
+            write_memory(cpu, cpu->DE + 2 + count++, (uint8_t)c);
+        }
+    }
+    write_memory(cpu, cpu->DE + 1, count);
+}
+
+static uint16_t bdos(cpm_t *cpm, uint8_t function){
+    i8080_t *cpu = cpm->cpu;
+    cpm_file_t *file;
+    char path[PATH_SIZE], renamed[PATH_SIZE], name[13];
+    int c;
+
+    switch(function){
+        case 0: // System reset
+            cpm->done = true;
+            cpu->halted = true;
+            cpu->deadline = 0;
+            fflush(cpm->output);
+            return 0;
+        case 1: // Console input
+            fflush(cpm->output);
+            c = fgetc(cpm->input);
+            return c == EOF ? EOF_MARK : (c == '\n' ? '\r' : (uint8_t)c);
+        case 2: // Console output
+            fputc(cpu->E, cpm->output);
+            return 0;
+        case 6: // Direct console I/O
+            if(cpu->E == 0xFF){
+                fflush(cpm->output);
+                c = fgetc(cpm->input);
+                return c == EOF ? 0 : (c == '\n' ? '\r' : (uint8_t)c);
+            }
+            if(cpu->E != 0xFE){
+                fputc(cpu->E, cpm->output);
+            }
+            return 0;
+        case 9: // Print string up to '$', which a guest may have left out of all of memory
+            for(uint32_t count = 0; count < MEMORY_SIZE; count++){
+                c = read_memory(cpu, (uint16_t)(cpu->DE + count));
+                if(c == '$'){
+                    break;
+                }
+                fputc(c, cpm->output);
+            }
+            return 0;
+        case 10: // Read console buffer
+            fflush(cpm->output);
+            read_line(cpm);
+            return 0;
+        case 11: // Console status
+            return 0;
+        case 12: // Version: CP/M 2.2
+            return 0x0022;
+        case 13: // Reset disk system
+            cpm->dma = CPM_DMA;
+            return 0;
+        case 15: // Open file
+            return open_file(cpm, false);
+        case 16: // Close file
+            file = fcb_file(cpm);
+            if(file == NULL){
+                return 0xFF;
+            }
+            close_file(file);
+            return 0;
+        case 17: // Search for first
+        case 18: // Search for next
+            return 0xFF;
+        case 19: // Delete file
+            return named_path(cpm, cpu->DE, path) && remove(path) == 0 ? 0 : 0xFF;
+        case 20: // Read sequential
+        case 21: // Write sequential
+        {
+            uint32_t record = sequential_record(cpu);
+            uint8_t result;
+            file = fcb_file(cpm);
+            if(file == NULL){
+                return 9; // Invalid FCB
+            }
+            result = function == 20 ? read_record(cpm, file, record) : write_record(cpm, file, record);
+            if(result == 0){
+                set_sequential_record(cpu, record + 1);
+            }
+            return result;
+        }
+        case 22: // Make file
+            return open_file(cpm, true);
+        case 23: // Rename file: new name in the second half of the FCB
+            if(!named_path(cpm, cpu->DE, path) || !fcb_name(cpu, cpu->DE + 16, name)){
+                return 0xFF;
+            }
+            file = find_file(cpm, name);
+            if(file != NULL){
+                close_file(file);
+            }
+            if(host_exists(cpm, name, renamed)){
+                return 0xFF; // The new name is taken
+            }
+            host_path(cpm, name, true, renamed);
+            return rename(path, renamed) == 0 ? 0 : 0xFF;
+        case 14: // Select disk
+        case 25: // Current disk: always A
+        case 32: // Get/set user code: always 0
+            return 0;
+        case 26: // Set DMA address
+            cpm->dma = cpu->DE;
+            return 0;
+        case 33: // Read random
+        case 34: // Write random
+        {
+            uint32_t record = random_record(cpu);
+            uint8_t result;
+            if(read_memory(cpu, cpu->DE + FCB_RANDOM + 2) != 0){
+                return 6; // Past the end of the disk
+            }
+            file = fcb_file(cpm);
+            if(file == NULL){
+                return 9;
+            }
+            result = function == 33 ? read_record(cpm, file, record) : write_record(cpm, file, record);
+            if(result == 0){
+                set_sequential_record(cpu, record); // The next sequential access repeats it
+            }
+            return result;
+        }
+        case 35: // Compute file size
+        {
+            FILE *stream;
+            if(!fcb_name(cpu, cpu->DE, name)){
+                return 0xFF;
+            }
+            file = find_file(cpm, name);
+            stream = file != NULL ? file->stream : host_open(cpm, name, "rb", path);
+            if(stream == NULL){
+                return 0xFF;
+            }
+            set_random_record(cpu, (uint32_t)file_records(stream));
+            if(file == NULL){
+                fclose(stream);
+            }
+            return 0;
+        }
+        case 36: // Set random record
+            set_random_record(cpu, sequential_record(cpu));
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// OUT from the stub, with the function number in C
+static void bdos_call(void *context, uint8_t port, uint8_t value){
+    cpm_t *cpm = (cpm_t*)context;
+    (void)port;
+    (void)value;
+    set_result(cpm->cpu, bdos(cpm, cpm->cpu->C));
+}
+
+bool cpm_init(cpm_t *cpm, i8080_t *cpu, const char *directory){
+    static const uint8_t stub[] = { 0xD3, CPM_PORT, 0xC9 }; // OUT CPM_PORT; RET
+    if(cpm == NULL || cpu == NULL){
+        return false;
+    }
+    memset(cpm, 0, sizeof(cpm_t));
+    cpm->cpu = cpu;
+    cpm->directory = directory != NULL ? directory : ".";
+    cpm->input = stdin;
+    cpm->output = stdout;
+    cpm->dma = CPM_DMA;
+
+    write_memory(cpu, 0x0000, 0x76); // HLT, where warm boot would be
+    write_memory(cpu, 0x0003, 0); // IOBYTE
+    write_memory(cpu, 0x0004, 0); // Drive A, user 0
+    write_memory(cpu, CPM_BDOS_ENTRY, 0xC3); // JMP CPM_BDOS_ADDRESS
+    write_memory(cpu, CPM_BDOS_ENTRY + 1, LOW_BYTE(CPM_BDOS_ADDRESS));
+    write_memory(cpu, CPM_BDOS_ENTRY + 2, HIGH_BYTE(CPM_BDOS_ADDRESS));
+    for(size_t i = 0; i < sizeof(stub); i++){
+        write_memory(cpu, CPM_BDOS_ADDRESS + i, stub[i]);
+    }
+    // A program that returns instead of calling function 0 returns to 0x0000
+    cpu->SP = CPM_BDOS_ADDRESS - 2;
+    write_memory(cpu, cpu->SP, 0);
+    write_memory(cpu, cpu->SP + 1, 0);
+    io_bus_register(&cpu->io, CPM_PORT, NULL, bdos_call, cpm);
+    cpm_command_line(cpm, "");
+    return true;
+}
+
+void cpm_release(cpm_t *cpm){
+    if(cpm != NULL && cpm->cpu != NULL){
+        for(int i = 0; i < CPM_MAX_FILES; i++){
+            if(cpm->files[i].stream != NULL){
+                close_file(&cpm->files[i]);
+            }
+        }
+        fflush(cpm->output);
+        io_bus_register(&cpm->cpu->io, CPM_PORT, NULL, NULL, NULL);
+        cpm->cpu = NULL;
+    }
+}
+
+// Parses one argument, e.g. "B:FOO.TXT", into an FCB; `*` fills the rest of a field with '?'
+static const char *parse_fcb(i8080_t *cpu, uint16_t fcb, const char *text){
+    uint8_t bytes[16];
+    size_t field = 1, end = 9;
+
+    memset(bytes, 0, sizeof(bytes));
+    memset(bytes + 1, ' ', 11);
+    while(*text == ' '){
+        text++;
+    }
+    if(text[0] != '\0' && text[1] == ':'){
+        bytes[0] = (uint8_t)(toupper((unsigned char)text[0]) - 'A' + 1);
+        text += 2;
+    }
+    for(; *text != '\0' && *text != ' '; text++){
+        if(*text == '.'){
+            field = 9;
+            end = 12;
+        }
+        else if(*text == '*'){
+            while(field < end){
+                bytes[field++] = '?';
+            }
+        }
+        else if(field < end){
+            bytes[field++] = (uint8_t)toupper((unsigned char)*text);
+        }
+    }
+    for(size_t i = 0; i < sizeof(bytes); i++){
+        write_memory(cpu, fcb + i, bytes[i]);
+    }
+    return text;
+}
+
+void cpm_command_line(cpm_t *cpm, const char *tail){
+    i8080_t *cpu;
+    size_t length;
+    const char *next;
+
+    if(cpm == NULL || cpm->cpu == NULL || tail == NULL){
+        return;
+    }
+    cpu = cpm->cpu;
+    length = strlen(tail);
+    if(length > 125){
+        length = 125; // Count, leading space and terminator fill the rest of 0x80-0xFF
+    }
+    // The CCP passes the tail upper case with a leading space
+    write_memory(cpu, CPM_DMA, (uint8_t)(length > 0 ? length + 1 : 0));
+    write_memory(cpu, CPM_DMA + 1, ' ');
+    for(size_t i = 0; i < length; i++){
+        write_memory(cpu, CPM_DMA + 2 + i, (uint8_t)toupper((unsigned char)tail[i]));
+    }
+    write_memory(cpu, CPM_DMA + 2 + length, 0);
+
+    next = parse_fcb(cpu, CPM_FCB, tail);
+    parse_fcb(cpu, CPM_FCB2, next);
+    for(uint16_t address = CPM_FCB2 + 16; address < CPM_FCB + FCB_SIZE; address++){
+        write_memory(cpu, address, 0); // Current and random record of the first FCB
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Created by leonv on 5/31/2024.
+//
+
+#ifndef INTEL8080_I8080_CPM_H
+#define INTEL8080_I8080_CPM_H
+
+#include <stdio.h>
+
+#include "i8080_cpu.h"
+
+// High-level emulation of CP/M 2.2's BDOS for running .COM programs. Rather than executing an
+// emulated BDOS, the entry point at 0x0005 jumps to a three-byte stub at CPM_BDOS_ADDRESS,
+// OUT CPM_PORT; RET, and the OUT hands the call to C: a BDOS call costs the guest two
+// instructions however much work it does. Every execution engine runs the stub as it is.
+//
+// Console functions go to `input` and `output`. Input is not echoed, which the host terminal
+// does, and console status always reports no key, so polling for ^C never eats input. Disk
+// functions work on files in one host directory, whatever drive the FCB names. FCB names
+// holding characters CP/M does not allow, path separators among them, are rejected. A name is
+// looked up as written in the FCB (upper case) and then in lower case, which is also how new
+// files are created. Warm boot (function 0, or returning to 0x0000) halts the machine.
+//
+// Supported: 0-2, 6, 9-19 (search only finds nothing), 20-23, 25-26, 32-36. Anything else
+// returns 0.
+
+#define CPM_BDOS_ENTRY 0x0005
+#define CPM_BDOS_ADDRESS 0xFE00 // Top of the TPA, as 0x0006 tells the program
+#define CPM_PORT 0xFF
+#define CPM_FCB 0x005C // Default FCBs, filled from the command line
+#define CPM_FCB2 0x006C
+#define CPM_DMA 0x0080 // Default DMA buffer, which also holds the command tail
+#define CPM_RECORD_SIZE 128
+#define CPM_MAX_FILES 16
+
+typedef struct {
+    char name[13]; // Host name from the FCB, "NAME.TYP" without attribute bits; "" while free
+    FILE *stream;
+} cpm_file_t;
+
+typedef struct {
+    i8080_t *cpu;
+    const char *directory;
+    FILE *input;
+    FILE *output;
+    uint16_t dma;
+    cpm_file_t files[CPM_MAX_FILES];
+    bool done; // The program asked for a warm boot
+} cpm_t;
+
+// Install the BDOS stub, page zero and the port handler on a machine with a program already
+// loaded at 0x100, and point SP just under the stub. `directory` must outlive the session.
+bool cpm_init(cpm_t *cpm, i8080_t *cpu, const char *directory);
+// Closes every file still open and unregisters the port
+void cpm_release(cpm_t *cpm);
+
+// Write the command tail to 0x80 and parse its first two arguments into the default FCBs, as
+// the CCP does. `tail` is what followed the program name, e.g. "IN.TXT OUT.TXT".
+void cpm_command_line(cpm_t *cpm, const char *tail);
+
+#endif //INTEL8080_I8080_CPM_H
@@ -3,51 +3,127 @@
 //
 
 #include "i8080_cpu.h"
+#include "i8080_snapshot.h"
+#include "i8080_block.h"
+#include "i8080_jit.h"
+#include "i8080_profile.h"
+#include "i8080_fuzz.h"
+#include "i8080_trace.h"
+#include "i8080_debug.h"
 
 #include <stdio.h>
+#include <string.h>
+
+static void reset_registers(i8080_t *cpu){
+    cpu->A = 0;
+    cpu->B = 0;
+    cpu->C = 0;
+    cpu->D = 0;
+    cpu->E = 0;
+    cpu->H = 0;
+    cpu->L = 0;
+    cpu->SP = 0;
+    cpu->PC = 0x100;
+    cpu->F = FLAG_ALWAYS;
+    CLEAR_PENDING_FLAGS(cpu);
+    cpu->interrupts_enabled = false;
+    cpu->ei_pending = false;
+    cpu->halted = false;
+    cpu->interrupt_pending = false;
+    cpu->interrupt_opcode = 0;
+    cpu->cycles = 0;
+    cpu->halted_at = 0;
+    cpu->deadline = 0;
+}
+
+void init_i8080_in(i8080_t *cpu, uint8_t *memory){
+    cpu->memory = memory;
+    cpu->base = NULL;
+    cpu->blocks = NULL;
+    cpu->debug = NULL;
+    cpu->devices = NULL;
+    cpu->device_count = 0;
+#ifdef I8080_PROFILE
+    cpu->profile = NULL;
+#endif
+#ifdef I8080_TRACE
+    cpu->trace = NULL;
+#endif
+#ifdef I8080_FUZZ
+    cpu->coverage = NULL;
+    cpu->coverage_previous = 0;
+#endif
+    reset_registers(cpu);
+    memory_map_init(&cpu->map, cpu->memory);
+    io_bus_init(&cpu->io);
+    scheduler_init(&cpu->scheduler);
+}
 
 i8080_t* init_i8080(void){
     i8080_t *cpu = (i8080_t*)malloc(sizeof(i8080_t));
     if(cpu != NULL){
-        cpu->A = 0;
-        cpu->B = 0;
-        cpu->C = 0;
-        cpu->D = 0;
-        cpu->E = 0;
-        cpu->H = 0;
-        cpu->L = 0;
-        cpu->SP = 0;
-        cpu->PC = 0x100;
-        cpu->flags.z = 0;
-        cpu->flags.s = 0;
-        cpu->flags.p = 0;
-        cpu->flags.cy = 0;
-        cpu->flags.ac = 0;
-        cpu->flags.pad = 0;
-
-        cpu->memory = (uint8_t*)malloc(0x10000);
-
-        printf("CPU initialized\n");
-    }
-    else {
-        cpu = NULL;
+        uint8_t *memory = (uint8_t*)calloc(1, MEMORY_SIZE);
+        if(memory != NULL){
+            init_i8080_in(cpu, memory);
+        }
+        else {
+            free(cpu);
+            cpu = NULL;
+        }
     }
     return cpu;
 }
 
+void reset_i8080(i8080_t *cpu){
+    if(cpu != NULL){
+        reset_registers(cpu);
+        release_snapshot(cpu->base);
+        cpu->base = NULL;
+        memset(cpu->memory, 0, MEMORY_SIZE);
+        memory_map_init(&cpu->map, cpu->memory);
+        restore_debugger(cpu);
+        flush_block_cache(cpu);
+        io_bus_release(&cpu->io);
+        cpu->scheduler.count = 0;
+        free(cpu->devices);
+        cpu->devices = NULL;
+        cpu->device_count = 0;
+    }
+}
+
+void release_i8080(i8080_t *cpu){
+    if(cpu != NULL){
+        io_bus_release(&cpu->io);
+        scheduler_release(&cpu->scheduler);
+        free(cpu->devices);
+        cpu->devices = NULL;
+        cpu->device_count = 0;
+        release_snapshot(cpu->base);
+        cpu->base = NULL;
+        disable_block_cache(cpu);
+        disable_debugger(cpu);
+#ifdef I8080_PROFILE
+        disable_profiler(cpu);
+#endif
+#ifdef I8080_TRACE
+        disable_trace(cpu);
+#endif
+    }
+}
+
 void destroy_i8080(i8080_t *cpu){
     if(cpu != NULL){
+        release_i8080(cpu);
         free(cpu->memory);
         free(cpu);
-        printf("CPU destroyed\n");
     }
 }
 
-uint8_t *read_memory(i8080_t *cpu, uint16_t address){
-    uint8_t* value = NULL;
+uint8_t read_memory(i8080_t *cpu, uint16_t address){
+    uint8_t value = 0;
 
     if(cpu != NULL){
-        value = &cpu->memory[address];
+        value = memory_map_read(&cpu->map, address);
     }
 
     return value;
@@ -55,7 +131,7 @@ uint8_t *read_memory(i8080_t *cpu, uint16_t address){
 
 void write_memory(i8080_t *cpu, uint16_t address, uint8_t value){
     if(cpu != NULL){
-        cpu->memory[address] = value;
+        memory_map_write(&cpu->map, address, value);
     }
 }
 
@@ -70,712 +146,619 @@ void print_state(i8080_t *cpu){
         printf("L: 0x%02x\n", cpu->L);
         printf("SP: 0x%04x\n", cpu->SP);
         printf("PC: 0x%04x\n", cpu->PC);
-        printf("Flags: Z:%d S:%d P:%d CY:%d AC:%d\n", cpu->flags.z, cpu->flags.s, cpu->flags.p, cpu->flags.cy, cpu->flags.ac);
+        printf("Flags: Z:%d S:%d P:%d CY:%d AC:%d\n", GET_Z(cpu), GET_S(cpu), GET_P(cpu), GET_CY(cpu), GET_AC(cpu));
+    }
+}
+
+// Unchecked memory access for the interpreter core. The public read_memory() and
+// write_memory() validate their arguments; the run loop validates once per call instead.
+// Plain RAM and ROM pages are a single page-table load; everything else takes the slow path.
+static inline uint8_t memory_read(i8080_t *cpu, uint16_t address){
+    const uint8_t *page = cpu->map.read[PAGE_OF(address)];
+    if(page != NULL){
+        return page[PAGE_OFFSET(address)];
+    }
+    return memory_map_read(&cpu->map, address);
+}
+
+static inline void memory_write(i8080_t *cpu, uint16_t address, uint8_t value){
+    uint8_t *page = cpu->map.write[PAGE_OF(address)];
+#ifdef I8080_TRACE
+    if(cpu->trace != NULL){
+        trace_write(cpu->trace, address, value);
+    }
+#endif
+    if(page != NULL){
+        page[PAGE_OFFSET(address)] = value;
+    }
+    else{
+        memory_map_write(&cpu->map, address, value);
+    }
+}
+
+static inline uint16_t memory_word(i8080_t *cpu, uint16_t address){
+    return TO16BIT(memory_read(cpu, address + 1), memory_read(cpu, address));
+}
+
+// The interpreter core lives in i8080_core.inc, written once against the OP()/NEXT/IMM8/IMM16
+// macros. It is expanded twice: execute() fetches every instruction from memory, while
+// execute_blocks() runs instructions already decoded into basic blocks. Each expansion is either
+// a switch inside a loop (portable) or, with I8080_COMPUTED_GOTO on GCC/Clang, labels with a
+// dispatch table where every handler ends in its own indirect jump to the next handler.
+#if defined(I8080_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#define I8080_USE_COMPUTED_GOTO
+#endif
+
+// With a profile attached, each instruction is reported along with the PC and SP it started
+// with. Without I8080_PROFILE this compiles to nothing.
+#ifdef I8080_PROFILE
+#define PROFILE_LOCALS uint16_t profile_pc = 0, profile_sp = 0
+#define PROFILE_FETCH() (profile_pc = cpu->PC, profile_sp = cpu->SP)
+#define PROFILE_STEP() do{ \
+        if(cpu->profile != NULL) profile_instruction(cpu->profile, cpu, profile_pc, profile_sp, opcode, cycles); \
+    }while(0)
+#else
+#define PROFILE_LOCALS
+#define PROFILE_FETCH() ((void)0)
+#define PROFILE_STEP() ((void)0)
+#endif
+
+// While tracing, each instruction is recorded along with the PC it started at. Without
+// I8080_TRACE this compiles to nothing.
+#ifdef I8080_TRACE
+#define TRACE_LOCALS uint16_t trace_pc = 0
+#define TRACE_FETCH() (trace_pc = cpu->PC)
+#define TRACE_STEP() do{ \
+        if(cpu->trace != NULL) trace_instruction(cpu->trace, cpu, trace_pc, opcode, cycles); \
+    }while(0)
+#else
+#define TRACE_LOCALS
+#define TRACE_FETCH() ((void)0)
+#define TRACE_STEP() ((void)0)
+#endif
+
+// While fuzzing, every control transfer records an edge to where it lands. Without I8080_FUZZ
+// this compiles to nothing.
+#ifdef I8080_FUZZ
+#define COVERAGE_STEP() do{ \
+        if(cpu->coverage != NULL && FUZZ_IS_BRANCH(opcode)) fuzz_edge(cpu); \
+    }while(0)
+#else
+#define COVERAGE_STEP() ((void)0)
+#endif
+
+#ifdef I8080_USE_COMPUTED_GOTO
+#define OP(code) op_##code
+#define NEXT PROFILE_STEP(); TRACE_STEP(); COVERAGE_STEP(); cpu->cycles += cycles; if(cpu->cycles >= cpu->deadline) goto done; DISPATCH()
+#define DISPATCH_TABLE static const void *const dispatch_table[256] = { \
+    &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07, \
+    &&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F, \
+    &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17, \
+    &&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F, \
+    &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27, \
+    &&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F, \
+    &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37, \
+    &&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F, \
+    &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47, \
+    &&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F, \
+    &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57, \
+    &&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F, \
+    &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67, \
+    &&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F, \
+    &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77, \
+    &&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F, \
+    &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87, \
+    &&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F, \
+    &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97, \
+    &&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F, \
+    &&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7, \
+    &&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF, \
+    &&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7, \
+    &&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF, \
+    &&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7, \
+    &&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF, \
+    &&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7, \
+    &&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_0xDD, &&op_0xDE, &&op_0xDF, \
+    &&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7, \
+    &&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_0xED, &&op_0xEE, &&op_0xEF, \
+    &&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7, \
+    &&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_0xFD, &&op_0xFE, &&op_0xFF \
+}
+#else
+#define OP(code) case code
+#define NEXT break
+#endif
+
+// Executes instructions until the cycle counter reaches `deadline` (at least one instruction).
+// Instructions and device callbacks can end the slice early by lowering cpu->deadline.
+static void execute(i8080_t *cpu, uint64_t deadline){
+    uint8_t cycles = 0;
+    uint8_t opcode;
+    uint16_t word;
+    uint8_t msb, lsb;
+    PROFILE_LOCALS;
+    TRACE_LOCALS;
+#define IMM8 memory_read(cpu, cpu->PC + 1)
+#define IMM16 memory_word(cpu, cpu->PC + 1)
+#define FETCH() (PROFILE_FETCH(), TRACE_FETCH(), opcode = memory_read(cpu, cpu->PC))
+#ifdef I8080_USE_COMPUTED_GOTO
+#define DISPATCH() do{ FETCH(); goto *dispatch_table[opcode]; }while(0)
+    DISPATCH_TABLE;
+    cpu->deadline = deadline;
+    DISPATCH();
+    {
+#include "i8080_core.inc"
     }
+done:
+    return;
+#else
+    cpu->deadline = deadline;
+    do{
+        FETCH();
+        switch(opcode){
+#include "i8080_core.inc"
+        }
+        PROFILE_STEP();
+        TRACE_STEP();
+        COVERAGE_STEP();
+        cpu->cycles += cycles;
+    }while(cpu->cycles < cpu->deadline);
+#endif
+#undef IMM8
+#undef IMM16
+#undef FETCH
+#undef DISPATCH
 }
 
-static void set_flags(i8080_t *cpu, uint16_t result);
+// Runs the interpreter from inside a slice until `until` at most, keeping the slice's deadline
+static void interpret(i8080_t *cpu, uint64_t until){
+    uint64_t deadline = cpu->deadline;
+    execute(cpu, until < deadline ? until : deadline);
+    // A deadline of zero means an instruction asked to end the slice (HLT, EI, an interrupt or
+    // an invalidated block); otherwise keep the slice's own, or an event scheduled meanwhile
+    if(cpu->deadline != 0){
+        uint64_t next = scheduler_next(&cpu->scheduler);
+        cpu->deadline = next < deadline ? next : deadline;
+    }
+}
+
+// Same as execute(), over instructions decoded ahead of time: opcodes and operands come from
+// the block cache, and memory is only consulted when control leaves a block. A write to a
+// decoded byte invalidates the blocks it falls in, which are decoded afresh when next reached;
+// only a write into the running block ends the slice.
+static void execute_blocks(i8080_t *cpu, uint64_t deadline){
+    uint8_t cycles = 0;
+    uint8_t opcode;
+    uint16_t word, operand;
+    uint8_t msb, lsb;
+    const decoded_t *instruction = NULL;
+    const decoded_t *end = NULL;
+    PROFILE_LOCALS;
+    TRACE_LOCALS;
+#define IMM8 ((uint8_t)operand)
+#define IMM16 operand
+#define FETCH() do{ \
+        while(instruction == end){ \
+            block_t *block = block_lookup(cpu); \
+            if(block == &cpu->blocks->scratch){ \
+                interpret(cpu, cpu->cycles + BLOCK_INTERPRET_CYCLES); \
+                if(cpu->cycles >= cpu->deadline) return; \
+                continue; \
+            } \
+            if(jit_run(cpu, block)){ \
+                if(cpu->cycles >= cpu->deadline) return; \
+                continue; \
+            } \
+            instruction = block->code; \
+            end = instruction + block->count; \
+        } \
+        PROFILE_FETCH(); \
+        TRACE_FETCH(); \
+        opcode = instruction->opcode; \
+        operand = instruction->operand; \
+        instruction++; \
+    }while(0)
+#ifdef I8080_USE_COMPUTED_GOTO
+#define DISPATCH() do{ FETCH(); goto *dispatch_table[opcode]; }while(0)
+    DISPATCH_TABLE;
+    cpu->deadline = deadline;
+    DISPATCH();
+    {
+#include "i8080_core.inc"
+    }
+done:
+    return;
+#else
+    cpu->deadline = deadline;
+    do{
+        FETCH();
+        switch(opcode){
+#include "i8080_core.inc"
+        }
+        PROFILE_STEP();
+        TRACE_STEP();
+        COVERAGE_STEP();
+        cpu->cycles += cycles;
+    }while(cpu->cycles < cpu->deadline);
+#endif
+#undef IMM8
+#undef IMM16
+#undef FETCH
+#undef DISPATCH
+}
+
+#undef OP
+#undef NEXT
+#undef DISPATCH_TABLE
+#undef PROFILE_LOCALS
+#undef PROFILE_FETCH
+#undef PROFILE_STEP
+#undef TRACE_LOCALS
+#undef TRACE_FETCH
+#undef TRACE_STEP
+#undef COVERAGE_STEP
+
+#ifdef I8080_JIT
+void step_instruction(i8080_t *cpu){
+    interpret(cpu, cpu->cycles + 1);
+}
+#endif
+
+// With breakpoints set, instructions run one at a time so each PC can be checked first. Stops at
+// `deadline`, at a breakpoint, or when an instruction lowers cpu->deadline as in execute().
+static void execute_debug(i8080_t *cpu, uint64_t deadline){
+    debug_t *debug = cpu->debug;
+    cpu->deadline = deadline;
+    while(cpu->cycles < cpu->deadline && !debug_breakpoint(debug, cpu->PC)){
+        uint64_t slice = cpu->deadline;
+        execute(cpu, cpu->cycles + 1);
+        if(cpu->deadline != 0){
+            uint64_t next = scheduler_next(&cpu->scheduler);
+            cpu->deadline = next < slice ? next : slice;
+        }
+    }
+}
+
+static inline bool at_breakpoint(i8080_t *cpu){
+    return cpu->debug != NULL && cpu->debug->breakpoint_count > 0 && debug_breakpoint(cpu->debug, cpu->PC);
+}
+
+static void take_interrupt(i8080_t *cpu){
+#ifdef I8080_TRACE
+    uint16_t interrupted = cpu->PC;
+    if(cpu->trace != NULL){
+        trace_interrupt(cpu->trace);
+    }
+#endif
+    cpu->interrupts_enabled = false;
+    cpu->interrupt_pending = false;
+    cpu->halted = false;
+    RST(cpu, cpu->interrupt_opcode);
+    cpu->cycles += 11;
+#ifdef I8080_PROFILE
+    if(cpu->profile != NULL){
+        profile_call(cpu->profile, cpu->PC, cpu->SP + 2);
+    }
+#endif
+#ifdef I8080_TRACE
+    if(cpu->trace != NULL){
+        trace_instruction(cpu->trace, cpu, interrupted, cpu->interrupt_opcode, 0);
+    }
+#endif
+#ifdef I8080_FUZZ
+    if(cpu->coverage != NULL){
+        fuzz_edge(cpu);
+    }
+#endif
+}
+
+static void fire_events(i8080_t *cpu){
+    event_t event;
+    while(scheduler_pop_due(&cpu->scheduler, cpu->cycles, &event)){
+        event.fn(event.context, event.when);
+    }
+}
+
+// Runs slices of the interpreter core up to the next scheduled event, firing events and taking
+// pending interrupts between them.
+static uint64_t run(i8080_t *cpu, uint64_t budget){
+    uint64_t start = cpu->cycles;
+    uint64_t end = start + budget;
+    uint64_t next;
+    if(cpu->debug != NULL){
+        cpu->debug->event = DEBUG_NONE;
+    }
+    do{
+        fire_events(cpu);
+        next = scheduler_next(&cpu->scheduler);
+        if(next > end){
+            next = end;
+        }
+        if(cpu->interrupt_pending && cpu->interrupts_enabled && !cpu->ei_pending){
+            take_interrupt(cpu);
+        }
+        else if(cpu->halted){
+            // Nothing but an interrupt can resume a halted CPU, so skip straight to the next
+            // event that might raise one.
+            cpu->cycles = next;
+        }
+        else{
+            if(cpu->ei_pending){
+                if(!at_breakpoint(cpu)){
+                    cpu->ei_pending = false;
+                    execute(cpu, cpu->cycles + 1);
+                }
+            }
+            else if(cpu->debug != NULL && cpu->debug->breakpoint_count > 0){
+                execute_debug(cpu, next);
+            }
+            else if(cpu->blocks != NULL){
+                execute_blocks(cpu, next);
+            }
+            else{
+                execute(cpu, next);
+            }
+            // Halting ends the slice, so this is the cycle the CPU stopped at, before any skip
+            if(cpu->halted){
+                cpu->halted_at = cpu->cycles;
+            }
+        }
+        // Events, devices and the caller only ever see F up to date
+        SYNC_FLAGS(cpu);
+    }while(cpu->cycles < end && (cpu->debug == NULL || cpu->debug->event == DEBUG_NONE));
+    return cpu->cycles - start;
+}
 
 uint8_t emulate_cycle(i8080_t *cpu){
     uint8_t cycles = 0;
-    if(cpu != NULL){
-        uint8_t* opcode = read_memory(cpu, cpu->PC);
-        uint16_t word;
-        bool condition = false;
-        uint8_t reg, msb, lsb;
-        uint8_t *reg1, *reg2;
-        if(opcode != NULL){
-            switch(*opcode){
-
-                // ADI instruction
-                case 0xC6: ADD(cpu, *read_memory(cpu, cpu->PC + 1), 0); cpu->PC += 2; cycles = 7; break;
-
-                // ADD instructions
-                case 0x80: ADD(cpu, cpu->B, 0); cpu->PC++; cycles = 4; break;
-                case 0x81: ADD(cpu, cpu->C, 0); cpu->PC++; cycles = 4; break;
-                case 0x82: ADD(cpu, cpu->D, 0); cpu->PC++; cycles = 4; break;
-                case 0x83: ADD(cpu, cpu->E, 0); cpu->PC++; cycles = 4; break;
-                case 0x84: ADD(cpu, cpu->H, 0); cpu->PC++; cycles = 4; break;
-                case 0x85: ADD(cpu, cpu->L, 0); cpu->PC++; cycles = 4; break;
-                case 0x87: ADD(cpu, cpu->A, 0); cpu->PC++; cycles = 4; break;
-                case 0x86: ADD(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L)), 0); cpu->PC++; cycles = 7; break;
-
-                // ADC instructions
-                case 0x88: ADD(cpu, cpu->B, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x89: ADD(cpu, cpu->C, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x8A: ADD(cpu, cpu->D, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x8B: ADD(cpu, cpu->E, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x8C: ADD(cpu, cpu->H, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x8D: ADD(cpu, cpu->L, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x8F: ADD(cpu, cpu->A, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x8E: ADD(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L)), cpu->flags.cy); cpu->PC++; cycles = 7; break;
-
-                // SUB instructions
-                case 0x90: SUB(cpu, cpu->B, 0); cpu->PC++; cycles = 4; break;
-                case 0x91: SUB(cpu, cpu->C, 0); cpu->PC++; cycles = 4; break;
-                case 0x92: SUB(cpu, cpu->D, 0); cpu->PC++; cycles = 4; break;
-                case 0x93: SUB(cpu, cpu->E, 0); cpu->PC++; cycles = 4; break;
-                case 0x94: SUB(cpu, cpu->H, 0); cpu->PC++; cycles = 4; break;
-                case 0x95: SUB(cpu, cpu->L, 0); cpu->PC++; cycles = 4; break;
-                case 0x97: SUB(cpu, cpu->A, 0); cpu->PC++; cycles = 4; break;
-                case 0x96: SUB(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L)), 0); cpu->PC++; cycles = 7; break;
-
-                // SBB instructions
-                case 0x98: SUB(cpu, cpu->B, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x99: SUB(cpu, cpu->C, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x9A: SUB(cpu, cpu->D, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x9B: SUB(cpu, cpu->E, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x9C: SUB(cpu, cpu->H, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x9D: SUB(cpu, cpu->L, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x9F: SUB(cpu, cpu->A, cpu->flags.cy); cpu->PC++; cycles = 4; break;
-                case 0x9E: SUB(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L)), cpu->flags.cy); cpu->PC++; cycles = 7; break;
-
-                // SUI instruction
-                case 0xD6: SUB(cpu, *read_memory(cpu, cpu->PC + 1), 0); cpu->PC += 2; cycles = 7; break;
-
-                // ANA Instructions
-                case 0xA0: ANA(cpu, cpu->B); cpu->PC++; cycles = 4; break;
-                case 0xA1: ANA(cpu, cpu->C); cpu->PC++; cycles = 4; break;
-                case 0xA2: ANA(cpu, cpu->D); cpu->PC++; cycles = 4; break;
-                case 0xA3: ANA(cpu, cpu->E); cpu->PC++; cycles = 4; break;
-                case 0xA4: ANA(cpu, cpu->H); cpu->PC++; cycles = 4; break;
-                case 0xA5: ANA(cpu, cpu->L); cpu->PC++; cycles = 4; break;
-                case 0xA7: ANA(cpu, cpu->A); cpu->PC++; cycles = 4; break;
-                case 0xA6: ANA(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L))); cpu->PC++; cycles = 7; break;
-
-                // ANI Instruction
-                case 0xE6: ANA(cpu, *read_memory(cpu, cpu->PC + 1)); cpu->PC += 2; cycles = 7; break;
-
-                // ORA Instructions
-                case 0xB0: ORA(cpu, cpu->B); cpu->PC++; cycles = 4; break;
-                case 0xB1: ORA(cpu, cpu->C); cpu->PC++; cycles = 4; break;
-                case 0xB2: ORA(cpu, cpu->D); cpu->PC++; cycles = 4; break;
-                case 0xB3: ORA(cpu, cpu->E); cpu->PC++; cycles = 4; break;
-                case 0xB4: ORA(cpu, cpu->H); cpu->PC++; cycles = 4; break;
-                case 0xB5: ORA(cpu, cpu->L); cpu->PC++; cycles = 4; break;
-                case 0xB7: ORA(cpu, cpu->A); cpu->PC++; cycles = 4; break;
-                case 0xB6: ORA(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L))); cpu->PC++; cycles = 7; break;
-
-                // ORI Instruction
-                case 0xF6: ORA(cpu, *read_memory(cpu, cpu->PC + 1)); cpu->PC += 2; cycles = 7; break;
-
-                // XRA Instructions
-                case 0xA8: XRA(cpu, cpu->B); cpu->PC++; cycles = 4; break;
-                case 0xA9: XRA(cpu, cpu->C); cpu->PC++; cycles = 4; break;
-                case 0xAA: XRA(cpu, cpu->D); cpu->PC++; cycles = 4; break;
-                case 0xAB: XRA(cpu, cpu->E); cpu->PC++; cycles = 4; break;
-                case 0xAC: XRA(cpu, cpu->H); cpu->PC++; cycles = 4; break;
-                case 0xAD: XRA(cpu, cpu->L); cpu->PC++; cycles = 4; break;
-                case 0xAF: XRA(cpu, cpu->A); cpu->PC++; cycles = 4; break;
-                case 0xAE: XRA(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L))); cpu->PC++; cycles = 7; break;
-
-                // XRI Instruction
-                case 0xEE: XRA(cpu, *read_memory(cpu, cpu->PC + 1)); cpu->PC += 2; cycles = 7; break;
-
-                // CMP Instructions
-                case 0xB8: CMP(cpu, cpu->B); cpu->PC++; cycles = 4; break;
-                case 0xB9: CMP(cpu, cpu->C); cpu->PC++; cycles = 4; break;
-                case 0xBA: CMP(cpu, cpu->D); cpu->PC++; cycles = 4; break;
-                case 0xBB: CMP(cpu, cpu->E); cpu->PC++; cycles = 4; break;
-                case 0xBC: CMP(cpu, cpu->H); cpu->PC++; cycles = 4; break;
-                case 0xBD: CMP(cpu, cpu->L); cpu->PC++; cycles = 4; break;
-                case 0xBF: CMP(cpu, cpu->A); cpu->PC++; cycles = 4; break;
-                case 0xBE: CMP(cpu, *read_memory(cpu, TO16BIT(cpu->H, cpu->L))); cpu->PC++; cycles = 7; break;
-
-                // CPI Instruction
-                case 0xFE: CMP(cpu, *read_memory(cpu, cpu->PC + 1)); cpu->PC += 2; cycles = 7; break;
-
-                // INR Instructions
-                case 0x04: INR(cpu, &cpu->B); cpu->PC++; cycles = 5; break;
-                case 0x0C: INR(cpu, &cpu->C); cpu->PC++; cycles = 5; break;
-                case 0x14: INR(cpu, &cpu->D); cpu->PC++; cycles = 5; break;
-                case 0x1C: INR(cpu, &cpu->E); cpu->PC++; cycles = 5; break;
-                case 0x24: INR(cpu, &cpu->H); cpu->PC++; cycles = 5; break;
-                case 0x2C: INR(cpu, &cpu->L); cpu->PC++; cycles = 5; break;
-                case 0x3C: INR(cpu, &cpu->A); cpu->PC++; cycles = 5; break;
-                case 0x34: INR(cpu, read_memory(cpu, TO16BIT(cpu->H, cpu->L))); cpu->PC++; cycles = 10; break;
-
-                // INX Instructions
-                case 0x03: INX(cpu, &cpu->B, &cpu->C); cpu->PC++; cycles = 5; break;
-                case 0x13: INX(cpu, &cpu->D, &cpu->E); cpu->PC++; cycles = 5; break;
-                case 0x23: INX(cpu, &cpu->H, &cpu->L); cpu->PC++; cycles = 5; break;
-                case 0x33: cpu->SP++; cpu->PC++; cycles = 5; break;
-
-                // DCR Instructions
-                case 0x05: DCR(cpu, &cpu->B); cpu->PC++; cycles = 5; break;
-                case 0x0D: DCR(cpu, &cpu->C); cpu->PC++; cycles = 5; break;
-                case 0x15: DCR(cpu, &cpu->D); cpu->PC++; cycles = 5; break;
-                case 0x1D: DCR(cpu, &cpu->E); cpu->PC++; cycles = 5; break;
-                case 0x25: DCR(cpu, &cpu->H); cpu->PC++; cycles = 5; break;
-                case 0x2D: DCR(cpu, &cpu->L); cpu->PC++; cycles = 5; break;
-                case 0x3D: DCR(cpu, &cpu->A); cpu->PC++; cycles = 5; break;
-                case 0x35: DCR(cpu, read_memory(cpu, TO16BIT(cpu->H, cpu->L))); cpu->PC++; cycles = 10; break;
-
-                // DCX Instructions
-                case 0x0B: DCX(cpu, &cpu->B, &cpu->C); cpu->PC++; cycles = 5; break;
-                case 0x1B: DCX(cpu, &cpu->D, &cpu->E); cpu->PC++; cycles = 5; break;
-                case 0x2B: DCX(cpu, &cpu->H, &cpu->L); cpu->PC++; cycles = 5; break;
-                case 0x3B: cpu->SP--; cpu->PC++; cycles = 5; break;
-
-                // DAD Instructions
-                case 0x09: DAD(cpu, cpu->B, cpu->C); cpu->PC++; cycles = 10; break;
-                case 0x19: DAD(cpu, cpu->D, cpu->E); cpu->PC++; cycles = 10; break;
-                case 0x29: DAD(cpu, cpu->H, cpu->L); cpu->PC++; cycles = 10; break;
-                case 0x39: DAD(cpu, HIGH_BYTE(cpu->SP), LOW_BYTE(cpu->SP)); cpu->PC++; cycles = 10; break;
-
-                // MOV B Instructions
-                case 0x40: cpu->B = cpu->B; cycles = 5; break;
-                case 0x41: cpu->B = cpu->C; cycles = 5; break;
-                case 0x42: cpu->B = cpu->D; cycles = 5; break;
-                case 0x43: cpu->B = cpu->E; cycles = 5; break;
-                case 0x44: cpu->B = cpu->H; cycles = 5; break;
-                case 0x45: cpu->B = cpu->L; cycles = 5; break;
-                case 0x47: cpu->B = cpu->A; cycles = 5; break;
-
-                // MOV C Instructions
-                case 0x48: cpu->C = cpu->B; cycles = 5; break;
-                case 0x49: cpu->C = cpu->C; cycles = 5; break;
-                case 0x4A: cpu->C = cpu->D; cycles = 5; break;
-                case 0x4B: cpu->C = cpu->E; cycles = 5; break;
-                case 0x4C: cpu->C = cpu->H; cycles = 5; break;
-                case 0x4D: cpu->C = cpu->L; cycles = 5; break;
-                case 0x4F: cpu->C = cpu->A; cycles = 5; break;
-
-                // MOV D Instructions
-                case 0x50: cpu->D = cpu->B; cycles = 5; break;
-                case 0x51: cpu->D = cpu->C; cycles = 5; break;
-                case 0x52: cpu->D = cpu->D; cycles = 5; break;
-                case 0x53: cpu->D = cpu->E; cycles = 5; break;
-                case 0x54: cpu->D = cpu->H; cycles = 5; break;
-                case 0x55: cpu->D = cpu->L; cycles = 5; break;
-                case 0x57: cpu->D = cpu->A; cycles = 5; break;
-
-                // MOV D Instructions
-                case 0x58: cpu->E = cpu->B; cycles = 5; break;
-                case 0x59: cpu->E = cpu->C; cycles = 5; break;
-                case 0x5A: cpu->E = cpu->D; cycles = 5; break;
-                case 0x5B: cpu->E = cpu->E; cycles = 5; break;
-                case 0x5C: cpu->E = cpu->H; cycles = 5; break;
-                case 0x5D: cpu->E = cpu->L; cycles = 5; break;
-                case 0x5F: cpu->E = cpu->A; cycles = 5; break;
-
-                // MOV D Instructions
-                case 0x60: cpu->H = cpu->B; cycles = 5; break;
-                case 0x61: cpu->H = cpu->C; cycles = 5; break;
-                case 0x62: cpu->H = cpu->D; cycles = 5; break;
-                case 0x63: cpu->H = cpu->E; cycles = 5; break;
-                case 0x64: cpu->H = cpu->H; cycles = 5; break;
-                case 0x65: cpu->H = cpu->L; cycles = 5; break;
-                case 0x67: cpu->H = cpu->A; cycles = 5; break;
-
-                // MOV D Instructions
-                case 0x68: cpu->L = cpu->B; cycles = 5; break;
-                case 0x69: cpu->L = cpu->C; cycles = 5; break;
-                case 0x6A: cpu->L = cpu->D; cycles = 5; break;
-                case 0x6B: cpu->L = cpu->E; cycles = 5; break;
-                case 0x6C: cpu->L = cpu->H; cycles = 5; break;
-                case 0x6D: cpu->L = cpu->L; cycles = 5; break;
-                case 0x6F: cpu->L = cpu->A; cycles = 5; break;
-
-                // MOV D Instructions
-                case 0x78: cpu->A = cpu->B; cycles = 5; break;
-                case 0x79: cpu->A = cpu->C; cycles = 5; break;
-                case 0x7A: cpu->A = cpu->D; cycles = 5; break;
-                case 0x7B: cpu->A = cpu->E; cycles = 5; break;
-                case 0x7C: cpu->A = cpu->H; cycles = 5; break;
-                case 0x7D: cpu->A = cpu->L; cycles = 5; break;
-                case 0x7F: cpu->A = cpu->A; cycles = 5; break;
-
-                // MOV Instructions
-                case 0x7E: cpu->A = *read_memory(cpu, TO16BIT(cpu->H, cpu->L)); cycles = 7; break;
-                case 0x6E: cpu->L = *read_memory(cpu, TO16BIT(cpu->H, cpu->L)); cycles = 7; break;
-                case 0x66: cpu->H = *read_memory(cpu, TO16BIT(cpu->H, cpu->L)); cycles = 7; break;
-                case 0x5E: cpu->E = *read_memory(cpu, TO16BIT(cpu->H, cpu->L)); cycles = 7; break;
-                case 0x56: cpu->D = *read_memory(cpu, TO16BIT(cpu->H, cpu->L)); cycles = 7; break;
-                case 0x4E: cpu->C = *read_memory(cpu, TO16BIT(cpu->H, cpu->L)); cycles = 7; break;
-                case 0x46: cpu->B = *read_memory(cpu, TO16BIT(cpu->H, cpu->L)); cycles = 7; break;
-
-                case 0x70: write_memory(cpu, TO16BIT(cpu->H, cpu->L), cpu->B); cycles = 7; break;
-                case 0x71: write_memory(cpu, TO16BIT(cpu->H, cpu->L), cpu->C); cycles = 7; break;
-                case 0x72: write_memory(cpu, TO16BIT(cpu->H, cpu->L), cpu->D); cycles = 7; break;
-                case 0x73: write_memory(cpu, TO16BIT(cpu->H, cpu->L), cpu->E); cycles = 7; break;
-                case 0x74: write_memory(cpu, TO16BIT(cpu->H, cpu->L), cpu->H); cycles = 7; break;
-                case 0x75: write_memory(cpu, TO16BIT(cpu->H, cpu->L), cpu->L); cycles = 7; break;
-                case 0x77: write_memory(cpu, TO16BIT(cpu->H, cpu->L), cpu->A); cycles = 7; break;
-
-                // MVI Instructions
-                case 0x06: cpu->B = *read_memory(cpu, cpu->PC + 1); cpu->PC += 2; cycles = 7; break;
-                case 0x0E: cpu->C = *read_memory(cpu, cpu->PC + 1); cpu->PC += 2; cycles = 7; break;
-                case 0x16: cpu->D = *read_memory(cpu, cpu->PC + 1); cpu->PC += 2; cycles = 7; break;
-                case 0x1E: cpu->E = *read_memory(cpu, cpu->PC + 1); cpu->PC += 2; cycles = 7; break;
-                case 0x26: cpu->H = *read_memory(cpu, cpu->PC + 1); cpu->PC += 2; cycles = 7; break;
-                case 0x2E: cpu->L = *read_memory(cpu, cpu->PC + 1); cpu->PC += 2; cycles = 7; break;
-                case 0x3E: cpu->A = *read_memory(cpu, cpu->PC + 1); cpu->PC += 2; cycles = 7; break;
-                case 0x36: *read_memory(cpu, TO16BIT(cpu->H, cpu->L)) = *read_memory(cpu, cpu->PC + 1);
-                    cpu->PC += 2; cycles = 10; break;
-
-                // PUSH Instructions
-                case 0xC5: PUSH(cpu, cpu->B, cpu->C); cpu->PC++; cycles = 11; break;
-                case 0xD5: PUSH(cpu, cpu->D, cpu->E); cpu->PC++; cycles = 11; break;
-                case 0xE5: PUSH(cpu, cpu->H, cpu->L); cpu->PC++; cycles = 11; break;
-                case 0xF5: PUSH_PSW(cpu); break;
-
-                // POP Instructions
-                case 0xC1: POP(cpu, &cpu->B, &cpu->C); cpu->PC++; cycles = 10; break;
-                case 0xD1: POP(cpu, &cpu->D, &cpu->E); cpu->PC++; cycles = 10; break;
-                case 0xE1: POP(cpu, &cpu->H, &cpu->L); cpu->PC++; cycles = 10; break;
-                case 0xF1: POP_PSW(cpu); break;
-
-                // CALL Instructions
-                case 0xC4: cycles = Ccc(cpu, !cpu->flags.z, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); break;
-                case 0xCC: cycles = Ccc(cpu, cpu->flags.z, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); break;
-                case 0xD4: cycles = Ccc(cpu, !cpu->flags.cy, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); break;
-                case 0xDC: cycles = Ccc(cpu, cpu->flags.cy, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); break;
-                case 0xCD: CALL(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); cpu->PC += 3; cycles = 17; break;
-
-                // RET Instructions
-                case 0xC0: cycles = Rcc(cpu, !cpu->flags.z); break;
-                case 0xC8: cycles = Rcc(cpu, cpu->flags.z); break;
-                case 0xD0: cycles = Rcc(cpu, !cpu->flags.cy); break;
-                case 0xD8: cycles = Rcc(cpu, cpu->flags.cy); break;
-                case 0xC9: RET(cpu); cycles = 10; break;
-
-                // JMP Instructions
-                case 0xC2: Jcc(cpu, !cpu->flags.z, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); cpu->PC += 3; cycles = 10; break;
-                case 0xCA: Jcc(cpu, cpu->flags.z, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); cpu->PC += 3; cycles = 10; break;
-                case 0xD2: Jcc(cpu, !cpu->flags.cy, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); cpu->PC += 3; cycles = 10; break;
-                case 0xDA: Jcc(cpu, cpu->flags.cy, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); cpu->PC += 3; cycles = 10; break;
-                case 0xC3: JMP(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); cpu->PC += 3; cycles = 10; break;
-
-                // LDA Instruction
-                case 0x3A: cpu->A = *read_memory(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1))); cpu->PC += 3; cycles = 13; break;
-
-                // LDAX Instructions
-                case 0x0A: cpu->A = *read_memory(cpu, TO16BIT(cpu->B, cpu->C)); cpu->PC++; cycles = 7; break;
-                case 0x1A: cpu->A = *read_memory(cpu, TO16BIT(cpu->D, cpu->E)); cpu->PC++; cycles = 7; break;
-
-                // STA Instruction
-                case 0x32: write_memory(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)), cpu->A); cpu->PC += 3; cycles = 13; break;
-
-                // STAX Instructions
-                case 0x02: write_memory(cpu, TO16BIT(cpu->B, cpu->C), cpu->A); cpu->PC++; cycles = 7; break;
-                case 0x12: write_memory(cpu, TO16BIT(cpu->D, cpu->E), cpu->A); cpu->PC++; cycles = 7; break;
-
-                // LXI Instructions
-                case 0x01: LXI(cpu, &cpu->B, &cpu->C, *read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)); cpu->PC += 3; cycles = 10; break;
-                case 0x11: LXI(cpu, &cpu->D, &cpu->E, *read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)); cpu->PC += 3; cycles = 10; break;
-                case 0x21: LXI(cpu, &cpu->H, &cpu->L, *read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)); cpu->PC += 3; cycles = 10; break;
-                case 0x31: cpu->SP = TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)); cpu->PC += 3; cycles = 10; break;
-
-                // NOP Instructions
-                case 0x00: // NOP
-                    NOP(cpu);
-                    cpu->PC++;
-                    cycles = 4;
-                    break;
-
-                case 0x07: cpu->flags.cy = (cpu->A & 0x80) >> 7; cpu->A = (cpu->A << 1) | cpu->flags.cy; cpu->PC++; cycles = 4; break;
-                case 0x0F: cpu->flags.cy = cpu->A & 0x01; cpu->A = (cpu->A >> 1) | (cpu->flags.cy << 7); cpu->PC++; cycles = 4; break;
-                case 0x17: msb = (cpu->A & 0x80) >> 7; cpu->A = (cpu->A << 1) | cpu->flags.cy; cpu->flags.cy = msb; cpu->PC++; cycles = 4; break;
-                case 0x1F: lsb = (cpu->A & 0x01); cpu->A = (cpu->A >> 1) | (cpu->flags.cy << 7); cpu->flags.cy = lsb; cpu->PC++; cycles = 4; break;
-                case 0x22:
-                    word = TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1));
-                    write_memory(cpu, word, cpu->L);
-                    write_memory(cpu, word + 1, cpu->H);
-                    cpu->PC += 3;
-                    cycles = 16;
-                    break;
-                case 0x27: // DAA
-                    if((cpu->A & 0x0F) > 9 || cpu->flags.ac){
-                        if((cpu->A & 0x0F) > 9){
-                            cpu->A += 6;
-                        }
-                        if((cpu->A & 0xF0) > 0x90){
-                            cpu->A += 0x60;
-                            cpu->flags.cy = 1;
-                        }
-                        cpu->flags.ac = 1;
-                    }
-                    else{
-                        cpu->flags.ac = 0;
-                    }
-                case 0x2A: // LHLD
-                    word = TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1));
-                    cpu->L = *read_memory(cpu, word);
-                    cpu->H = *read_memory(cpu, word + 1);
-                    cpu->PC += 3;
-                    cycles = 16;
-                    break;
-                case 0x2F: cpu->A = ~cpu->A; cpu->PC++; cycles = 4; break;
-                case 0x37: cpu->flags.cy = 1; cpu->PC++; cycles = 4; break;
-                case 0x3F: cpu->flags.cy = !cpu->flags.cy; cpu->PC++; cycles = 4; break;
-
-
-                case 0x76: // HLT
-                    // TODO: cpu->halt = 1;
-                    cpu->PC++;
-                    cycles = 7;
-                    break;
-
-                case 0xC7: // RST 0
-                case 0xCF: // RST 1
-                case 0xD7: // RST 2
-                case 0xDF: // RST 3
-                case 0xE7: // RST 4
-                case 0xEF: // RST 5
-                case 0xF7: // RST 6
-                case 0xFF: // RST 7
-                    // TODO: RST(cpu, (*opcode & 0x38) >> 3);
-                    cpu->PC++;
-                    cycles = 11;
-                    break;
-
-                case 0xCE: // ACI
-                    word = cpu->A + *read_memory(cpu, cpu->PC + 1) + cpu->flags.cy;
-                    set_flags(cpu, word);
-                    cpu->A = word & 0xFF;
-                    cpu->PC += 2;
-                    cycles = 7;
-                    break;
-                case 0xD3: // OUT
-                    // TODO: OUT(cpu, *read_memory(cpu, cpu->PC + 1), cpu->A);
-                    cpu->PC += 2;
-                    cycles = 10;
-                    break;
-                case 0xDE: // SBI
-                    word = cpu->A - *read_memory(cpu, cpu->PC + 1);
-                    set_flags(cpu, word);
-                    cpu->A = word & 0xFF;
-                    cpu->PC += 2;
-                    cycles = 7;
-                    break;
-                case 0xDB: // IN
-                    // TODO: cpu->A = IN(cpu, *read_memory(cpu, cpu->PC + 1));
-                    cpu->PC += 2;
-                    cycles = 10;
-                    break;
-                case 0xE0: // RPO
-                    if(!cpu->flags.p){
-                        RET(cpu);
-                        cycles = 11;
-                    }
-                    else{
-                        cpu->PC++;
-                        cycles = 5;
-                    }
-                case 0xE2: // JPO
-                    if(!cpu->flags.p){
-                        JMP(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                    }
-                    else cpu->PC += 3;
-                    cycles = 10;
-                    break;
-                case 0xE3: // XTHL
-                    word = TO16BIT(cpu->H, cpu->L);
-                    cpu->H = *read_memory(cpu, cpu->SP + 1);
-                    cpu->L = *read_memory(cpu, cpu->SP);
-                    write_memory(cpu, cpu->SP + 1, HIGH_BYTE(word));
-                    write_memory(cpu, cpu->SP, LOW_BYTE(word));
-                    cpu->PC++;
-                    cycles = 18;
-                    break;
-                case 0xE4: // CPO
-                    if(!cpu->flags.p){
-                        CALL(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                        cycles = 17;
-                    }
-                    else{
-                        cpu->PC += 3;
-                        cycles = 11;
-                    }
-                    break;
-                case 0xE8: // RPE
-                    if(cpu->flags.p){
-                        RET(cpu);
-                        cycles = 11;
-                    }
-                    else{
-                        cpu->PC++;
-                        cycles = 5;
-                    }
-                    break;
-                case 0xEA: // JPE
-                    if(cpu->flags.p){
-                        JMP(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                    }
-                    else cpu->PC += 3;
-                    cycles = 10;
-                    break;
-                case 0xEB: // XCHG
-                    word = TO16BIT(cpu->H, cpu->L);
-                    cpu->H = cpu->D;
-                    cpu->L = cpu->E;
-                    cpu->D = HIGH_BYTE(word);
-                    cpu->E = LOW_BYTE(word);
-                    cpu->PC++;
-                    cycles = 5;
-                    break;
-                case 0xEC: // CPE
-                    if(cpu->flags.p){
-                        CALL(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                        cycles = 17;
-                    }
-                    else{
-                        cpu->PC += 3;
-                        cycles = 11;
-                    }
-                    break;
-                case 0xF0: // RP
-                    if(!cpu->flags.s){
-                        RET(cpu);
-                        cycles = 11;
-                    }
-                    else{
-                        cpu->PC++;
-                        cycles = 5;
-                    }
-                    break;
-                case 0xF2: // JP
-                    if(!cpu->flags.s){
-                        JMP(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                    }
-                    else cpu->PC += 3;
-                    cycles = 10;
-                    break;
-                case 0xF4: // CP
-                    if(!cpu->flags.s){
-                        CALL(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                        cycles = 17;
-                    }
-                    else{
-                        cpu->PC += 3;
-                        cycles = 11;
-                    }
-                    break;
-                case 0xF8: // RM
-                    if(cpu->flags.s){
-                        RET(cpu);
-                        cycles = 11;
-                    }
-                    else{
-                        cpu->PC++;
-                        cycles = 5;
-                    }
-                    break;
-                case 0xFA: // JM
-                    if(cpu->flags.s){
-                        JMP(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                    }
-                    else cpu->PC += 3;
-                    cycles = 10;
-                    break;
-                case 0xFC: // CM
-                    if(cpu->flags.s){
-                        CALL(cpu, TO16BIT(*read_memory(cpu, cpu->PC + 2), *read_memory(cpu, cpu->PC + 1)));
-                        cycles = 17;
-                    }
-                    else{
-                        cpu->PC += 3;
-                        cycles = 11;
-                    }
-                    break;
-                case 0xFB: // EI
-                    // TODO: cpu->interrupts = 1;
-                    cpu->PC++;
-                    cycles = 4;
-                    break;
-                case 0xF3: // DI
-                    // TODO: cpu->interrupts = 0;
-                    cpu->PC++;
-                    cycles = 4;
-                    break;
-                case 0xE9: // PCHL
-                    cpu->PC = TO16BIT(cpu->H, cpu->L);
-                    cycles = 5;
-                    break;
-                case 0xF9: // SPHL
-                    cpu->SP = TO16BIT(cpu->H, cpu->L);
-                    cpu->PC++;
-                    cycles = 5;
-                    break;
-
-
-                case 0xFD: // CALL
-                case 0xED: // CALL
-                case 0xDD: // CALL
-                case 0xD9: // RET
-                case 0xCB: // JMP
-                    break;
-
-                // NOP Instructions
-                case 0x10: // NOP
-                case 0x20: // NOP
-                case 0x30: // NOP
-                case 0x08: // NOP
-                case 0x18: // NOP
-                case 0x28: // NOP
-                case 0x38: // NOP
-                    //printf("Unimplemented opcode: 0x%02x\n", *opcode);
-                    cpu->PC++;
-                    break;
-                default:
-                    printf("Unknown opcode: 0x%02x\n", *opcode);
-                    cpu->PC++;
+    if(cpu != NULL && cpu->memory != NULL){
+        cycles = (uint8_t)run(cpu, 1);
+    }
+    return cycles;
+}
+
+uint64_t run_cycles(i8080_t *cpu, uint64_t budget){
+    uint64_t cycles = 0;
+    if(cpu != NULL && cpu->memory != NULL && budget > 0){
+        cycles = run(cpu, budget);
+        io_bus_flush(&cpu->io);
+    }
+    return cycles;
+}
+
+uint64_t run_until(i8080_t *cpu, i8080_stop_fn stop, void *context){
+    uint64_t cycles = 0;
+    if(cpu != NULL && cpu->memory != NULL && stop != NULL){
+        while(!stop(cpu, context)){
+            cycles += run(cpu, 1);
+            if(cpu->debug != NULL && cpu->debug->event != DEBUG_NONE){
+                break; // Stopped by a breakpoint or watchpoint
             }
         }
+        io_bus_flush(&cpu->io);
     }
     return cycles;
 }
 
-static uint8_t check_parity(uint8_t value){
-    uint8_t parity = 0;
-    for(int i = 0; i < 8; i++){
-        if(value & 0x01){
-            parity++;
+bool schedule_event(i8080_t *cpu, uint64_t when, event_fn fn, void *context){
+    bool scheduled = false;
+    if(cpu != NULL){
+        scheduled = scheduler_push(&cpu->scheduler, when, fn, context);
+        if(scheduled && when < cpu->deadline){
+            cpu->deadline = when;
         }
-        value >>= 1;
     }
-    return (parity % 2 == 0);
+    return scheduled;
 }
 
-static void set_flags(i8080_t *cpu, uint16_t result){
-    cpu->flags.z = (result & 0xFF) == 0;
-    cpu->flags.s = (result & 0x80) != 0;
-    cpu->flags.p = check_parity(result & 0xFF);
-    cpu->flags.cy = (result & 0xFF00) != 0;
-    cpu->flags.ac = (result & 0x0F) != 0;
+void cancel_event(i8080_t *cpu, event_fn fn, void *context){
+    if(cpu != NULL){
+        scheduler_cancel(&cpu->scheduler, fn, context);
+    }
 }
 
+void request_interrupt(i8080_t *cpu, uint8_t opcode){
+    if(cpu != NULL){
+        cpu->interrupt_opcode = opcode;
+        cpu->interrupt_pending = true;
+        if(cpu->interrupts_enabled){
+            cpu->deadline = 0;
+        }
+    }
+}
+
+// Sign, zero and parity bits of every 8-bit result, in PSW bit positions.
+static const uint8_t zsp_table[256] = {
+        0x44, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+        0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+        0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+        0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+        0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+        0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+        0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+        0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+        0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+        0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+        0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+        0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+        0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+        0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+        0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+        0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84
+};
+
+// Auxiliary carry out of bit 3, indexed by bit 3 of both operands and of the result.
+static const uint8_t half_carry_table[8] = { 0, 0, FLAG_AC, 0, FLAG_AC, 0, FLAG_AC, FLAG_AC };
+// Same index for subtraction; the 8080 sets AC when there was *no* borrow from bit 4.
+static const uint8_t sub_half_carry_table[8] = { FLAG_AC, 0, 0, 0, FLAG_AC, FLAG_AC, FLAG_AC, 0 };
+
+#define HALF_CARRY_INDEX(a, b, result) ((((a) & 0x08) >> 1) | (((b) & 0x08) >> 2) | (((result) & 0x08) >> 3))
+
+// PSW for the result of `operation` on `a` and `b`. Bit 8 of `result` is the carry out, or for
+// INR/DCR the carry they leave untouched.
+static inline uint8_t compute_flags(uint8_t operation, uint8_t a, uint8_t b, uint16_t result){
+    uint8_t ac = 0;
+    switch(operation){
+        case FLAGS_ADD: ac = half_carry_table[HALF_CARRY_INDEX(a, b, result)]; break;
+        case FLAGS_SUB: ac = sub_half_carry_table[HALF_CARRY_INDEX(a, b, result)]; break;
+        case FLAGS_AND: ac = ((a | b) & 0x08) << 1; break;
+        case FLAGS_INR: ac = (result & 0x0F) == 0 ? FLAG_AC : 0; break;
+        case FLAGS_DCR: ac = (result & 0x0F) != 0x0F ? FLAG_AC : 0; break;
+        default: break;
+    }
+    return zsp_table[result & 0xFF] | ((result >> 8) & FLAG_CY) | ac | FLAG_ALWAYS;
+}
+
+static inline void set_flags(i8080_t *cpu, uint8_t operation, uint8_t a, uint8_t b, uint16_t result){
+#ifdef I8080_LAZY_FLAGS
+    cpu->flag_op = operation;
+    cpu->flag_a = a;
+    cpu->flag_b = b;
+    cpu->flag_result = result;
+#else
+    cpu->F = compute_flags(operation, a, b, result);
+#endif
+}
+
+#ifdef I8080_LAZY_FLAGS
+uint8_t materialize_flags(i8080_t *cpu){
+    cpu->F = compute_flags(cpu->flag_op, cpu->flag_a, cpu->flag_b, cpu->flag_result);
+    cpu->flag_op = FLAGS_CLEAN;
+    return cpu->F;
+}
+#endif
+
 void ADD(i8080_t *cpu, uint8_t val1, uint8_t val2){
     uint16_t result = cpu->A + val1 + val2;
-    set_flags(cpu, result);
+    set_flags(cpu, FLAGS_ADD, cpu->A, val1, result);
     cpu->A = result & 0xFF;
 }
 
 void SUB(i8080_t *cpu, uint8_t val1, uint8_t val2){
     uint16_t result = cpu->A - val1 - val2;
-    set_flags(cpu, result);
+    set_flags(cpu, FLAGS_SUB, cpu->A, val1, result & 0x1FF);
     cpu->A = result & 0xFF;
 }
 
 void ANA(i8080_t *cpu, uint8_t reg){
-    uint16_t result = cpu->A & reg;
-    set_flags(cpu, result);
-    cpu->A = result & 0xFF;
+    uint8_t result = cpu->A & reg;
+    set_flags(cpu, FLAGS_AND, cpu->A, reg, result);
+    cpu->A = result;
 }
 
 void ORA(i8080_t *cpu, uint8_t reg){
-    uint16_t result = cpu->A | reg;
-    set_flags(cpu, result);
-    cpu->A = result & 0xFF;
+    cpu->A |= reg;
+    set_flags(cpu, FLAGS_LOGIC, 0, 0, cpu->A);
 }
 
 void XRA(i8080_t *cpu, uint8_t reg){
-    uint16_t result = cpu->A ^ reg;
-    set_flags(cpu, result);
-    cpu->A = result & 0xFF;
+    cpu->A ^= reg;
+    set_flags(cpu, FLAGS_LOGIC, 0, 0, cpu->A);
 }
 
 void CMP(i8080_t *cpu, uint8_t reg){
     uint16_t result = cpu->A - reg;
-    set_flags(cpu, result);
+    set_flags(cpu, FLAGS_SUB, cpu->A, reg, result & 0x1FF);
 }
 
 void INR(i8080_t *cpu, uint8_t *reg){
-    uint16_t result = *reg + 1;
-    set_flags(cpu, result);
-    *reg = result & 0xFF;
+    uint8_t result = *reg + 1;
+    set_flags(cpu, FLAGS_INR, 0, 0, result | (GET_CY(cpu) << 8));
+    *reg = result;
 }
 
-void INX(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2){
-    uint16_t result = TO16BIT(*reg1, *reg2) + 1;
-    *reg1 = (result >> 8) & 0xFF;
-    *reg2 = result & 0xFF;
+void INX(i8080_t *cpu, uint16_t *pair){
+    (void)cpu;
+    (*pair)++;
 }
 
 void DCR(i8080_t *cpu, uint8_t *reg){
-    uint16_t result = *reg - 1;
-    set_flags(cpu, result);
-    *reg = result & 0xFF;
+    uint8_t result = *reg - 1;
+    set_flags(cpu, FLAGS_DCR, 0, 0, result | (GET_CY(cpu) << 8));
+    *reg = result;
+}
+
+void DCX(i8080_t *cpu, uint16_t *pair){
+    (void)cpu;
+    (*pair)--;
 }
 
-void DCX(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2){
-    uint16_t result = TO16BIT(*reg1, *reg2) - 1;
-    *reg1 = (result >> 8) & 0xFF;
-    *reg2 = result & 0xFF;
+void DAD(i8080_t *cpu, uint16_t pair){
+    uint32_t result = cpu->HL + pair;
+    cpu->HL = result & 0xFFFF;
+    SET_FLAG(cpu, FLAG_CY, result > 0xFFFF);
 }
 
-void DAD(i8080_t *cpu, uint8_t reg1, uint8_t reg2){
-    uint16_t result = TO16BIT(cpu->H, cpu->L) + TO16BIT(reg1, reg2);
-    cpu->H = HIGH_BYTE(result);
-    cpu->L = LOW_BYTE(result);
-    cpu->flags.cy = (result & 0xFF00) != 0;
+// Adds 0x06 and/or 0x60 to bring A back to two BCD digits. S, Z, P and AC follow the addition;
+// CY is set when the high digit needed correcting and is never cleared.
+void DAA(i8080_t *cpu){
+    uint8_t correction = 0;
+    uint8_t carry = GET_CY(cpu);
+    uint8_t low = cpu->A & 0x0F;
+    uint8_t high = cpu->A >> 4;
+    uint16_t result;
+    if(low > 9 || GET_AC(cpu)){
+        correction |= 0x06;
+    }
+    if(high > 9 || carry || (high == 9 && low > 9)){
+        correction |= 0x60;
+        carry = 1;
+    }
+    result = cpu->A + correction;
+    set_flags(cpu, FLAGS_ADD, cpu->A, correction, (result & 0xFF) | (carry << 8));
+    cpu->A = result & 0xFF;
 }
 
 void MOV(i8080_t *cpu, uint8_t *reg1, const uint8_t *reg2){
     *reg1 = *reg2;
 }
 
-void POP(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2){
-    *reg2 = *read_memory(cpu, cpu->SP);
-    cpu->SP++;
-    *reg1 = *read_memory(cpu, cpu->SP);
-    cpu->SP++;
+void POP(i8080_t *cpu, uint16_t *pair){
+    *pair = memory_word(cpu, cpu->SP);
+    cpu->SP += 2;
 }
 
 void POP_PSW(i8080_t *cpu){
-    uint8_t psw = *read_memory(cpu, cpu->SP);
-
-    cpu->flags.z = (psw & 0x40) != 0;
-    cpu->flags.s = (psw & 0x80) != 0;
-    cpu->flags.p = (psw & 0x04) != 0;
-    cpu->flags.cy = (psw & 0x01) != 0;
-    cpu->flags.ac = (psw & 0x10) != 0;
-
-    cpu->A = *read_memory(cpu, cpu->SP + 1);
-    cpu->SP += 2;
+    POP(cpu, &cpu->PSW);
+    cpu->F = (cpu->F & FLAG_MASK) | FLAG_ALWAYS;
+    CLEAR_PENDING_FLAGS(cpu);
 }
 
-void PUSH(i8080_t *cpu, uint8_t reg1, uint8_t reg2){
+void PUSH(i8080_t *cpu, uint16_t pair){
     cpu->SP--;
-    write_memory(cpu, cpu->SP, reg1);
+    memory_write(cpu, cpu->SP, HIGH_BYTE(pair));
     cpu->SP--;
-    write_memory(cpu, cpu->SP, reg2);
+    memory_write(cpu, cpu->SP, LOW_BYTE(pair));
 }
 
 void PUSH_PSW(i8080_t *cpu){
-    uint8_t psw = 0;
-
-    psw |= cpu->flags.z << 6;
-    psw |= cpu->flags.s << 7;
-    psw |= cpu->flags.p << 2;
-    psw |= cpu->flags.cy;
-    psw |= cpu->flags.ac << 4;
-
-    cpu->SP--;
-    write_memory(cpu, cpu->SP, psw);
-    cpu->SP--;
-    write_memory(cpu, cpu->SP, cpu->A);
+    SYNC_FLAGS(cpu);
+    PUSH(cpu, cpu->PSW);
 }
 
+// Pushes the address of the instruction following the 3-byte CALL/Ccc at PC.
 void CALL(i8080_t *cpu, uint16_t address){
-    PUSH(cpu, HIGH_BYTE(cpu->PC), LOW_BYTE(cpu->PC));
+    PUSH(cpu, cpu->PC + 3);
     cpu->PC = address;
 }
 
 void RET(i8080_t *cpu){
-    uint8_t pc_low = LOW_BYTE(cpu->PC);
-    uint8_t pc_high = HIGH_BYTE(cpu->PC);
-    POP(cpu, &pc_high, &pc_low);
+    POP(cpu, &cpu->PC);
+}
+
+// Pushes PC and jumps to the restart vector encoded in an RST opcode.
+void RST(i8080_t *cpu, uint8_t opcode){
+    PUSH(cpu, cpu->PC);
+    cpu->PC = opcode & 0x38;
 }
 
 void JMP(i8080_t *cpu, uint16_t address){
     cpu->PC = address;
 }
 
-void LXI(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2, uint8_t high, uint8_t low){
-    *reg1 = high;
-    *reg2 = low;
+void LXI(i8080_t *cpu, uint16_t *pair, uint16_t value){
+    (void)cpu;
+    *pair = value;
 }
 
 void NOP(i8080_t *cpu){
@@ -9,28 +9,66 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include "i8080_io.h"
+#include "i8080_memory.h"
+#include "i8080_scheduler.h"
+
 #define HIGH_BYTE(val) ((val & 0xFF00) >> 8)
 #define LOW_BYTE(val) (val & 0x00FF)
 #define TO16BIT(h, l) ((h << 8) | l)
 
-typedef struct {
-    uint8_t z:1; // Zero Flag
-    uint8_t s:1; // Sign Flag
-    uint8_t p:1; // Parity Flag
-    uint8_t cy:1; // Carry Flag
-    uint8_t ac:1; // Auxiliary Carry Flag
-    uint8_t pad:3; // Not used
-} flags_t;
+// Flag bit positions in the 8080 PSW byte
+#define FLAG_S 0x80
+#define FLAG_Z 0x40
+#define FLAG_AC 0x10
+#define FLAG_P 0x04
+#define FLAG_ALWAYS 0x02 // Bit 1 always reads as 1
+#define FLAG_CY 0x01
+#define FLAG_MASK (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)
+
+// Operations whose flags are computed from their operands and result (see set_flags())
+#define FLAGS_CLEAN 0 // F is up to date
+#define FLAGS_ADD 1
+#define FLAGS_SUB 2
+#define FLAGS_AND 3
+#define FLAGS_LOGIC 4 // ORA, XRA
+#define FLAGS_INR 5
+#define FLAGS_DCR 6
+
+#ifdef I8080_LAZY_FLAGS
+// With lazy flags the ALU only records its last operation; F is brought up to date when
+// something reads it as a whole. CY, Z and S come straight from the recorded result.
+#define FLAGS(cpu) ((cpu)->flag_op != FLAGS_CLEAN ? materialize_flags(cpu) : (cpu)->F)
+#define SYNC_FLAGS(cpu) ((void)FLAGS(cpu))
+#define CLEAR_PENDING_FLAGS(cpu) ((cpu)->flag_op = FLAGS_CLEAN)
+#define GET_S(cpu) (((cpu)->flag_op != FLAGS_CLEAN ? (cpu)->flag_result : (cpu)->F) >> 7 & 1)
+#define GET_Z(cpu) ((cpu)->flag_op != FLAGS_CLEAN ? ((cpu)->flag_result & 0xFF) == 0 : ((cpu)->F >> 6) & 1)
+#define GET_CY(cpu) (((cpu)->flag_op != FLAGS_CLEAN ? (cpu)->flag_result >> 8 : (cpu)->F) & 1)
+#else
+#define FLAGS(cpu) ((cpu)->F)
+#define SYNC_FLAGS(cpu) ((void)0)
+#define CLEAR_PENDING_FLAGS(cpu) ((void)0)
+#define GET_S(cpu) (((cpu)->F >> 7) & 1)
+#define GET_Z(cpu) (((cpu)->F >> 6) & 1)
+#define GET_CY(cpu) ((cpu)->F & 1)
+#endif
+#define GET_AC(cpu) ((FLAGS(cpu) >> 4) & 1)
+#define GET_P(cpu) ((FLAGS(cpu) >> 2) & 1)
+#define SET_FLAG(cpu, flag, value) (SYNC_FLAGS(cpu), (cpu)->F = (value) ? ((cpu)->F | (flag)) : ((cpu)->F & ~(flag)))
+
+// Register pair whose halves are addressable as 8-bit registers, high byte first in 8080 terms
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define REGISTER_PAIR(high, low, pair) union { struct { uint8_t high; uint8_t low; }; uint16_t pair; }
+#else
+#define REGISTER_PAIR(high, low, pair) union { struct { uint8_t low; uint8_t high; }; uint16_t pair; }
+#endif
 
 typedef struct{
-    // 8-bit registers
-    uint8_t A; // Primary Accumulator
-    uint8_t B;
-    uint8_t C;
-    uint8_t D;
-    uint8_t E;
-    uint8_t H;
-    uint8_t L;
+    // 8-bit registers, paired as PSW (A and flags), BC, DE and HL
+    REGISTER_PAIR(A, F, PSW); // Primary Accumulator and flags
+    REGISTER_PAIR(B, C, BC);
+    REGISTER_PAIR(D, E, DE);
+    REGISTER_PAIR(H, L, HL);
 
     // 16-bit index registers
     uint16_t SP; // Stack Pointer
@@ -38,21 +76,84 @@ typedef struct{
     // 16-bit program counter
     uint16_t PC; // Program Counter
 
-    flags_t flags;
-
-    uint8_t *memory;
+    // Interrupt state
+    bool interrupts_enabled; // INTE flip-flop
+    bool ei_pending; // EI was the last instruction; interrupts are held off for one more
+    bool halted;
+    bool interrupt_pending;
+    uint8_t interrupt_opcode; // RST instruction supplied by the interrupting device
+
+#ifdef I8080_LAZY_FLAGS
+    // Last flag-setting operation, FLAGS_CLEAN once folded into F. Bit 8 of the result is CY.
+    uint8_t flag_op;
+    uint8_t flag_a;
+    uint8_t flag_b;
+    uint16_t flag_result;
+#endif
+
+    uint64_t cycles; // T-states elapsed since init
+    uint64_t deadline; // Cycle at which the running slice stops, lowered to stop it early
+    uint64_t halted_at; // Cycle count when the CPU last halted, before waiting skipped ahead
+    scheduler_t scheduler;
+
+    uint8_t *memory; // Backing RAM, mapped 1:1 by default
+    memory_map_t map;
+    io_bus_t io;
+
+    struct i8080_snapshot *base; // Snapshot whose pages are shared into the map, if any
+    struct block_cache *blocks; // Decoded basic blocks, NULL while interpreting
+    struct i8080_debug *debug; // Breakpoints and watchpoints, NULL while not debugging
+    struct state_device *devices; // Save-state hooks, see register_device()
+    size_t device_count;
+#ifdef I8080_PROFILE
+    struct i8080_profile *profile; // Counters updated by the core, NULL while not profiling
+#endif
+#ifdef I8080_TRACE
+    struct i8080_trace *trace; // Ring of executed instructions, NULL while not tracing
+#endif
+#ifdef I8080_FUZZ
+    uint8_t *coverage; // Edge hit counters updated by the core, NULL while not fuzzing
+    uint16_t coverage_previous; // Last branch target, hashed and shifted as AFL does
+#endif
 } i8080_t;
 
 i8080_t* init_i8080(void);
+// Return to the power-on state: registers and memory cleared, plain RAM map, no devices or events.
+void reset_i8080(i8080_t *cpu);
 void destroy_i8080(i8080_t *cpu);
 
-uint8_t *read_memory(i8080_t *cpu, uint16_t address);
+// Set up / tear down a machine whose struct and MEMORY_SIZE bytes of memory the caller owns
+void init_i8080_in(i8080_t *cpu, uint8_t *memory);
+void release_i8080(i8080_t *cpu);
+
+uint8_t read_memory(i8080_t *cpu, uint16_t address);
 void write_memory(i8080_t *cpu, uint16_t address, uint8_t value);
 
+typedef bool (*i8080_stop_fn)(i8080_t *cpu, void *context);
+
 uint8_t emulate_cycle(i8080_t *cpu);
 
+// Execute instructions until at least `budget` T-states have elapsed. Returns the cycles spent.
+uint64_t run_cycles(i8080_t *cpu, uint64_t budget);
+// Execute instructions until `stop` returns true. Returns the cycles spent.
+uint64_t run_until(i8080_t *cpu, i8080_stop_fn stop, void *context);
+
+// Call `fn` once cpu->cycles reaches `when`. Events fire between instructions, so a callback
+// may run a few cycles late (never early); `when` is passed through unchanged.
+bool schedule_event(i8080_t *cpu, uint64_t when, event_fn fn, void *context);
+void cancel_event(i8080_t *cpu, event_fn fn, void *context);
+
+// Raise the interrupt line with an RST opcode. It is taken between instructions once interrupts
+// are enabled, and wakes the CPU from HLT.
+void request_interrupt(i8080_t *cpu, uint8_t opcode);
+
 void print_state(i8080_t *cpu);
 
+#ifdef I8080_LAZY_FLAGS
+// Folds the pending operation into F and returns it
+uint8_t materialize_flags(i8080_t *cpu);
+#endif
+
 void NOP(i8080_t *cpu);
 
 // Opcode functions
@@ -63,15 +164,17 @@ void ORA(i8080_t *cpu, uint8_t reg);
 void XRA(i8080_t *cpu, uint8_t reg);
 void CMP(i8080_t *cpu, uint8_t reg);
 void INR(i8080_t *cpu, uint8_t *reg);
-void INX(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2);
+void INX(i8080_t *cpu, uint16_t *pair);
 void DCR(i8080_t *cpu, uint8_t *reg);
-void DCX(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2);
-void DAD(i8080_t *cpu, uint8_t reg1, uint8_t reg2);void POP(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2);
+void DCX(i8080_t *cpu, uint16_t *pair);
+void DAD(i8080_t *cpu, uint16_t pair);
+void DAA(i8080_t *cpu);
+void POP(i8080_t *cpu, uint16_t *pair);
 void POP_PSW(i8080_t *cpu);
-void PUSH(i8080_t *cpu, uint8_t reg1, uint8_t reg2);
+void PUSH(i8080_t *cpu, uint16_t pair);
 void PUSH_PSW(i8080_t *cpu);
 
-void LXI(i8080_t *cpu, uint8_t *reg1, uint8_t *reg2, uint8_t high, uint8_t low);
+void LXI(i8080_t *cpu, uint16_t *pair, uint16_t value);
 
 void JMP(i8080_t *cpu, uint16_t address);
 void CALL(i8080_t *cpu, uint16_t address);
@@ -79,5 +182,6 @@ uint8_t Ccc(i8080_t *cpu, bool condition, uint16_t address);
 uint8_t Rcc(i8080_t *cpu, bool condition);
 void Jcc(i8080_t *cpu, bool condition, uint16_t address);
 void RET(i8080_t *cpu);
+void RST(i8080_t *cpu, uint8_t opcode);
 
 #endif //INTEL8080_I8080_CPU_H
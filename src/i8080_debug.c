@@ -0,0 +1,135 @@
+//
+// Created by leonv on 5/30/2024.
+//
+
+#include "i8080_debug.h"
+
+#include <stdlib.h>
+
+static void set_bit(uint8_t *map, uint16_t address, bool value){
+    if(value){
+        map[address >> 3] |= 1 << (address & 7);
+    }
+    else{
+        map[address >> 3] &= ~(1 << (address & 7));
+    }
+}
+
+// Reported by the memory map for every access to a watched page
+static void watch_access(void *context, uint16_t address, uint8_t value, bool write){
+    i8080_t *cpu = (i8080_t*)context;
+    debug_t *debug = cpu->debug;
+    if(debug->event == DEBUG_NONE && DEBUG_BIT(write ? debug->watch_write : debug->watch_read, address)){
+        debug->event = write ? DEBUG_WRITE : DEBUG_READ;
+        debug->address = address;
+        debug->value = value;
+        cpu->deadline = 0; // End the slice once the instruction is done
+    }
+}
+
+debug_t *enable_debugger(i8080_t *cpu){
+    debug_t *debug;
+    if(cpu == NULL){
+        return NULL;
+    }
+    if(cpu->debug != NULL){
+        return cpu->debug;
+    }
+    debug = (debug_t*)calloc(1, sizeof(debug_t));
+    if(debug != NULL){
+        cpu->debug = debug;
+        cpu->map.watch = watch_access;
+        cpu->map.watch_context = cpu;
+    }
+    return debug;
+}
+
+void disable_debugger(i8080_t *cpu){
+    if(cpu != NULL && cpu->debug != NULL){
+        for(int page = 0; page < PAGE_COUNT; page++){
+            if(cpu->debug->page_watches[page] != 0){
+                memory_map_unwatch(&cpu->map, page);
+            }
+        }
+        cpu->map.watch = NULL;
+        cpu->map.watch_context = NULL;
+        free(cpu->debug);
+        cpu->debug = NULL;
+    }
+}
+
+void restore_debugger(i8080_t *cpu){
+    if(cpu != NULL && cpu->debug != NULL){
+        cpu->map.watch = watch_access;
+        cpu->map.watch_context = cpu;
+        for(int page = 0; page < PAGE_COUNT; page++){
+            if(cpu->debug->page_watches[page] != 0){
+                memory_map_watch(&cpu->map, page);
+            }
+        }
+    }
+}
+
+bool set_breakpoint(i8080_t *cpu, uint16_t address){
+    debug_t *debug = enable_debugger(cpu);
+    if(debug == NULL){
+        return false;
+    }
+    if(!DEBUG_BIT(debug->breakpoints, address)){
+        set_bit(debug->breakpoints, address, true);
+        debug->breakpoint_count++;
+        cpu->deadline = 0; // A running slice has to switch to checking them
+    }
+    return true;
+}
+
+bool clear_breakpoint(i8080_t *cpu, uint16_t address){
+    debug_t *debug = cpu != NULL ? cpu->debug : NULL;
+    if(debug == NULL || !DEBUG_BIT(debug->breakpoints, address)){
+        return false;
+    }
+    set_bit(debug->breakpoints, address, false);
+    debug->breakpoint_count--;
+    return true;
+}
+
+// Sets or clears the watch bits for [address, address + length), keeping the per-page counts
+// and the memory map's PAGE_WATCH marks in line with them
+static void update_watch(i8080_t *cpu, uint16_t address, uint16_t length, bool read, bool write, bool value){
+    debug_t *debug = cpu->debug;
+    for(uint32_t i = 0; i < length; i++){
+        uint16_t byte = (uint16_t)(address + i);
+        uint8_t page = PAGE_OF(byte);
+        bool before = DEBUG_BIT(debug->watch_read, byte) || DEBUG_BIT(debug->watch_write, byte);
+        bool after;
+        if(read){
+            set_bit(debug->watch_read, byte, value);
+        }
+        if(write){
+            set_bit(debug->watch_write, byte, value);
+        }
+        after = DEBUG_BIT(debug->watch_read, byte) || DEBUG_BIT(debug->watch_write, byte);
+        if(after && !before && debug->page_watches[page]++ == 0){
+            memory_map_watch(&cpu->map, page);
+        }
+        else if(before && !after && --debug->page_watches[page] == 0){
+            memory_map_unwatch(&cpu->map, page);
+        }
+    }
+}
+
+bool set_watchpoint(i8080_t *cpu, uint16_t address, uint16_t length, bool read, bool write){
+    if(length == 0 || (!read && !write) || enable_debugger(cpu) == NULL){
+        return false;
+    }
+    update_watch(cpu, address, length, read, write, true);
+    return true;
+}
+
+bool clear_watchpoint(i8080_t *cpu, uint16_t address, uint16_t length, bool read, bool write){
+    if(cpu == NULL || cpu->debug == NULL){
+        return false;
+    }
+    update_watch(cpu, address, length, read, write, false);
+    return true;
+}
@@ -0,0 +1,68 @@
+//
+// Created by leonv on 5/30/2024.
+//
+
+#ifndef INTEL8080_I8080_DEBUG_H
+#define INTEL8080_I8080_DEBUG_H
+
+#include "i8080_cpu.h"
+
+// PC breakpoints and memory watchpoints. run_cycles(), run_until() and emulate_cycle() return
+// early when one is hit, with the reason in debug->event; the next run resumes from there.
+//
+// Nothing is checked while nothing is armed. With breakpoints set, the run loop steps one
+// instruction at a time and looks each PC up in a bitmap, bypassing the block cache and JIT.
+// Watchpoints cost nothing on pages without one: a watched page is marked PAGE_WATCH, which
+// sends every access to it down the memory map's slow path and on to the debugger. Instruction
+// fetches from a watched page count as reads, and so do host accesses through read_memory().
+
+typedef enum {
+    DEBUG_NONE,
+    DEBUG_BREAKPOINT, // Stopped before the instruction at `address`
+    DEBUG_READ, // Stopped after the instruction that read `value` from `address`
+    DEBUG_WRITE, // Stopped after the instruction that wrote `value` to `address`
+} debug_event_t;
+
+typedef struct i8080_debug {
+    uint8_t breakpoints[MEMORY_SIZE / 8];
+    uint8_t watch_read[MEMORY_SIZE / 8];
+    uint8_t watch_write[MEMORY_SIZE / 8];
+    uint16_t page_watches[PAGE_COUNT]; // Watched bytes per page, for either access
+    size_t breakpoint_count;
+
+    debug_event_t event;
+    uint16_t address;
+    uint8_t value;
+    bool resuming; // Stopped at the breakpoint at `address`, which the next run executes rather than stops at
+} debug_t;
+
+// Attach a debugger (or return the one attached); NULL on allocation failure
+debug_t *enable_debugger(i8080_t *cpu);
+// Clears every breakpoint and watchpoint and frees the debugger
+void disable_debugger(i8080_t *cpu);
+// Marks the watched pages again in a freshly initialised memory map, as after reset_i8080()
+void restore_debugger(i8080_t *cpu);
+
+bool set_breakpoint(i8080_t *cpu, uint16_t address);
+bool clear_breakpoint(i8080_t *cpu, uint16_t address);
+// Watch `length` bytes from `address` for reads, writes or both
+bool set_watchpoint(i8080_t *cpu, uint16_t address, uint16_t length, bool read, bool write);
+bool clear_watchpoint(i8080_t *cpu, uint16_t address, uint16_t length, bool read, bool write);
+
+#define DEBUG_BIT(map, address) (((map)[(address) >> 3] >> ((address) & 7)) & 1)
+
+// Called by the run loop before each instruction while breakpoints are set. Returns true, and
+// records the event, if the run has to stop here.
+static inline bool debug_breakpoint(debug_t *debug, uint16_t pc){
+    bool resuming = debug->resuming && pc == debug->address;
+    debug->resuming = false;
+    if(DEBUG_BIT(debug->breakpoints, pc) && !resuming){
+        debug->event = DEBUG_BREAKPOINT;
+        debug->address = pc;
+        debug->resuming = true;
+        return true;
+    }
+    return false;
+}
+
+#endif //INTEL8080_I8080_DEBUG_H
@@ -0,0 +1,247 @@
+//
+// Created by leonv on 5/12/2024.
+//
+
+#include "i8080_fleet.h"
+#include "i8080_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#define FLEET_SLICE 0x100000 // Cycles per run_cycles() call while checking for completion
+
+// Jobs [head, tail) still waiting on one worker. The owner takes from the head, thieves take
+// the upper half.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} fleet_queue_t;
+
+typedef struct {
+    fleet_job_t *jobs;
+    const fleet_options_t *options;
+    fleet_queue_t *queues;
+    unsigned count;
+} fleet_t;
+
+typedef struct {
+    fleet_t *fleet;
+    unsigned index;
+    i8080_t *cpu;
+    size_t halted;
+} fleet_worker_t;
+
+static unsigned default_threads(void){
+#if defined(_SC_NPROCESSORS_ONLN)
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if(online > 0){
+        return (unsigned)online;
+    }
+#endif
+    return 1;
+}
+
+static bool take_job(fleet_queue_t *queue, size_t *job){
+    bool taken = false;
+    pthread_mutex_lock(&queue->lock);
+    if(queue->head < queue->tail){
+        *job = queue->head++;
+        taken = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return taken;
+}
+
+static size_t queued_jobs(fleet_queue_t *queue){
+    size_t queued;
+    pthread_mutex_lock(&queue->lock);
+    queued = queue->tail - queue->head;
+    pthread_mutex_unlock(&queue->lock);
+    return queued;
+}
+
+// Moves the upper half of the fullest other queue into the worker's (empty) own queue.
+static bool steal_jobs(fleet_t *fleet, unsigned self){
+    unsigned victim = self;
+    size_t most = 0;
+    size_t head = 0, tail = 0;
+
+    for(unsigned i = 0; i < fleet->count; i++){
+        size_t queued = i != self ? queued_jobs(&fleet->queues[i]) : 0;
+        if(queued > most){
+            most = queued;
+            victim = i;
+        }
+    }
+    if(victim == self){
+        return false;
+    }
+
+    fleet_queue_t *queue = &fleet->queues[victim];
+    pthread_mutex_lock(&queue->lock);
+    if(queue->tail > queue->head){
+        size_t half = (queue->tail - queue->head + 1) / 2;
+        tail = queue->tail;
+        head = tail - half;
+        queue->tail = head;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    if(head == tail){
+        return true; // Lost the race for this victim, but others may still have work
+    }
+    queue = &fleet->queues[self];
+    pthread_mutex_lock(&queue->lock);
+    queue->head = head;
+    queue->tail = tail;
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+static bool has_work(fleet_t *fleet){
+    for(unsigned i = 0; i < fleet->count; i++){
+        if(queued_jobs(&fleet->queues[i]) > 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_job(i8080_t *cpu, fleet_job_t *job, const fleet_options_t *options){
+    job->cycles = 0;
+    if(!reset_to_image(cpu, job->image, job->size, job->origin)){
+        job->status = FLEET_ERROR;
+        return;
+    }
+    if(options->setup != NULL){
+        options->setup(cpu, job);
+    }
+
+    job->status = FLEET_CYCLE_CAP;
+    while(cpu->cycles < job->cycle_cap){
+        uint64_t slice = job->cycle_cap - cpu->cycles;
+        run_cycles(cpu, slice < FLEET_SLICE ? slice : FLEET_SLICE);
+        if(cpu->halted && (!cpu->interrupts_enabled || cpu->scheduler.count == 0)){
+            job->status = FLEET_HALTED;
+            break;
+        }
+    }
+
+    // Waiting in HLT skips to the end of the slice, which says nothing about the program
+    job->cycles = job->status == FLEET_HALTED ? cpu->halted_at : cpu->cycles;
+    job->PSW = cpu->PSW;
+    job->BC = cpu->BC;
+    job->DE = cpu->DE;
+    job->HL = cpu->HL;
+    job->SP = cpu->SP;
+    job->PC = cpu->PC;
+    if(options->finish != NULL){
+        options->finish(cpu, job);
+    }
+}
+
+static void *fleet_worker(void *argument){
+    fleet_worker_t *worker = (fleet_worker_t*)argument;
+    fleet_t *fleet = worker->fleet;
+    i8080_t *cpu = worker->cpu;
+    size_t job;
+
+    for(;;){
+        if(take_job(&fleet->queues[worker->index], &job)){
+            run_job(cpu, &fleet->jobs[job], fleet->options);
+            if(fleet->jobs[job].status == FLEET_HALTED){
+                worker->halted++;
+            }
+        }
+        else if(!steal_jobs(fleet, worker->index) && !has_work(fleet)){
+            break;
+        }
+    }
+    return NULL;
+}
+
+size_t run_fleet(fleet_job_t *jobs, size_t count, const fleet_options_t *options){
+    fleet_options_t defaults = { 0, NULL, NULL };
+    fleet_t fleet;
+    machine_pool_t pool;
+    fleet_worker_t *workers;
+    pthread_t *threads;
+    size_t halted = 0;
+    unsigned started = 0;
+
+    if(jobs == NULL || count == 0){
+        return 0;
+    }
+    if(options == NULL){
+        options = &defaults;
+    }
+    fleet.jobs = jobs;
+    fleet.options = options;
+    fleet.count = options->threads > 0 ? options->threads : default_threads();
+    if(fleet.count > count){
+        fleet.count = (unsigned)count;
+    }
+    fleet.queues = (fleet_queue_t*)calloc(fleet.count, sizeof(fleet_queue_t));
+    workers = (fleet_worker_t*)calloc(fleet.count, sizeof(fleet_worker_t));
+    threads = (pthread_t*)calloc(fleet.count, sizeof(pthread_t));
+    if(fleet.queues == NULL || workers == NULL || threads == NULL || !machine_pool_init(&pool, fleet.count)){
+        free(fleet.queues);
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    for(size_t i = 0; i < count; i++){
+        jobs[i].status = FLEET_PENDING;
+    }
+    // Contiguous initial shares keep neighbouring jobs (often similar images) on one worker
+    for(unsigned i = 0; i < fleet.count; i++){
+        pthread_mutex_init(&fleet.queues[i].lock, NULL);
+        fleet.queues[i].head = count * i / fleet.count;
+        fleet.queues[i].tail = count * (i + 1) / fleet.count;
+        workers[i].fleet = &fleet;
+        workers[i].index = i;
+        workers[i].cpu = machine_pool_acquire(&pool);
+        workers[i].halted = 0;
+    }
+    for(unsigned i = 0; i < fleet.count; i++){
+        if(pthread_create(&threads[i], NULL, fleet_worker, &workers[i]) != 0){
+            break;
+        }
+        started++;
+    }
+    if(started == 0){
+        fleet_worker(&workers[0]); // Could not start any threads, run everything here
+    }
+    for(unsigned i = 0; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+
+    for(unsigned i = 0; i < fleet.count; i++){
+        halted += workers[i].halted;
+        pthread_mutex_destroy(&fleet.queues[i].lock);
+    }
+    machine_pool_release(&pool);
+    free(fleet.queues);
+    free(workers);
+    free(threads);
+    return halted;
+}
+
+void print_fleet_summary(const fleet_job_t *jobs, size_t count){
+    size_t by_status[FLEET_ERROR + 1] = { 0 };
+    uint64_t cycles = 0;
+
+    for(size_t i = 0; i < count; i++){
+        by_status[jobs[i].status]++;
+        cycles += jobs[i].cycles;
+    }
+    printf("Jobs: %zu halted, %zu hit cycle cap, %zu failed, %zu not run\n",
+           by_status[FLEET_HALTED], by_status[FLEET_CYCLE_CAP], by_status[FLEET_ERROR], by_status[FLEET_PENDING]);
+    printf("Total cycles: %llu\n", (unsigned long long)cycles);
+}
@@ -0,0 +1,47 @@
+//
+// Created by leonv on 5/12/2024.
+//
+
+#ifndef INTEL8080_I8080_FLEET_H
+#define INTEL8080_I8080_FLEET_H
+
+#include "i8080_cpu.h"
+
+typedef enum {
+    FLEET_PENDING,
+    FLEET_HALTED, // Ran to HLT with no way left to wake up
+    FLEET_CYCLE_CAP, // Still running when the cycle cap was reached
+    FLEET_ERROR // The image did not fit in memory
+} fleet_status_t;
+
+typedef struct {
+    // Input
+    const uint8_t *image;
+    size_t size;
+    uint16_t origin; // Load address, also the entry point
+    uint64_t cycle_cap;
+    void *context; // Free for the setup/finish callbacks
+
+    // Result
+    fleet_status_t status;
+    uint64_t cycles;
+    uint16_t PSW, BC, DE, HL, SP, PC;
+} fleet_job_t;
+
+// Called on the worker thread with the machine assigned to a job: `setup` after the image is
+// loaded, to attach devices; `finish` after it stops, to collect device state.
+typedef void (*fleet_fn)(i8080_t *cpu, fleet_job_t *job);
+
+typedef struct {
+    unsigned threads; // 0 picks one per online CPU
+    fleet_fn setup;
+    fleet_fn finish;
+} fleet_options_t;
+
+// Runs every job on its own machine, spread over worker threads that steal work from each
+// other once their own share is done. Returns the number of jobs that halted.
+size_t run_fleet(fleet_job_t *jobs, size_t count, const fleet_options_t *options);
+
+void print_fleet_summary(const fleet_job_t *jobs, size_t count);
+
+#endif //INTEL8080_I8080_FLEET_H
@@ -0,0 +1,123 @@
+//
+// Created by leonv on 5/28/2024.
+//
+
+#include "i8080_fuzz.h"
+
+#ifdef I8080_FUZZ
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint8_t read_input(void *context, uint8_t port){
+    fuzz_t *fuzz = (fuzz_t*)context;
+    (void)port;
+    return fuzz->position < fuzz->size ? fuzz->input[fuzz->position++] : 0;
+}
+
+static uint8_t read_remaining(void *context, uint8_t port){
+    fuzz_t *fuzz = (fuzz_t*)context;
+    (void)port;
+    return fuzz->position < fuzz->size ? 0xFF : 0x00;
+}
+
+// Ends the run by halting, which the run loop skips through to the end of the budget
+static void write_status(void *context, uint8_t port, uint8_t value){
+    fuzz_t *fuzz = (fuzz_t*)context;
+    (void)port;
+    fuzz->status = value == 0 ? FUZZ_EXIT : FUZZ_CRASH;
+    fuzz->cpu->halted = true;
+    fuzz->cpu->deadline = 0;
+}
+
+bool fuzz_init(fuzz_t *fuzz, i8080_t *cpu, uint8_t *coverage, uint8_t port, uint64_t max_cycles){
+    if(fuzz == NULL || cpu == NULL || max_cycles == 0){
+        return false;
+    }
+    memset(fuzz, 0, sizeof(*fuzz));
+    fuzz->own_coverage = coverage == NULL;
+    if(fuzz->own_coverage){
+        coverage = (uint8_t*)calloc(1, FUZZ_MAP_SIZE);
+        if(coverage == NULL){
+            return false;
+        }
+    }
+    fuzz->start = snapshot_i8080(cpu);
+    if(fuzz->start == NULL){
+        if(fuzz->own_coverage){
+            free(coverage);
+        }
+        return false;
+    }
+    fuzz->cpu = cpu;
+    fuzz->coverage = coverage;
+    fuzz->port = port;
+    fuzz->max_cycles = max_cycles;
+    io_bus_register(&cpu->io, port, read_input, write_status, fuzz);
+    io_bus_register(&cpu->io, (uint8_t)(port + 1), read_remaining, NULL, fuzz);
+    cpu->coverage = coverage;
+    return true;
+}
+
+bool fuzz_input_region(fuzz_t *fuzz, uint16_t address, uint16_t capacity){
+    if(fuzz == NULL || fuzz->cpu == NULL || (capacity != 0 && (capacity < 2 || address + capacity > MEMORY_SIZE))){
+        return false;
+    }
+    fuzz->address = address;
+    fuzz->capacity = capacity;
+    return true;
+}
+
+void fuzz_release(fuzz_t *fuzz){
+    if(fuzz != NULL && fuzz->cpu != NULL){
+        io_bus_register(&fuzz->cpu->io, fuzz->port, NULL, NULL, NULL);
+        io_bus_register(&fuzz->cpu->io, (uint8_t)(fuzz->port + 1), NULL, NULL, NULL);
+        fuzz->cpu->coverage = NULL;
+        release_snapshot(fuzz->start);
+        if(fuzz->own_coverage){
+            free(fuzz->coverage);
+        }
+        memset(fuzz, 0, sizeof(*fuzz));
+    }
+}
+
+fuzz_status_t fuzz_run(fuzz_t *fuzz, const uint8_t *input, size_t size){
+    i8080_t *cpu = fuzz->cpu;
+
+    restore_i8080(cpu, fuzz->start);
+    fuzz->input = input;
+    fuzz->size = size;
+    fuzz->position = 0;
+    fuzz->status = FUZZ_HANG;
+    if(fuzz->capacity != 0){
+        uint16_t length = size < fuzz->capacity - 2u ? (uint16_t)size : fuzz->capacity - 2u;
+        write_memory(cpu, fuzz->address, LOW_BYTE(length));
+        write_memory(cpu, fuzz->address + 1, HIGH_BYTE(length));
+        for(uint16_t i = 0; i < length; i++){
+            write_memory(cpu, fuzz->address + 2 + i, input[i]);
+        }
+    }
+    cpu->coverage_previous = 0;
+
+    run_cycles(cpu, fuzz->max_cycles);
+    // A guest that halts on its own has finished with the input too
+    if(fuzz->status == FUZZ_HANG && cpu->halted){
+        fuzz->status = FUZZ_EXIT;
+    }
+    fuzz->executions++;
+    return fuzz->status;
+}
+
+void fuzz_clear_coverage(fuzz_t *fuzz){
+    memset(fuzz->coverage, 0, FUZZ_MAP_SIZE);
+}
+
+size_t fuzz_edges(const fuzz_t *fuzz){
+    size_t edges = 0;
+    for(size_t i = 0; i < FUZZ_MAP_SIZE; i++){
+        edges += fuzz->coverage[i] != 0;
+    }
+    return edges;
+}
+
+#endif
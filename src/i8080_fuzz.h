@@ -0,0 +1,85 @@
+//
+// Created by leonv on 5/28/2024.
+//
+
+#ifndef INTEL8080_I8080_FUZZ_H
+#define INTEL8080_I8080_FUZZ_H
+
+#include "i8080_cpu.h"
+#include "i8080_snapshot.h"
+
+#ifdef I8080_FUZZ
+
+// Coverage-guided fuzzing support, only compiled in with I8080_FUZZ. While a coverage map is
+// attached the core records every control transfer (JMP, CALL, RET and their conditional
+// forms, RST, PCHL and interrupts) as an edge in an AFL-compatible bitmap: the landing PC is
+// hashed, XORed with the previous one and the byte at that index incremented. Not-taken
+// branches count as well, as an edge to the next instruction.
+//
+// A fuzz_t runs inputs against a machine set up by the caller. The machine is snapshotted
+// once, and every input starts from that snapshot: restoring only remaps the pages the last
+// input wrote, so a reset costs little more than the registers.
+
+#define FUZZ_MAP_SIZE 0x10000 // Bytes in the edge bitmap, AFL's default
+
+// Opcodes 0xC0-0xFF that transfer control, one bit each
+#define FUZZ_BRANCHES 0xB595B795B795BF9DULL
+#define FUZZ_IS_BRANCH(opcode) ((opcode) >= 0xC0 && ((FUZZ_BRANCHES >> ((opcode) & 0x3F)) & 1))
+
+typedef enum {
+    FUZZ_EXIT, // Halted, or wrote 0 to the harness port
+    FUZZ_CRASH, // Wrote anything else to the harness port
+    FUZZ_HANG, // Still running when the cycle budget ran out
+} fuzz_status_t;
+
+typedef struct {
+    i8080_t *cpu;
+    i8080_snapshot_t *start; // State every input starts from
+    uint8_t *coverage;
+    bool own_coverage;
+
+    // The guest reads the input from `port`, one byte per IN (0 once it runs out), while IN
+    // from `port + 1` reads nonzero as long as bytes remain. OUT to `port` ends the run.
+    uint8_t port;
+    // When `capacity` is nonzero, the input is also copied into memory at `address` as a
+    // 16-bit little-endian length followed by up to `capacity - 2` bytes
+    uint16_t address;
+    uint16_t capacity;
+    uint64_t max_cycles; // Budget per input
+
+    // The input being run
+    const uint8_t *input;
+    size_t size;
+    size_t position;
+    fuzz_status_t status;
+
+    uint64_t executions;
+} fuzz_t;
+
+// Prepare to fuzz the machine in its current state. `coverage` is a FUZZ_MAP_SIZE bitmap,
+// such as AFL's shared memory, or NULL to allocate one. Registers the ports and attaches the
+// bitmap to the machine.
+bool fuzz_init(fuzz_t *fuzz, i8080_t *cpu, uint8_t *coverage, uint8_t port, uint64_t max_cycles);
+// Also deliver inputs through memory, see fuzz_t
+bool fuzz_input_region(fuzz_t *fuzz, uint16_t address, uint16_t capacity);
+// Detaches the bitmap and unregisters the ports; the machine is left as the last input left it
+void fuzz_release(fuzz_t *fuzz);
+
+// Reset the machine to the starting snapshot and run it on one input. The bitmap is not
+// cleared in between, which AFL does itself; see fuzz_clear_coverage().
+fuzz_status_t fuzz_run(fuzz_t *fuzz, const uint8_t *input, size_t size);
+
+void fuzz_clear_coverage(fuzz_t *fuzz);
+// Non-zero bytes in the bitmap
+size_t fuzz_edges(const fuzz_t *fuzz);
+
+// Called by the core after each control transfer, with PC at its destination
+static inline void fuzz_edge(i8080_t *cpu){
+    uint16_t location = (uint16_t)(cpu->PC * 0x9E37u); // Odd multiplier, so distinct PCs stay distinct
+    cpu->coverage[location ^ cpu->coverage_previous]++;
+    cpu->coverage_previous = location >> 1;
+}
+
+#endif
+
+#endif //INTEL8080_I8080_FUZZ_H
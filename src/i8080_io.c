@@ -0,0 +1,97 @@
+//
+// Created by leonv on 5/4/2024.
+//
+
+#include "i8080_io.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void io_bus_init(io_bus_t *io){
+    memset(io, 0, sizeof(io_bus_t));
+}
+
+void io_bus_release(io_bus_t *io){
+    io_bus_flush(io);
+    for(int port = 0; port < PORT_COUNT; port++){
+        free(io->ports[port].buffer);
+    }
+    memset(io, 0, sizeof(io_bus_t));
+}
+
+void io_bus_register(io_bus_t *io, uint8_t port, port_in_fn in, port_out_fn out, void *context){
+    io->ports[port].in = in;
+    io->ports[port].out = out;
+    io->ports[port].context = context;
+}
+
+static void flush_port(port_t *p, uint8_t port){
+    if(p->length > 0){
+        p->flush(p->flush_context, port, p->buffer, p->length);
+        p->length = 0;
+    }
+}
+
+bool io_bus_buffer(io_bus_t *io, uint8_t port, port_flush_fn flush, void *context, size_t capacity){
+    port_t *p = &io->ports[port];
+    uint8_t *buffer = NULL;
+
+    if(flush == NULL || capacity == 0){
+        return false;
+    }
+    // Bytes already buffered go to the old handler before the buffer changes
+    if(p->buffer != NULL){
+        flush_port(p, port);
+    }
+    buffer = (uint8_t*)realloc(p->buffer, capacity);
+    if(buffer == NULL){
+        return false;
+    }
+    p->buffer = buffer;
+    p->capacity = capacity;
+    p->length = 0;
+    p->flush = flush;
+    p->flush_context = context;
+    return true;
+}
+
+void io_bus_flush(io_bus_t *io){
+    if(io->pending){
+        for(int port = 0; port < PORT_COUNT; port++){
+            if(io->ports[port].buffer != NULL){
+                flush_port(&io->ports[port], port);
+            }
+        }
+        io->pending = false;
+    }
+}
+
+uint8_t io_bus_in(io_bus_t *io, uint8_t port){
+    port_t *p = &io->ports[port];
+    uint8_t value = 0xFF;
+    // Devices see the OUTs that came before an IN first, so a prompt is out before its reply
+    // is read and status ports reflect everything written so far
+    if(io->pending){
+        io_bus_flush(io);
+    }
+    if(p->in != NULL){
+        value = p->in(p->context, port);
+    }
+    return value;
+}
+
+void io_bus_out(io_bus_t *io, uint8_t port, uint8_t value){
+    port_t *p = &io->ports[port];
+    if(p->buffer != NULL){
+        p->buffer[p->length++] = value;
+        if(p->length == p->capacity){
+            flush_port(p, port);
+        }
+        else{
+            io->pending = true;
+        }
+    }
+    else if(p->out != NULL){
+        p->out(p->context, port, value);
+    }
+}
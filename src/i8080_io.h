@@ -0,0 +1,51 @@
+//
+// Created by leonv on 5/4/2024.
+//
+
+#ifndef INTEL8080_I8080_IO_H
+#define INTEL8080_I8080_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PORT_COUNT 0x100
+
+typedef uint8_t (*port_in_fn)(void *context, uint8_t port);
+typedef void (*port_out_fn)(void *context, uint8_t port, uint8_t value);
+// Receives a batch of bytes written to a buffered port, in the order they were written
+typedef void (*port_flush_fn)(void *context, uint8_t port, const uint8_t *data, size_t length);
+
+typedef struct {
+    port_in_fn in;
+    port_out_fn out;
+    port_flush_fn flush;
+    void *context; // For `in` and `out`
+    void *flush_context;
+
+    // Output buffer, only allocated for buffered ports
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+} port_t;
+
+typedef struct {
+    port_t ports[PORT_COUNT];
+    bool pending; // Some buffered port holds unflushed output
+} io_bus_t;
+
+void io_bus_init(io_bus_t *io);
+void io_bus_release(io_bus_t *io);
+
+// Handlers may be NULL; IN from a port without a handler reads 0xFF and OUT is dropped.
+void io_bus_register(io_bus_t *io, uint8_t port, port_in_fn in, port_out_fn out, void *context);
+// Collect OUT bytes for `port` and deliver them `capacity` at a time. Pending bytes are also
+// delivered by io_bus_flush(), which io_bus_in() calls before every IN and run_cycles() and
+// run_until() call before returning.
+bool io_bus_buffer(io_bus_t *io, uint8_t port, port_flush_fn flush, void *context, size_t capacity);
+void io_bus_flush(io_bus_t *io);
+
+uint8_t io_bus_in(io_bus_t *io, uint8_t port);
+void io_bus_out(io_bus_t *io, uint8_t port, uint8_t value);
+
+#endif //INTEL8080_I8080_IO_H
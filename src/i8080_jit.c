@@ -0,0 +1,714 @@
+//
+// Created by leonv on 5/22/2024.
+//
+
+#include "i8080_jit.h"
+
+#ifdef I8080_JIT
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Worst case for one translated instruction plus the block prologue and epilogue
+#define JIT_MAX_INSTRUCTION 256
+#define JIT_MAX_BLOCK (BLOCK_MAX_INSTRUCTIONS * JIT_MAX_INSTRUCTION + 16)
+#define DISPATCH_SIZE 128 // Bytes at the start of the code cache kept for the dispatcher
+
+// Field offsets for [rbx + disp8] operands. rbx holds the i8080_t pointer throughout and r12
+// the cycle counter, which is only written back to the struct around calls and on exit.
+#define FIELD(name) ((uint8_t)offsetof(i8080_t, name))
+_Static_assert(offsetof(i8080_t, deadline) < 0x80, "register fields must be reachable with an 8-bit displacement");
+
+// 8080 register encoding: B C D E H L (M) A
+static const uint8_t register_field[8] = {
+    FIELD(B), FIELD(C), FIELD(D), FIELD(E), FIELD(H), FIELD(L), 0, FIELD(A)
+};
+
+// Register pairs in LXI/INX/DCX/DAD encoding: BC DE HL SP
+static const uint8_t pair_field[4] = { FIELD(BC), FIELD(DE), FIELD(HL), FIELD(SP) };
+
+// Flag tested by each Jcc condition, taken when set for the odd conditions: NZ Z NC C PO PE P M
+static const uint8_t condition_flag[8] = {
+    FLAG_Z, FLAG_Z, FLAG_CY, FLAG_CY, FLAG_P, FLAG_P, FLAG_S, FLAG_S
+};
+
+typedef struct {
+    uint8_t *at;
+    const uint8_t *dispatch; // See emit_dispatcher()
+    uint8_t fallbacks; // Instructions left to step_instruction()
+} emitter_t;
+
+static void emit(emitter_t *out, const uint8_t *bytes, size_t count){
+    memcpy(out->at, bytes, count);
+    out->at += count;
+}
+
+#define EMIT(out, ...) do{ const uint8_t bytes_[] = { __VA_ARGS__ }; emit(out, bytes_, sizeof(bytes_)); }while(0)
+
+static void emit16(emitter_t *out, uint16_t value){
+    EMIT(out, LOW_BYTE(value), HIGH_BYTE(value));
+}
+
+static void emit32(emitter_t *out, uint32_t value){
+    emit16(out, value & 0xFFFF);
+    emit16(out, value >> 16);
+}
+
+static void emit_call(emitter_t *out, const void *function){
+    uint64_t address = (uint64_t)(uintptr_t)function;
+    EMIT(out, 0x48, 0xB8); // mov rax, imm64
+    emit32(out, address & 0xFFFFFFFF);
+    emit32(out, address >> 32);
+    EMIT(out, 0xFF, 0xD0); // call rax
+}
+
+static void emit_cpu_argument(emitter_t *out){
+    EMIT(out, 0x48, 0x89, 0xDF); // mov rdi, rbx
+}
+
+static void emit_store_cycles(emitter_t *out){
+    EMIT(out, 0x4C, 0x89, 0x63, FIELD(cycles)); // mov [rbx + cycles], r12
+}
+
+static void emit_load_cycles(emitter_t *out){
+    EMIT(out, 0x4C, 0x8B, 0x63, FIELD(cycles)); // mov r12, [rbx + cycles]
+}
+
+#define EXIT_SIZE 12
+
+static void emit_exit(emitter_t *out){
+    emit_store_cycles(out);
+    EMIT(out, 0x48, 0x83, 0xC4, 0x08); // add rsp, 8
+    EMIT(out, 0x41, 0x5C, 0x5B, 0xC3); // pop r12; pop rbx; ret
+}
+
+static void emit_check(emitter_t *out){
+    EMIT(out, 0x4C, 0x3B, 0x63, FIELD(deadline)); // cmp r12, [rbx + deadline]
+    EMIT(out, 0x72, EXIT_SIZE); // jb over the exit
+    emit_exit(out);
+}
+
+static void emit_jump(emitter_t *out, const uint8_t *target){
+    EMIT(out, 0xE9); // jmp rel32
+    emit32(out, (uint32_t)(target - (out->at + 4)));
+}
+
+// Goes on with the block at PC if the slice does, without returning to execute_blocks()
+static void emit_leave(emitter_t *out){
+    emit_check(out);
+    emit_jump(out, out->dispatch);
+}
+
+#define LEAVE_SIZE (6 + EXIT_SIZE + 5)
+
+// Leaves the block at `target` after an instruction of `cycles`
+static void emit_branch(emitter_t *out, uint16_t target, uint8_t cycles){
+    EMIT(out, 0x66, 0xC7, 0x43, FIELD(PC)); // mov word [rbx + PC], target
+    emit16(out, target);
+    EMIT(out, 0x49, 0x83, 0xC4, cycles); // add r12, cycles
+    emit_leave(out);
+}
+
+#define BRANCH_SIZE (10 + LEAVE_SIZE)
+
+// Forward jz/jnz with a 32-bit displacement, for skipping more than a short jump reaches.
+// Returns where the displacement ends, to be handed to emit_label().
+static uint8_t *emit_forward(emitter_t *out, uint8_t condition){
+    EMIT(out, 0x0F, condition, 0, 0, 0, 0);
+    return out->at;
+}
+
+static void emit_label(emitter_t *out, uint8_t *jump){
+    uint32_t distance = (uint32_t)(out->at - jump);
+    memcpy(jump - 4, &distance, 4);
+}
+
+// PC of the next instruction, the instruction's cycles, then stop if the slice is over
+static void emit_finish(emitter_t *out, uint16_t next, uint8_t cycles){
+    EMIT(out, 0x66, 0xC7, 0x43, FIELD(PC)); // mov word [rbx + PC], next
+    emit16(out, next);
+    EMIT(out, 0x49, 0x83, 0xC4, cycles); // add r12, cycles
+    emit_check(out);
+}
+
+// eax = address held in pair (BC, DE or HL) or, for pair == 0xFF, `address`
+static void emit_address(emitter_t *out, uint8_t pair, uint16_t address){
+    if(pair != 0xFF){
+        EMIT(out, 0x0F, 0xB7, 0x43, pair); // movzx eax, word [rbx + pair]
+    }
+    else{
+        EMIT(out, 0xB8); // mov eax, imm32
+        emit32(out, address);
+    }
+    EMIT(out, 0x89, 0xC1); // mov ecx, eax
+    EMIT(out, 0xC1, 0xE9, 0x08); // shr ecx, 8
+}
+
+#define READ_SLOW_SIZE 24
+#define WRITE_SLOW_SIZE 21
+
+// esi = byte at the address, straight from the page table when the page has a read pointer
+static void emit_read(emitter_t *out, uint8_t pair, uint16_t address){
+    emit_address(out, pair, address);
+    EMIT(out, 0x48, 0x8B, 0x94, 0xCB); // mov rdx, [rbx + rcx * 8 + map.read]
+    emit32(out, (uint32_t)offsetof(i8080_t, map.read));
+    EMIT(out, 0x48, 0x85, 0xD2); // test rdx, rdx
+    EMIT(out, 0x74, 9); // jz slow
+    EMIT(out, 0x0F, 0xB6, 0xC0); // movzx eax, al
+    EMIT(out, 0x0F, 0xB6, 0x34, 0x02); // movzx esi, byte [rdx + rax]
+    EMIT(out, 0xEB, READ_SLOW_SIZE); // jmp done
+    // slow: MMIO handlers may look at the clock
+    emit_store_cycles(out);
+    emit_cpu_argument(out);
+    EMIT(out, 0x89, 0xC6); // mov esi, eax
+    emit_call(out, (const void*)read_memory);
+    EMIT(out, 0x0F, 0xB6, 0xF0); // movzx esi, al
+}
+
+// Stores the value in edx, which the caller has loaded. Pages without a write pointer (ROM,
+// MMIO, shared or holding cached code) go through write_memory().
+static void emit_write(emitter_t *out, uint8_t pair, uint16_t address){
+    emit_address(out, pair, address);
+    EMIT(out, 0x48, 0x8B, 0x8C, 0xCB); // mov rcx, [rbx + rcx * 8 + map.write]
+    emit32(out, (uint32_t)offsetof(i8080_t, map.write));
+    EMIT(out, 0x48, 0x85, 0xC9); // test rcx, rcx
+    EMIT(out, 0x74, 8); // jz slow
+    EMIT(out, 0x0F, 0xB6, 0xC0); // movzx eax, al
+    EMIT(out, 0x88, 0x14, 0x01); // mov [rcx + rax], dl
+    EMIT(out, 0xEB, WRITE_SLOW_SIZE); // jmp done
+    emit_store_cycles(out);
+    emit_cpu_argument(out);
+    EMIT(out, 0x89, 0xC6); // mov esi, eax
+    emit_call(out, (const void*)write_memory);
+}
+
+// Stores edx at --SP, as PUSH() does one byte at a time
+static void emit_push_byte(emitter_t *out){
+    EMIT(out, 0x66, 0xFF, 0x4B, FIELD(SP)); // dec word [rbx + SP]
+    emit_write(out, FIELD(SP), 0);
+}
+
+static void emit_push_fields(emitter_t *out, uint8_t high, uint8_t low){
+    EMIT(out, 0x0F, 0xB6, 0x53, high); // movzx edx, byte [rbx + high]
+    emit_push_byte(out);
+    EMIT(out, 0x0F, 0xB6, 0x53, low); // movzx edx, byte [rbx + low]
+    emit_push_byte(out);
+}
+
+static void emit_push_word(emitter_t *out, uint16_t value){
+    EMIT(out, 0xBA); // mov edx, imm32
+    emit32(out, HIGH_BYTE(value));
+    emit_push_byte(out);
+    EMIT(out, 0xBA);
+    emit32(out, LOW_BYTE(value));
+    emit_push_byte(out);
+}
+
+// esi = byte at SP++
+static void emit_pop_byte(emitter_t *out){
+    emit_read(out, FIELD(SP), 0);
+    EMIT(out, 0x66, 0xFF, 0x43, FIELD(SP)); // inc word [rbx + SP]
+}
+
+static void emit_pop_fields(emitter_t *out, uint8_t high, uint8_t low){
+    emit_pop_byte(out);
+    EMIT(out, 0x40, 0x88, 0x73, low); // mov [rbx + low], sil
+    emit_pop_byte(out);
+    EMIT(out, 0x40, 0x88, 0x73, high); // mov [rbx + high], sil
+}
+
+// Brings F up to date before generated code reads it directly. Emits nothing without lazy flags.
+static void emit_sync_flags(emitter_t *out){
+#ifdef I8080_LAZY_FLAGS
+    EMIT(out, 0x80, 0x7B, FIELD(flag_op), FLAGS_CLEAN); // cmp byte [rbx + flag_op], FLAGS_CLEAN
+    EMIT(out, 0x74, 15); // je past the call
+    emit_cpu_argument(out);
+    emit_call(out, (const void*)materialize_flags);
+#else
+    (void)out;
+#endif
+}
+
+// eax holds `flag` (Z, CY, S or P) at its bit position in F. With lazy flags Z, CY and S come
+// straight from a pending result, as GET_Z() and friends do, so conditional jumps and
+// ADC/SBB do not have to fold the whole PSW first.
+static void emit_flag(emitter_t *out, uint8_t flag){
+#ifdef I8080_LAZY_FLAGS
+    if(flag != FLAG_P){
+        uint8_t skip = flag == FLAG_Z ? 12 : flag == FLAG_CY ? 7 : 4;
+        EMIT(out, 0x80, 0x7B, FIELD(flag_op), FLAGS_CLEAN); // cmp byte [rbx + flag_op], FLAGS_CLEAN
+        EMIT(out, 0x0F, 0xB6, 0x43, FIELD(F)); // movzx eax, byte [rbx + F]
+        EMIT(out, 0x74, skip); // je past the pending result
+        EMIT(out, 0x0F, 0xB7, 0x43, FIELD(flag_result)); // movzx eax, word [rbx + flag_result]
+        if(flag == FLAG_Z){
+            EMIT(out, 0x84, 0xC0); // test al, al
+            EMIT(out, 0x0F, 0x94, 0xC0); // sete al
+            EMIT(out, 0xC0, 0xE0, 6); // shl al, 6
+        }
+        else if(flag == FLAG_CY){
+            EMIT(out, 0xC1, 0xE8, 8); // shr eax, 8
+        }
+        return;
+    }
+#else
+    (void)flag;
+#endif
+    emit_sync_flags(out);
+    EMIT(out, 0x0F, 0xB6, 0x43, FIELD(F)); // movzx eax, byte [rbx + F]
+}
+
+// Turns the host's flags, taken into ah with lahf, into F. x86 keeps S, Z, AC, P and CY in the
+// same bits as the 8080, with bit 1 set and bits 3 and 5 clear. Only the bits in `keep` are
+// kept, and those in `flip` are the ones the 8080 sets the other way round (AC after a
+// subtraction).
+static void emit_fix_flags(emitter_t *out, uint8_t keep, uint8_t flip){
+    if(keep != 0xFF){
+        EMIT(out, 0x80, 0xE4, keep); // and ah, keep
+    }
+    if(flip != 0){
+        EMIT(out, 0x80, 0xF4, flip); // xor ah, flip
+    }
+}
+
+static void emit_store_flags(emitter_t *out){
+    EMIT(out, 0x88, 0x63, FIELD(F)); // mov [rbx + F], ah
+#ifdef I8080_LAZY_FLAGS
+    EMIT(out, 0xC6, 0x43, FIELD(flag_op), FLAGS_CLEAN); // mov byte [rbx + flag_op], FLAGS_CLEAN
+#endif
+}
+
+// ADD ADC SUB SBB ANA XRA ORA CMP with the operand in esi, run on the host ALU so that its
+// flags give F directly
+static void emit_alu(emitter_t *out, uint8_t operation){
+    // Host opcodes of `op al, sil` in 8080 order
+    static const uint8_t host_operation[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38 };
+
+    if(operation == 1 || operation == 3){
+        emit_flag(out, FLAG_CY);
+        EMIT(out, 0x0F, 0xBA, 0xE0, 0x00); // bt eax, 0: carry in
+    }
+    else if(operation == 4){
+        // ANA sets AC from bit 3 of either operand
+        EMIT(out, 0x8A, 0x4B, FIELD(A)); // mov cl, [rbx + A]
+        EMIT(out, 0x40, 0x08, 0xF1); // or cl, sil
+        EMIT(out, 0x80, 0xE1, 0x08); // and cl, 0x08
+        EMIT(out, 0x00, 0xC9); // add cl, cl
+    }
+    EMIT(out, 0x8A, 0x43, FIELD(A)); // mov al, [rbx + A]
+    EMIT(out, 0x40, host_operation[operation], 0xF0); // op al, sil
+    EMIT(out, 0x9F); // lahf
+    if(operation != 7){
+        EMIT(out, 0x88, 0x43, FIELD(A)); // mov [rbx + A], al
+    }
+    switch(operation){
+        case 0: case 1: // ADD, ADC
+            break;
+        case 2: case 3: case 7: // SUB, SBB, CMP: AC is set when bit 3 did not borrow
+            emit_fix_flags(out, 0xFF, FLAG_AC);
+            break;
+        case 4: // ANA
+            emit_fix_flags(out, (uint8_t)~FLAG_AC, 0);
+            EMIT(out, 0x08, 0xCC); // or ah, cl
+            break;
+        default: // XRA, ORA clear AC and CY; the host already cleared CY
+            emit_fix_flags(out, (uint8_t)~FLAG_AC, 0);
+            break;
+    }
+    emit_store_flags(out);
+}
+
+// INR and DCR of the byte in sil. The host's inc and dec leave its carry alone as the 8080's do,
+// but that is the host's carry, so CY is put back from F.
+static void emit_increment(emitter_t *out, bool decrement){
+    emit_flag(out, FLAG_CY);
+    EMIT(out, 0x89, 0xC1); // mov ecx, eax
+    EMIT(out, 0x80, 0xE1, FLAG_CY); // and cl, FLAG_CY
+    EMIT(out, 0x40, 0xFE, decrement ? 0xCE : 0xC6); // inc sil / dec sil
+    EMIT(out, 0x9F); // lahf
+    // DCR sets AC unless the low digit borrowed
+    emit_fix_flags(out, (uint8_t)~FLAG_CY, decrement ? FLAG_AC : 0);
+    EMIT(out, 0x08, 0xCC); // or ah, cl
+    emit_store_flags(out);
+}
+
+// RLC RRC RAL RAR, as the host's rol ror rcl rcr, which like them only touch the carry
+static void emit_rotate(emitter_t *out, uint8_t kind){
+    emit_sync_flags(out);
+    if(kind >= 2){
+        EMIT(out, 0x0F, 0xB6, 0x43, FIELD(F)); // movzx eax, byte [rbx + F]
+        EMIT(out, 0x0F, 0xBA, 0xE0, 0x00); // bt eax, 0: carry in
+    }
+    EMIT(out, 0xD0, 0x43 | (kind << 3), FIELD(A)); // rol/ror/rcl/rcr byte [rbx + A], 1
+    EMIT(out, 0x0F, 0x92, 0xC0); // setc al
+    EMIT(out, 0x80, 0x63, FIELD(F), (uint8_t)~FLAG_CY); // and byte [rbx + F], ~FLAG_CY
+    EMIT(out, 0x08, 0x43, FIELD(F)); // or [rbx + F], al
+}
+
+static void emit_step(emitter_t *out){
+    out->fallbacks++;
+    emit_store_cycles(out);
+    emit_cpu_argument(out);
+    emit_call(out, (const void*)step_instruction);
+    emit_load_cycles(out);
+    emit_check(out);
+}
+
+// Translates one instruction. Returns false once the block has ended.
+static bool translate(emitter_t *out, const decoded_t *instruction, uint16_t pc){
+    uint8_t opcode = instruction->opcode;
+    uint16_t operand = instruction->operand;
+    uint8_t destination = (opcode >> 3) & 0x07;
+    uint8_t source = opcode & 0x07;
+    uint8_t pair = (opcode >> 4) & 0x03;
+
+    if(opcode >= 0x40 && opcode < 0x80 && opcode != 0x76){ // MOV
+        if(source == 6){
+            emit_read(out, FIELD(HL), 0);
+            EMIT(out, 0x40, 0x88, 0x73, register_field[destination]); // mov [rbx + r], sil
+            emit_finish(out, pc + 1, 7);
+        }
+        else if(destination == 6){
+            EMIT(out, 0x0F, 0xB6, 0x53, register_field[source]); // movzx edx, byte [rbx + r]
+            emit_write(out, FIELD(HL), 0);
+            emit_finish(out, pc + 1, 7);
+        }
+        else{
+            EMIT(out, 0x0F, 0xB6, 0x43, register_field[source]); // movzx eax, byte [rbx + r]
+            EMIT(out, 0x88, 0x43, register_field[destination]); // mov [rbx + r], al
+            emit_finish(out, pc + 1, 5);
+        }
+        return true;
+    }
+    if(opcode >= 0x80 && opcode < 0xC0){ // ALU with register or M
+        if(source == 6){
+            emit_read(out, FIELD(HL), 0);
+        }
+        else{
+            EMIT(out, 0x0F, 0xB6, 0x73, register_field[source]); // movzx esi, byte [rbx + r]
+        }
+        emit_alu(out, destination);
+        emit_finish(out, pc + 1, source == 6 ? 7 : 4);
+        return true;
+    }
+    if(opcode >= 0xC0 && source == 6){ // ALU immediate
+        EMIT(out, 0xBE);
+        emit32(out, operand & 0xFF);
+        emit_alu(out, destination);
+        emit_finish(out, pc + 2, 7);
+        return true;
+    }
+    if(opcode >= 0xC0 && (source == 0 || source == 4)){ // Rcc, Ccc
+        uint8_t *not_taken;
+        emit_flag(out, condition_flag[destination]);
+        EMIT(out, 0xA8, condition_flag[destination]); // test al, flag
+        not_taken = emit_forward(out, (destination & 1) ? 0x84 : 0x85); // jz / jnz
+        if(source == 0){
+            emit_pop_fields(out, FIELD(PC) + 1, FIELD(PC));
+            EMIT(out, 0x49, 0x83, 0xC4, 11); // add r12, 11
+            emit_leave(out);
+            emit_label(out, not_taken);
+            emit_branch(out, pc + 1, 5);
+        }
+        else{
+            emit_push_word(out, pc + 3);
+            emit_branch(out, operand, 17);
+            emit_label(out, not_taken);
+            emit_branch(out, pc + 3, 11);
+        }
+        return false;
+    }
+    if(opcode >= 0xC0 && (source == 1 || source == 5) && (destination & 1) == 0){ // POP, PUSH
+        uint8_t high = pair < 3 ? register_field[pair * 2] : FIELD(A);
+        uint8_t low = pair < 3 ? register_field[pair * 2 + 1] : FIELD(F);
+        if(source == 5){
+            if(pair == 3){
+                emit_sync_flags(out);
+            }
+            emit_push_fields(out, high, low);
+            emit_finish(out, pc + 1, 11);
+        }
+        else if(pair < 3){
+            emit_pop_fields(out, high, low);
+            emit_finish(out, pc + 1, 10);
+        }
+        else{ // POP PSW keeps the bits of F that always read the same
+            emit_pop_byte(out);
+            EMIT(out, 0x81, 0xE6); // and esi, FLAG_MASK
+            emit32(out, FLAG_MASK);
+            EMIT(out, 0x83, 0xCE, FLAG_ALWAYS); // or esi, FLAG_ALWAYS
+            EMIT(out, 0x40, 0x88, 0x73, FIELD(F)); // mov [rbx + F], sil
+#ifdef I8080_LAZY_FLAGS
+            EMIT(out, 0xC6, 0x43, FIELD(flag_op), FLAGS_CLEAN); // mov byte [rbx + flag_op], FLAGS_CLEAN
+#endif
+            emit_pop_byte(out);
+            EMIT(out, 0x40, 0x88, 0x73, FIELD(A)); // mov [rbx + A], sil
+            emit_finish(out, pc + 1, 10);
+        }
+        return true;
+    }
+    if(opcode >= 0xC0 && source == 7){ // RST
+        emit_push_word(out, pc + 1);
+        emit_branch(out, opcode & 0x38, 11);
+        return false;
+    }
+    if(opcode < 0x40){
+        switch(opcode & 0x0F){
+            case 0x01: // LXI
+                EMIT(out, 0x66, 0xC7, 0x43, pair_field[pair]);
+                emit16(out, operand);
+                emit_finish(out, pc + 3, 10);
+                return true;
+            case 0x03: // INX
+                EMIT(out, 0x66, 0xFF, 0x43, pair_field[pair]); // inc word [rbx + pair]
+                emit_finish(out, pc + 1, 5);
+                return true;
+            case 0x0B: // DCX
+                EMIT(out, 0x66, 0xFF, 0x4B, pair_field[pair]); // dec word [rbx + pair]
+                emit_finish(out, pc + 1, 5);
+                return true;
+            case 0x09: // DAD
+                EMIT(out, 0x0F, 0xB7, 0x73, pair_field[pair]);
+                emit_cpu_argument(out);
+                emit_call(out, (const void*)DAD);
+                emit_finish(out, pc + 1, 10);
+                return true;
+            default:
+                break;
+        }
+        if(source == 6 && destination != 6){ // MVI r
+            EMIT(out, 0xC6, 0x43, register_field[destination], operand & 0xFF);
+            emit_finish(out, pc + 2, 7);
+            return true;
+        }
+        if(source == 4 || source == 5){ // INR, DCR
+            if(destination == 6){
+                emit_read(out, FIELD(HL), 0);
+                emit_increment(out, source == 5);
+                EMIT(out, 0x89, 0xF2); // mov edx, esi
+                emit_write(out, FIELD(HL), 0);
+                emit_finish(out, pc + 1, 10);
+            }
+            else{
+                EMIT(out, 0x0F, 0xB6, 0x73, register_field[destination]); // movzx esi, byte [rbx + r]
+                emit_increment(out, source == 5);
+                EMIT(out, 0x40, 0x88, 0x73, register_field[destination]); // mov [rbx + r], sil
+                emit_finish(out, pc + 1, 5);
+            }
+            return true;
+        }
+        if((opcode & 0x07) == 0){ // NOP and its aliases
+            emit_finish(out, pc + 1, 4);
+            return true;
+        }
+    }
+    switch(opcode){
+        case 0x36: // MVI M
+            EMIT(out, 0xBA); // mov edx, imm32
+            emit32(out, operand & 0xFF);
+            emit_write(out, FIELD(HL), 0);
+            emit_finish(out, pc + 2, 10);
+            return true;
+        case 0x0A: case 0x1A: // LDAX
+            emit_read(out, opcode == 0x0A ? FIELD(BC) : FIELD(DE), 0);
+            EMIT(out, 0x40, 0x88, 0x73, FIELD(A));
+            emit_finish(out, pc + 1, 7);
+            return true;
+        case 0x02: case 0x12: // STAX
+            EMIT(out, 0x0F, 0xB6, 0x53, FIELD(A));
+            emit_write(out, opcode == 0x02 ? FIELD(BC) : FIELD(DE), 0);
+            emit_finish(out, pc + 1, 7);
+            return true;
+        case 0x3A: // LDA
+            emit_read(out, 0xFF, operand);
+            EMIT(out, 0x40, 0x88, 0x73, FIELD(A));
+            emit_finish(out, pc + 3, 13);
+            return true;
+        case 0x32: // STA
+            EMIT(out, 0x0F, 0xB6, 0x53, FIELD(A));
+            emit_write(out, 0xFF, operand);
+            emit_finish(out, pc + 3, 13);
+            return true;
+        case 0x07: case 0x0F: case 0x17: case 0x1F: // RLC RRC RAL RAR
+            emit_rotate(out, opcode >> 3);
+            emit_finish(out, pc + 1, 4);
+            return true;
+        case 0x2F: // CMA
+            EMIT(out, 0xF6, 0x53, FIELD(A)); // not byte [rbx + A]
+            emit_finish(out, pc + 1, 4);
+            return true;
+        case 0x37: case 0x3F: // STC, CMC
+            emit_sync_flags(out);
+            EMIT(out, 0x80, opcode == 0x37 ? 0x4B : 0x73, FIELD(F), FLAG_CY); // or/xor byte [rbx + F], FLAG_CY
+            emit_finish(out, pc + 1, 4);
+            return true;
+        case 0x27: // DAA
+            emit_cpu_argument(out);
+            emit_call(out, (const void*)DAA);
+            emit_finish(out, pc + 1, 4);
+            return true;
+        case 0xC3: case 0xCB: // JMP
+            emit_branch(out, operand, 10);
+            return false;
+        case 0xCD: case 0xDD: case 0xED: case 0xFD: // CALL
+            emit_push_word(out, pc + 3);
+            emit_branch(out, operand, 17);
+            return false;
+        case 0xC9: case 0xD9: // RET
+            emit_pop_fields(out, FIELD(PC) + 1, FIELD(PC));
+            EMIT(out, 0x49, 0x83, 0xC4, 10); // add r12, 10
+            emit_leave(out);
+            return false;
+        case 0xE9: // PCHL
+            EMIT(out, 0x0F, 0xB7, 0x43, FIELD(HL)); // movzx eax, word [rbx + HL]
+            EMIT(out, 0x66, 0x89, 0x43, FIELD(PC)); // mov [rbx + PC], ax
+            EMIT(out, 0x49, 0x83, 0xC4, 5); // add r12, 5
+            emit_leave(out);
+            return false;
+        case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xE2: case 0xEA: case 0xF2: case 0xFA: // Jcc
+            emit_flag(out, condition_flag[destination]);
+            EMIT(out, 0xA8, condition_flag[destination]); // test al, flag
+            // Skip the taken path when the condition does not hold
+            EMIT(out, (destination & 1) ? 0x74 : 0x75, BRANCH_SIZE); // jz / jnz
+            emit_branch(out, operand, 10);
+            emit_branch(out, pc + 3, 10);
+            return false;
+        default:
+            emit_step(out);
+            return true;
+    }
+}
+
+#define PROLOGUE_SIZE 14
+
+// Entry point of a translation, called as void (*)(i8080_t*)
+static void emit_prologue(emitter_t *out){
+    EMIT(out, 0x53, 0x41, 0x54); // push rbx; push r12
+    EMIT(out, 0x48, 0x83, 0xEC, 0x08); // sub rsp, 8 to align the stack for calls
+    EMIT(out, 0x48, 0x89, 0xFB); // mov rbx, rdi
+    emit_load_cycles(out);
+}
+
+// Translated blocks end by jumping here with PC and r12 up to date and the slice not over. It
+// jumps past the prologue of the translation of the block cached at PC, as block_lookup() and
+// jit_run() would have found it, or returns to execute_blocks() if there is none.
+static void emit_dispatcher(emitter_t *out, block_cache_t *cache){
+    uint8_t *no_block, *no_translation;
+    EMIT(out, 0x0F, 0xB7, 0x43, FIELD(PC)); // movzx eax, word [rbx + PC]
+    EMIT(out, 0x48, 0xB9); // mov rcx, imm64
+    emit32(out, (uint32_t)(uintptr_t)cache->entry);
+    emit32(out, (uint32_t)((uint64_t)(uintptr_t)cache->entry >> 32));
+    EMIT(out, 0x0F, 0xB7, 0x04, 0x41); // movzx eax, word [rcx + rax * 2]
+    EMIT(out, 0x85, 0xC0); // test eax, eax
+    no_block = emit_forward(out, 0x84); // jz
+    EMIT(out, 0x69, 0xC0); // imul eax, eax, sizeof(block_t)
+    emit32(out, sizeof(block_t));
+    EMIT(out, 0x48, 0xB9); // mov rcx, imm64: entries count from 1
+    emit32(out, (uint32_t)((uintptr_t)cache->blocks - sizeof(block_t)));
+    emit32(out, (uint32_t)((uint64_t)((uintptr_t)cache->blocks - sizeof(block_t)) >> 32));
+    EMIT(out, 0x48, 0x01, 0xC1); // add rcx, rax
+    EMIT(out, 0x48, 0x8B, 0x41, (uint8_t)offsetof(block_t, native)); // mov rax, [rcx + native]
+    EMIT(out, 0x48, 0x85, 0xC0); // test rax, rax
+    no_translation = emit_forward(out, 0x84); // jz
+    EMIT(out, 0x48, 0xBA); // mov rdx, imm64
+    emit32(out, (uint32_t)(uintptr_t)&cache->running);
+    emit32(out, (uint32_t)((uint64_t)(uintptr_t)&cache->running >> 32));
+    EMIT(out, 0x48, 0x89, 0x0A); // mov [rdx], rcx: it is the running block now
+    EMIT(out, 0x48, 0x83, 0xC0, PROLOGUE_SIZE); // add rax, PROLOGUE_SIZE
+    EMIT(out, 0xFF, 0xE0); // jmp rax
+    emit_label(out, no_block);
+    emit_label(out, no_translation);
+    emit_exit(out);
+}
+
+// The code cache is never writable and executable at once: the pages a block is emitted into
+// are made writable for the translation and executable again before it runs
+static bool jit_protect(block_cache_t *cache, size_t from, size_t to, int protection){
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = from & ~(page - 1);
+    size_t end = (to + page - 1) & ~(page - 1);
+    return mprotect(cache->jit_code + start, end - start, protection) == 0;
+}
+
+bool jit_init(block_cache_t *cache){
+    void *code = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    emitter_t out;
+
+    cache->jit_code = code != MAP_FAILED ? (uint8_t*)code : NULL;
+    cache->jit_used = DISPATCH_SIZE;
+    cache->jit_full = false;
+    if(cache->jit_code == NULL){
+        return false;
+    }
+    out.at = cache->jit_code;
+    emit_dispatcher(&out, cache);
+    if(!jit_protect(cache, 0, DISPATCH_SIZE, PROT_READ | PROT_EXEC)){
+        jit_release(cache);
+        return false;
+    }
+    return true;
+}
+
+void jit_release(block_cache_t *cache){
+    if(cache->jit_code != NULL){
+        munmap(cache->jit_code, JIT_CACHE_SIZE);
+        cache->jit_code = NULL;
+    }
+}
+
+void jit_flush(block_cache_t *cache){
+    cache->jit_used = DISPATCH_SIZE;
+    cache->jit_full = false;
+}
+
+bool jit_translate(block_cache_t *cache, block_t *block){
+    emitter_t out;
+    uint16_t pc = block->start;
+    size_t end = cache->jit_used + JIT_MAX_BLOCK;
+    bool open = true;
+    uint8_t i;
+
+    if(cache->jit_code == NULL){
+        return false;
+    }
+    if(cache->rewrites[PAGE_OF(block->start)] > JIT_REWRITE_LIMIT ||
+       cache->rewrites[PAGE_OF(block->start + block->size - 1)] > JIT_REWRITE_LIMIT){
+        return false;
+    }
+    if(end > JIT_CACHE_SIZE){
+        cache->jit_full = true;
+        return false;
+    }
+    if(!jit_protect(cache, cache->jit_used, end, PROT_READ | PROT_WRITE)){
+        return false;
+    }
+    out.at = cache->jit_code + cache->jit_used;
+    out.dispatch = cache->jit_code;
+    out.fallbacks = 0;
+    emit_prologue(&out);
+    for(i = 0; open && i < block->count; i++){
+        open = translate(&out, &block->code[i], pc);
+        pc += instruction_length[block->code[i].opcode];
+    }
+    if(open){
+        emit_jump(&out, out.dispatch); // The block ran out without a jump; PC is stored and checked
+    }
+
+    if(!jit_protect(cache, cache->jit_used, end, PROT_READ | PROT_EXEC)){
+        // Blocks translated earlier may share the first page; none of them can run now
+        flush_block_cache(cache->cpu);
+        return false;
+    }
+    // A block that mostly calls back into the interpreter runs faster without the detour;
+    // its space is reused by the next translation
+    if(out.fallbacks * 2 > i){
+        return false;
+    }
+    block->native = (void (*)(i8080_t*))(cache->jit_code + cache->jit_used);
+    cache->jit_used = (size_t)(out.at - cache->jit_code + 15) & ~(size_t)15;
+    cache->translated++;
+    return true;
+}
+
+#endif
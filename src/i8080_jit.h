@@ -0,0 +1,67 @@
+//
+// Created by leonv on 5/22/2024.
+//
+
+#ifndef INTEL8080_I8080_JIT_H
+#define INTEL8080_I8080_JIT_H
+
+#include "i8080_block.h"
+
+#ifdef I8080_JIT
+
+#ifndef JIT_THRESHOLD
+#define JIT_THRESHOLD 16 // Executions of a block before it is translated
+#endif
+#define JIT_REWRITE_LIMIT 2 // Times a page's code may be rewritten before its blocks are no longer translated
+#define JIT_CACHE_SIZE 0x100000 // Bytes of executable memory per machine
+
+// Translated blocks keep every register in the i8080_t, so they can stop after any
+// instruction: each one stores PC, adds its cycles and returns once the deadline is reached,
+// exactly where the interpreter would stop. Register moves, loads and stores, 8-bit and 16-bit
+// arithmetic, the stack, jumps, calls and returns are emitted inline, with F taken from the
+// host's flags; DAD and DAA call the interpreter's helpers and anything else runs through
+// step_instruction(). Blocks where that would be most instructions are not translated, and
+// neither is code that keeps being rewritten: translating it would not pay off before the
+// next write drops it.
+
+bool jit_init(block_cache_t *cache);
+void jit_release(block_cache_t *cache);
+// Called when the block cache is flushed; every translation is dropped with the blocks
+void jit_flush(block_cache_t *cache);
+bool jit_translate(block_cache_t *cache, block_t *block);
+
+// One instruction through the interpreter core, keeping the running slice's deadline
+void step_instruction(i8080_t *cpu);
+
+// Runs the block natively if it is (or has just become) hot. Returns false when the caller
+// should interpret it instead. Translated code does not report its instructions, so a machine
+// with a profile, trace or coverage map attached is always interpreted and every instruction
+// and control transfer is seen.
+static inline bool jit_run(i8080_t *cpu, block_t *block){
+#ifdef I8080_PROFILE
+    if(cpu->profile != NULL){
+        return false;
+    }
+#endif
+#ifdef I8080_TRACE
+    if(cpu->trace != NULL){
+        return false;
+    }
+#endif
+#ifdef I8080_FUZZ
+    if(cpu->coverage != NULL){
+        return false;
+    }
+#endif
+    if(block->native == NULL && (++block->executions != JIT_THRESHOLD || !jit_translate(cpu->blocks, block))){
+        return false;
+    }
+    block->native(cpu);
+    return true;
+}
+
+#else
+#define jit_run(cpu, block) false
+#endif
+
+#endif //INTEL8080_I8080_JIT_H
@@ -0,0 +1,943 @@
+//
+// Created by leonv on 5/27/2024.
+//
+
+#include "i8080_lockstep.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Kernels are written once against lane_t. With GCC and Clang it is a 32-byte AVX2 vector
+// when enabled (I8080_AVX2), otherwise a 16-byte SSE2 or NEON one; elsewhere it is a single
+// byte and the kernels run per lane. Wider elements are split into bytes rather than held in
+// wider vectors, which compilers lower to code a lane at a time once they outgrow a register.
+#if defined(__GNUC__) || defined(__clang__)
+#ifdef __AVX2__
+#define LANES 32
+#else
+#define LANES 16
+#endif
+typedef uint8_t lane_t __attribute__((vector_size(LANES)));
+#define LANE_EQ(a, b) ((lane_t)((a) == (b)))
+#define LANE_LT(a, b) ((lane_t)((a) < (b)))
+#else
+typedef uint8_t lane_t;
+#define LANES 1
+#define LANE_EQ(a, b) ((lane_t)-((a) == (b)))
+#define LANE_LT(a, b) ((lane_t)-((a) < (b)))
+#endif
+
+#define REG_M 6
+#define REG_A 7
+
+// Vector step kinds, one per family of instructions the kernels handle
+enum {
+    STEP_SCALAR,
+    STEP_NOP,
+    STEP_MOV,
+    STEP_MVI,
+    STEP_INR,
+    STEP_DCR,
+    STEP_ALU,
+    STEP_ALU_IMMEDIATE,
+    STEP_INX,
+    STEP_DCX,
+    STEP_LXI,
+    STEP_JMP,
+    STEP_JCC,
+    STEP_ROTATE,
+    STEP_CMA,
+    STEP_STC,
+    STEP_CMC,
+    STEP_DAD,
+    STEP_DAA,
+    STEP_XCHG,
+    // Memory steps, whose accesses go through each lane's page table
+    STEP_LOAD, // MOV r,M LDAX LDA
+    STEP_STORE, // MOV M,r STAX STA MVI M
+    STEP_ALU_MEMORY,
+    STEP_INR_MEMORY,
+    STEP_DCR_MEMORY,
+    STEP_PUSH,
+    STEP_POP,
+    STEP_CALL, // CALL Ccc
+    STEP_RET, // RET Rcc
+};
+
+typedef struct {
+    uint8_t kind;
+    uint8_t length;
+    uint8_t cycles; // Those of a conditional instruction when the condition does not hold
+    uint8_t taken; // Cycles when it does, 0 for unconditional instructions
+} step_t;
+
+// Timings of an instruction, and of a conditional one that takes `taken_` cycles when it holds
+#define STEP(kind_, length_, cycles_) ((step_t){ .kind = (kind_), .length = (length_), .cycles = (cycles_), .taken = 0 })
+#define CONDITIONAL_STEP(kind_, length_, cycles_, taken_) \
+    ((step_t){ .kind = (kind_), .length = (length_), .cycles = (cycles_), .taken = (taken_) })
+
+// Same timings as the interpreter core
+static step_t classify(uint8_t opcode){
+    uint8_t destination = (opcode >> 3) & 0x07;
+    uint8_t source = opcode & 0x07;
+    switch(opcode >> 6){
+        case 0:
+            switch(source){
+                case 0: return STEP(STEP_NOP, 1, 4);
+                case 1: return (opcode & 0x08) ? STEP(STEP_DAD, 1, 10) : STEP(STEP_LXI, 3, 10);
+                case 3: return STEP((opcode & 0x08) ? STEP_DCX : STEP_INX, 1, 5);
+                case 2:
+                    switch(opcode){
+                        case 0x02: case 0x12: return STEP(STEP_STORE, 1, 7); // STAX
+                        case 0x0A: case 0x1A: return STEP(STEP_LOAD, 1, 7); // LDAX
+                        case 0x32: return STEP(STEP_STORE, 3, 13); // STA
+                        case 0x3A: return STEP(STEP_LOAD, 3, 13); // LDA
+                        default: return STEP(STEP_SCALAR, 1, 0); // SHLD LHLD
+                    }
+                case 4: return destination == REG_M ? STEP(STEP_INR_MEMORY, 1, 10) : STEP(STEP_INR, 1, 5);
+                case 5: return destination == REG_M ? STEP(STEP_DCR_MEMORY, 1, 10) : STEP(STEP_DCR, 1, 5);
+                case 6: return destination == REG_M ? STEP(STEP_STORE, 2, 10) : STEP(STEP_MVI, 2, 7);
+                case 7:
+                    if(destination < 4){
+                        return STEP(STEP_ROTATE, 1, 4);
+                    }
+                    if(opcode == 0x2F){
+                        return STEP(STEP_CMA, 1, 4);
+                    }
+                    if(opcode == 0x37){
+                        return STEP(STEP_STC, 1, 4);
+                    }
+                    if(opcode == 0x3F){
+                        return STEP(STEP_CMC, 1, 4);
+                    }
+                    return STEP(STEP_DAA, 1, 4);
+                default: return STEP(STEP_SCALAR, 1, 0);
+            }
+        case 1:
+            if(source == REG_M && destination == REG_M){
+                return STEP(STEP_SCALAR, 1, 0); // HLT
+            }
+            if(source == REG_M){
+                return STEP(STEP_LOAD, 1, 7);
+            }
+            if(destination == REG_M){
+                return STEP(STEP_STORE, 1, 7);
+            }
+            return STEP(STEP_MOV, 1, 5);
+        case 2:
+            return source == REG_M ? STEP(STEP_ALU_MEMORY, 1, 7) : STEP(STEP_ALU, 1, 4);
+        default:
+            if(source == 6){
+                return STEP(STEP_ALU_IMMEDIATE, 2, 7);
+            }
+            if(opcode == 0xC3 || opcode == 0xCB){
+                return STEP(STEP_JMP, 3, 10);
+            }
+            switch(source){
+                case 0: return CONDITIONAL_STEP(STEP_RET, 1, 5, 11);
+                case 2: return CONDITIONAL_STEP(STEP_JCC, 3, 10, 10);
+                case 4: return CONDITIONAL_STEP(STEP_CALL, 3, 11, 17);
+                default: break;
+            }
+            switch(opcode){
+                case 0xC9: case 0xD9: return STEP(STEP_RET, 1, 10);
+                case 0xCD: case 0xDD: case 0xED: case 0xFD: return STEP(STEP_CALL, 3, 17);
+                case 0xC1: case 0xD1: case 0xE1: case 0xF1: return STEP(STEP_POP, 1, 10);
+                case 0xC5: case 0xD5: case 0xE5: case 0xF5: return STEP(STEP_PUSH, 1, 11);
+                case 0xEB: return STEP(STEP_XCHG, 1, 5);
+                default: return STEP(STEP_SCALAR, 1, 0);
+            }
+    }
+}
+
+static inline lane_t load(const uint8_t *array, size_t offset){
+    lane_t value;
+    memcpy(&value, array + offset, sizeof(value));
+    return value;
+}
+
+static inline void store(uint8_t *array, size_t offset, lane_t value, lane_t mask){
+    lane_t old = load(array, offset);
+    value = (old & ~mask) | (value & mask);
+    memcpy(array + offset, &value, sizeof(value));
+}
+
+static inline lane_t broadcast(uint8_t value){
+    lane_t lanes;
+    memset(&lanes, value, sizeof(lanes));
+    return lanes;
+}
+
+// True if any lane of the mask is set
+static inline bool any(lane_t mask){
+    uint64_t words[(sizeof(lane_t) + 7) / 8] = { 0 };
+    uint64_t all = 0;
+    memcpy(words, &mask, sizeof(mask));
+    for(size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++){
+        all |= words[w];
+    }
+    return all != 0;
+}
+
+static inline uint64_t count_lanes(lane_t mask){
+    uint64_t words[(sizeof(lane_t) + 7) / 8] = { 0 };
+    uint64_t count = 0;
+    memcpy(words, &mask, sizeof(mask));
+    for(size_t w = 0; w < sizeof(words) / sizeof(words[0]); w++){
+        for(uint64_t word = words[w]; word != 0; word &= word - 1){
+            count++;
+        }
+    }
+    return count / 8;
+}
+
+// S, Z and P of each result byte, computed rather than looked up so they vectorise
+static inline lane_t sign_zero_parity(lane_t result){
+    lane_t parity = result ^ (result >> 4);
+    parity ^= parity >> 2;
+    parity ^= parity >> 1;
+    return (result & FLAG_S) | (LANE_EQ(result, broadcast(0)) & FLAG_Z) | (((parity & 1) ^ 1) << 2);
+}
+
+// F after INR (or DCR) left `result`: CY is kept, AC set when the low digit wrapped to 0 (or
+// did not borrow)
+static inline lane_t inr_dcr_flags(lane_t f, lane_t result, bool increment){
+    lane_t ac = increment ? LANE_EQ(result & 0x0F, broadcast(0)) : ~LANE_EQ(result & 0x0F, broadcast(0x0F));
+    return (f & FLAG_CY) | sign_zero_parity(result) | FLAG_ALWAYS | (ac & FLAG_AC);
+}
+
+// ADD ADC SUB SBB ANA XRA ORA CMP of `b` into A, flags as in ADD()/SUB()/ANA()/ORA()/XRA()/CMP()
+static void alu_kernel(lockstep_t *group, size_t offset, lane_t mask, uint8_t operation, lane_t b){
+    lane_t a = load(group->registers[REG_A], offset);
+    lane_t f = load(group->F, offset);
+    lane_t carry = (operation == 1 || operation == 3) ? (f & FLAG_CY) : broadcast(0); // ADC SBB
+    lane_t result, flags;
+    switch(operation){
+        case 0: case 1: // ADD ADC: AC is the carry into bit 4, CY the carry out of bit 7
+            result = a + b + carry;
+            flags = ((a ^ b ^ result) & FLAG_AC) | (((a & b) | ((a | b) & ~result)) >> 7);
+            break;
+        case 2: case 3: case 7: // SUB SBB CMP: AC is set when bit 3 did not borrow
+            result = a - b - carry;
+            flags = (((a ^ b ^ result) & FLAG_AC) ^ FLAG_AC) | (((~a & b) | (~(a ^ b) & result)) >> 7);
+            break;
+        case 4: // ANA
+            result = a & b;
+            flags = ((a | b) & 0x08) << 1;
+            break;
+        case 5: // XRA
+            result = a ^ b;
+            flags = broadcast(0);
+            break;
+        default: // ORA
+            result = a | b;
+            flags = broadcast(0);
+            break;
+    }
+    store(group->F, offset, flags | sign_zero_parity(result) | FLAG_ALWAYS, mask);
+    if(operation != 7){
+        store(group->registers[REG_A], offset, result, mask);
+    }
+}
+
+// Bit of F behind each pair of conditions (NZ/Z, NC/C, PO/PE, P/M); the second of a pair holds
+// when the bit is set
+static const uint8_t condition_shift[4] = { 6, 0, 2, 7 };
+
+// Lanes for which the condition of a conditional jump, call or return holds
+static inline lane_t condition_holds(const lockstep_t *group, size_t offset, uint8_t opcode){
+    uint8_t condition = (opcode >> 3) & 0x07;
+    uint8_t shift = condition_shift[condition >> 1];
+    return LANE_EQ((load(group->F, offset) >> shift) & 1, broadcast(condition & 1));
+}
+
+// SP moved two bytes down (PUSH, CALL) or up (POP, RET)
+static void move_stack(lockstep_t *group, size_t offset, lane_t mask, bool down){
+    lane_t low = load(group->SP[1], offset);
+    lane_t high = load(group->SP[0], offset);
+    if(down){
+        high += LANE_LT(low, broadcast(2));
+        low -= 2;
+    }
+    else{
+        low += 2;
+        high -= LANE_LT(low, broadcast(2));
+    }
+    store(group->SP[1], offset, low, mask);
+    store(group->SP[0], offset, high, mask);
+}
+
+// Addresses the lanes access first in a memory step, split into page and offset bytes
+static void memory_address(const lockstep_t *group, step_t step, uint8_t opcode, uint16_t operand, size_t offset,
+                           lane_t *page, lane_t *low){
+    lane_t sp = load(group->SP[1], offset);
+    switch(step.kind){
+        case STEP_PUSH:
+        case STEP_CALL:
+            *page = load(group->SP[0], offset) + LANE_LT(sp, broadcast(2));
+            *low = sp - 2;
+            return;
+        case STEP_POP:
+        case STEP_RET:
+            *page = load(group->SP[0], offset);
+            *low = sp;
+            return;
+        default:
+            break;
+    }
+    if(opcode < 0x40 && (opcode & 0x07) == 2){ // STAX LDAX STA LDA
+        if(step.length == 3){
+            *page = broadcast(operand >> 8);
+            *low = broadcast(operand & 0xFF);
+            return;
+        }
+        *page = load(group->registers[(opcode & 0x10) ? 2 : 0], offset);
+        *low = load(group->registers[(opcode & 0x10) ? 3 : 1], offset);
+        return;
+    }
+    *page = load(group->registers[4], offset);
+    *low = load(group->registers[5], offset);
+}
+
+// Runs a memory step at `pc` for the lanes in `mask`, returning those that took it. The
+// accesses are made a lane at a time straight through the page tables, which is all
+// memory_read() and memory_write() do for plain pages; lanes that would meet MMIO, a watched
+// page or a shared page not yet written to are left out for the scalar path. Everything else
+// runs as vectors.
+static lane_t memory_kernel(lockstep_t *group, step_t step, uint8_t opcode, uint16_t pc, uint16_t operand,
+                            size_t offset, lane_t mask){
+    uint8_t destination = (opcode >> 3) & 0x07;
+    uint8_t source = opcode & 0x07;
+    uint8_t pair = (opcode >> 4) & 0x03;
+    uint8_t lanes[LANES], pages[LANES], lows[LANES], low[LANES] = { 0 }, high[LANES] = { 0 };
+    i8080_t **machines = group->machines + offset;
+    lane_t skipped = broadcast(0);
+    lane_t page, value, f;
+
+    if(step.taken != 0){ // Only calls and returns made touch memory
+        skipped = mask & ~condition_holds(group, offset, opcode);
+        mask &= ~skipped;
+    }
+    memory_address(group, step, opcode, operand, offset, &page, &value);
+    memcpy(pages, &page, sizeof(pages));
+    memcpy(lows, &value, sizeof(lows));
+    memcpy(lanes, &mask, sizeof(lanes));
+    switch(step.kind){
+        case STEP_LOAD:
+        case STEP_ALU_MEMORY:
+        case STEP_INR_MEMORY:
+        case STEP_DCR_MEMORY:
+            for(size_t i = 0; i < LANES; i++){
+                if(lanes[i]){
+                    const uint8_t *data = machines[i]->map.read[pages[i]];
+                    if(data == NULL || (step.kind >= STEP_INR_MEMORY && machines[i]->map.write[pages[i]] == NULL)){
+                        lanes[i] = 0;
+                    }
+                    else{
+                        low[i] = data[lows[i]];
+                    }
+                }
+            }
+            memcpy(&mask, lanes, sizeof(mask));
+            memcpy(&value, low, sizeof(value));
+            if(step.kind == STEP_LOAD){
+                store(group->registers[opcode < 0x40 ? REG_A : destination], offset, value, mask);
+            }
+            else if(step.kind == STEP_ALU_MEMORY){
+                alu_kernel(group, offset, mask, destination, value);
+            }
+            else{
+                value += broadcast(step.kind == STEP_INR_MEMORY ? 1 : 0xFF);
+                store(group->F, offset, inr_dcr_flags(load(group->F, offset), value, step.kind == STEP_INR_MEMORY), mask);
+                memcpy(low, &value, sizeof(low));
+                for(size_t i = 0; i < LANES; i++){
+                    if(lanes[i]){
+                        machines[i]->map.write[pages[i]][lows[i]] = low[i];
+                    }
+                }
+            }
+            break;
+        case STEP_STORE:
+            value = opcode == 0x36 ? broadcast(operand & 0xFF) :
+                    load(group->registers[opcode < 0x40 ? REG_A : source], offset);
+            memcpy(low, &value, sizeof(low));
+            for(size_t i = 0; i < LANES; i++){
+                if(lanes[i]){
+                    uint8_t *data = machines[i]->map.write[pages[i]];
+                    if(data == NULL){
+                        lanes[i] = 0;
+                    }
+                    else{
+                        data[lows[i]] = low[i];
+                    }
+                }
+            }
+            memcpy(&mask, lanes, sizeof(mask));
+            break;
+        case STEP_PUSH:
+        case STEP_CALL: // The high byte goes first, to SP - 1
+            if(step.kind == STEP_CALL){
+                memset(high, (uint16_t)(pc + 3) >> 8, sizeof(high));
+                memset(low, (pc + 3) & 0xFF, sizeof(low));
+            }
+            else{
+                value = load(pair == 3 ? group->registers[REG_A] : group->registers[pair * 2], offset);
+                memcpy(high, &value, sizeof(high));
+                value = load(pair == 3 ? group->F : group->registers[pair * 2 + 1], offset);
+                memcpy(low, &value, sizeof(low));
+            }
+            for(size_t i = 0; i < LANES; i++){
+                if(lanes[i]){
+                    uint8_t *first = machines[i]->map.write[pages[i]];
+                    uint8_t *second = lows[i] == 0xFF ? machines[i]->map.write[(uint8_t)(pages[i] + 1)] : first;
+                    if(first == NULL || second == NULL){
+                        lanes[i] = 0;
+                    }
+                    else{
+                        second[(uint8_t)(lows[i] + 1)] = high[i];
+                        first[lows[i]] = low[i];
+                    }
+                }
+            }
+            memcpy(&mask, lanes, sizeof(mask));
+            move_stack(group, offset, mask, true);
+            break;
+        case STEP_POP:
+        case STEP_RET:
+            for(size_t i = 0; i < LANES; i++){
+                if(lanes[i]){
+                    const uint8_t *first = machines[i]->map.read[pages[i]];
+                    const uint8_t *second = lows[i] == 0xFF ? machines[i]->map.read[(uint8_t)(pages[i] + 1)] : first;
+                    if(first == NULL || second == NULL){
+                        lanes[i] = 0;
+                    }
+                    else{
+                        low[i] = first[lows[i]];
+                        high[i] = second[(uint8_t)(lows[i] + 1)];
+                    }
+                }
+            }
+            memcpy(&mask, lanes, sizeof(mask));
+            if(step.kind == STEP_RET){ // finish_kernel() leaves the PCs of returning lanes alone
+                memcpy(&value, high, sizeof(value));
+                store(group->PC[0], offset, value, mask);
+                memcpy(&value, low, sizeof(value));
+                store(group->PC[1], offset, value, mask);
+            }
+            else{
+                memcpy(&value, high, sizeof(value));
+                store(pair == 3 ? group->registers[REG_A] : group->registers[pair * 2], offset, value, mask);
+                memcpy(&f, low, sizeof(f));
+                if(pair == 3){
+                    f = (f & FLAG_MASK) | FLAG_ALWAYS;
+                }
+                store(pair == 3 ? group->F : group->registers[pair * 2 + 1], offset, f, mask);
+            }
+            move_stack(group, offset, mask, false);
+            break;
+        default:
+            break;
+    }
+    return mask | skipped;
+}
+
+// Runs one decoded instruction for the lanes in `mask` of the LANES starting at `offset`
+static void execute_kernel(lockstep_t *group, step_t step, uint8_t opcode, uint8_t low, uint8_t high,
+                           size_t offset, lane_t mask){
+    uint8_t destination = (opcode >> 3) & 0x07;
+    uint8_t source = opcode & 0x07;
+    uint8_t pair = (opcode >> 4) & 0x03;
+    uint8_t *pair_high = pair == 3 ? group->SP[0] : group->registers[pair * 2];
+    uint8_t *pair_low = pair == 3 ? group->SP[1] : group->registers[pair * 2 + 1];
+    lane_t value, f;
+
+    switch(step.kind){
+        case STEP_MOV:
+            store(group->registers[destination], offset, load(group->registers[source], offset), mask);
+            break;
+        case STEP_MVI:
+            store(group->registers[destination], offset, broadcast(low), mask);
+            break;
+        case STEP_INR:
+        case STEP_DCR:
+            value = load(group->registers[destination], offset) + broadcast(step.kind == STEP_INR ? 1 : 0xFF);
+            store(group->F, offset, inr_dcr_flags(load(group->F, offset), value, step.kind == STEP_INR), mask);
+            store(group->registers[destination], offset, value, mask);
+            break;
+        case STEP_ALU:
+            alu_kernel(group, offset, mask, destination, load(group->registers[source], offset));
+            break;
+        case STEP_ALU_IMMEDIATE:
+            alu_kernel(group, offset, mask, destination, broadcast(low));
+            break;
+        case STEP_INX: // The high byte takes the carry when the low one wraps to 0
+        case STEP_DCX:
+            value = load(pair_low, offset);
+            f = load(pair_high, offset);
+            if(step.kind == STEP_INX){
+                value += 1;
+                f -= LANE_EQ(value, broadcast(0));
+            }
+            else{
+                f += LANE_EQ(value, broadcast(0));
+                value -= 1;
+            }
+            store(pair_low, offset, value, mask);
+            store(pair_high, offset, f, mask);
+            break;
+        case STEP_LXI:
+            store(pair_low, offset, broadcast(low), mask);
+            store(pair_high, offset, broadcast(high), mask);
+            break;
+        case STEP_ROTATE: // RLC RRC RAL RAR
+            value = load(group->registers[REG_A], offset);
+            f = load(group->F, offset);
+            switch(destination){
+                case 0:
+                    f = (f & ~FLAG_CY) | (value >> 7);
+                    value = (value << 1) | (value >> 7);
+                    break;
+                case 1:
+                    f = (f & ~FLAG_CY) | (value & 1);
+                    value = (value >> 1) | (value << 7);
+                    break;
+                case 2:
+                    value = (value << 1) | (f & FLAG_CY);
+                    f = (f & ~FLAG_CY) | (load(group->registers[REG_A], offset) >> 7);
+                    break;
+                default:
+                    value = (value >> 1) | (f << 7);
+                    f = (f & ~FLAG_CY) | (load(group->registers[REG_A], offset) & 1);
+                    break;
+            }
+            store(group->registers[REG_A], offset, value, mask);
+            store(group->F, offset, f, mask);
+            break;
+        case STEP_CMA:
+            store(group->registers[REG_A], offset, ~load(group->registers[REG_A], offset), mask);
+            break;
+        case STEP_STC:
+            store(group->F, offset, load(group->F, offset) | FLAG_CY, mask);
+            break;
+        case STEP_CMC:
+            store(group->F, offset, load(group->F, offset) ^ FLAG_CY, mask);
+            break;
+        case STEP_DAD: { // Only CY changes, from the carry out of the high byte
+            lane_t l = load(group->registers[5], offset);
+            lane_t h = load(group->registers[4], offset);
+            lane_t carry_low, carry_high;
+            value = l + load(pair_low, offset);
+            carry_low = LANE_LT(value, l);
+            f = h + load(pair_high, offset);
+            carry_high = LANE_LT(f, h);
+            f -= carry_low;
+            carry_high |= carry_low & LANE_EQ(f, broadcast(0));
+            store(group->registers[5], offset, value, mask);
+            store(group->registers[4], offset, f, mask);
+            store(group->F, offset, (load(group->F, offset) & ~FLAG_CY) | (carry_high & FLAG_CY), mask);
+            break;
+        }
+        case STEP_DAA: { // As DAA(): 0x06 and/or 0x60 added, CY set when the high digit was corrected
+            lane_t a = load(group->registers[REG_A], offset);
+            lane_t low = a & 0x0F;
+            lane_t high = a >> 4;
+            lane_t nine = broadcast(9);
+            lane_t fix_low, fix_high, correction;
+            f = load(group->F, offset);
+            fix_low = LANE_LT(nine, low) | ~LANE_EQ(f & FLAG_AC, broadcast(0));
+            fix_high = LANE_LT(nine, high) | ~LANE_EQ(f & FLAG_CY, broadcast(0)) |
+                       (LANE_EQ(high, nine) & LANE_LT(nine, low));
+            correction = (fix_low & 0x06) | (fix_high & 0x60);
+            value = a + correction;
+            f = ((a ^ correction ^ value) & FLAG_AC) | sign_zero_parity(value) | FLAG_ALWAYS |
+                ((f | fix_high) & FLAG_CY);
+            store(group->registers[REG_A], offset, value, mask);
+            store(group->F, offset, f, mask);
+            break;
+        }
+        case STEP_XCHG:
+            value = load(group->registers[2], offset);
+            store(group->registers[2], offset, load(group->registers[4], offset), mask);
+            store(group->registers[4], offset, value, mask);
+            value = load(group->registers[3], offset);
+            store(group->registers[3], offset, load(group->registers[5], offset), mask);
+            store(group->registers[5], offset, value, mask);
+            break;
+        default:
+            break;
+    }
+}
+
+static void update_shared(lockstep_t *group, size_t i){
+    uint16_t page = PAGE_OF(TO16BIT(group->PC[0][i], group->PC[1][i]));
+    group->shared[i] = group->machines[i]->map.read[page] == group->reference[page] ? 0xFF : 0;
+}
+
+// Cycles lane `i` can run before its next event is due, up to LOCKSTEP_SLACK
+static void update_slack(lockstep_t *group, size_t i){
+    uint64_t next = scheduler_next(&group->machines[i]->scheduler);
+    uint64_t cycles = group->cycles[i];
+    group->slack[i] = next <= cycles ? 0 : next - cycles < LOCKSTEP_SLACK ? (uint8_t)(next - cycles) : LOCKSTEP_SLACK;
+}
+
+// PC and cycles of the lanes that took part, which the byte kernels do not cover. Every lane
+// was at `pc`, so only a branch, call or return taken makes their PCs differ.
+static void finish_kernel(lockstep_t *group, step_t step, uint8_t opcode, uint16_t pc, uint16_t operand,
+                          size_t offset, lane_t mask){
+    uint16_t next = pc + step.length;
+    bool branch = step.kind == STEP_JMP || step.kind == STEP_JCC || step.kind == STEP_CALL || step.kind == STEP_RET;
+    lane_t taken = branch ? mask : broadcast(0);
+    lane_t spent = mask & step.cycles;
+    lane_t slack;
+
+    if(step.taken != 0){
+        taken &= condition_holds(group, offset, opcode);
+        spent = (spent & ~taken) | (taken & step.taken);
+    }
+    slack = load(group->slack, offset);
+    store(group->elapsed, offset, load(group->elapsed, offset) + spent, mask);
+    store(group->slack, offset, (slack - spent) & ~LANE_LT(slack, spent), mask);
+    store(group->PC[0], offset, broadcast(next >> 8), mask & ~taken);
+    store(group->PC[1], offset, broadcast(next & 0xFF), mask & ~taken);
+    if(step.kind != STEP_RET){ // Returns took their PCs off the stack
+        store(group->PC[0], offset, broadcast(operand >> 8), taken);
+        store(group->PC[1], offset, broadcast(operand & 0xFF), taken);
+    }
+
+    // Lanes that left the page see whether the new one is shared; that is the exception
+    mask &= ~LANE_EQ(load(group->PC[0], offset), broadcast(PAGE_OF(pc)));
+    if(any(mask)){
+        uint8_t lanes[LANES];
+        memcpy(lanes, &mask, sizeof(lanes));
+        for(size_t i = 0; i < LANES; i++){
+            if(lanes[i]){
+                update_shared(group, offset + i);
+            }
+        }
+    }
+}
+
+// True when emulate_cycle() would do nothing but execute one instruction, events aside
+static bool plain(const i8080_t *cpu){
+    bool plain = !cpu->halted && !cpu->interrupt_pending && !cpu->ei_pending;
+    plain &= cpu->debug == NULL; // Vector steps check no breakpoints or watchpoints
+#ifdef I8080_PROFILE
+    plain &= cpu->profile == NULL; // Vector steps update no profile counters
+#endif
+#ifdef I8080_TRACE
+    plain &= cpu->trace == NULL; // Vector steps record no trace
+#endif
+#ifdef I8080_FUZZ
+    plain &= cpu->coverage == NULL; // Vector steps record no edges
+#endif
+    return plain;
+}
+
+static void load_lane(lockstep_t *group, size_t i){
+    i8080_t *cpu = group->machines[i];
+    group->registers[0][i] = cpu->B;
+    group->registers[1][i] = cpu->C;
+    group->registers[2][i] = cpu->D;
+    group->registers[3][i] = cpu->E;
+    group->registers[4][i] = cpu->H;
+    group->registers[5][i] = cpu->L;
+    group->registers[REG_A][i] = cpu->A;
+    group->F[i] = FLAGS(cpu);
+    group->SP[0][i] = cpu->SP >> 8;
+    group->SP[1][i] = cpu->SP & 0xFF;
+    group->PC[0][i] = cpu->PC >> 8;
+    group->PC[1][i] = cpu->PC & 0xFF;
+    group->cycles[i] = cpu->cycles;
+    group->elapsed[i] = 0;
+    update_slack(group, i);
+    update_shared(group, i);
+    group->plain[i] = plain(cpu);
+}
+
+static void store_lane(lockstep_t *group, size_t i){
+    i8080_t *cpu = group->machines[i];
+    cpu->B = group->registers[0][i];
+    cpu->C = group->registers[1][i];
+    cpu->D = group->registers[2][i];
+    cpu->E = group->registers[3][i];
+    cpu->H = group->registers[4][i];
+    cpu->L = group->registers[5][i];
+    cpu->A = group->registers[REG_A][i];
+    cpu->F = group->F[i];
+    CLEAR_PENDING_FLAGS(cpu);
+    cpu->SP = TO16BIT(group->SP[0][i], group->SP[1][i]);
+    cpu->PC = TO16BIT(group->PC[0][i], group->PC[1][i]);
+    cpu->cycles = group->cycles[i] + group->elapsed[i];
+}
+
+// Code is only read through the page table: fetching from an MMIO page could have side
+// effects, so instructions there are left to the scalar path.
+static inline bool fetch(const i8080_t *cpu, uint16_t address, uint8_t *value){
+    const uint8_t *page = cpu->map.read[PAGE_OF(address)];
+    if(page == NULL){
+        return false;
+    }
+    *value = page[PAGE_OFFSET(address)];
+    return true;
+}
+
+// Hands lane `i` up to 255 more of the instructions it still has to run
+static void refill(lockstep_t *group, size_t i){
+    uint64_t steps = group->remaining[i] < 0xFF ? group->remaining[i] : 0xFF;
+    group->left[i] = (uint8_t)steps;
+    group->remaining[i] -= steps;
+}
+
+// Steps lane `i` with emulate_cycle() until it reaches an instruction the kernels handle or
+// has no steps left, since moving it out of the arrays and back costs more than the
+// instruction does
+static void scalar_run(lockstep_t *group, size_t i){
+    i8080_t *cpu = group->machines[i];
+    uint8_t opcode;
+    store_lane(group, i);
+    do{
+        emulate_cycle(cpu);
+        group->scalar_steps++;
+        if(--group->left[i] == 0){
+            refill(group, i);
+        }
+    }while(group->left[i] > 0 && !(plain(cpu) && fetch(cpu, cpu->PC, &opcode) && classify(opcode).kind != STEP_SCALAR));
+    load_lane(group, i);
+}
+
+// True if lane `i` would execute the `length` bytes at `pc` that the lead does, for lanes not
+// known to share the lead's page (a copy made by a write, or an instruction crossing pages)
+static bool same_code(const lockstep_t *group, size_t i, uint16_t pc, const uint8_t *code, uint8_t length){
+    const i8080_t *cpu = group->machines[i];
+    const uint8_t *page = cpu->map.read[PAGE_OF(pc)];
+    if(page != NULL && PAGE_OFFSET(pc) + length <= PAGE_SIZE){ // One lookup for the common case
+        page += PAGE_OFFSET(pc);
+        return page[0] == code[0] && (length < 2 || page[1] == code[1]) && (length < 3 || page[2] == code[2]);
+    }
+    for(uint8_t k = 0; k < length; k++){
+        uint8_t value;
+        if(!fetch(cpu, pc + k, &value) || value != code[k]){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lanes out of `mask`, all at `pc`, that can join the lead's vector step: ready and on the
+// same `code` as the lead. `shared` is whether the lead's page was the reference one when its
+// code was fetched; it may have run on since. A lane whose slack ran out only has an event
+// due if recounting it from the scheduler agrees.
+static lane_t match(lockstep_t *group, bool shared, size_t offset, lane_t mask, uint16_t pc, const uint8_t *code,
+                    step_t step){
+    lane_t plain = mask & ~LANE_EQ(load(group->plain, offset), broadcast(0));
+    lane_t stale = plain & LANE_EQ(load(group->slack, offset), broadcast(0));
+    lane_t check;
+    uint8_t lanes[LANES];
+    uint8_t checks[LANES];
+
+    if(any(stale)){
+        memcpy(lanes, &stale, sizeof(lanes));
+        for(size_t i = 0; i < LANES; i++){
+            if(lanes[i]){
+                group->cycles[offset + i] += group->elapsed[offset + i];
+                group->elapsed[offset + i] = 0;
+                update_slack(group, offset + i);
+            }
+        }
+    }
+    mask = plain & ~LANE_EQ(load(group->slack, offset), broadcast(0));
+    check = mask; // Lanes whose code has to be compared byte by byte
+    if(shared && PAGE_OFFSET(pc) + step.length <= PAGE_SIZE){
+        check &= ~load(group->shared, offset);
+    }
+    if(any(check)){
+        memcpy(lanes, &mask, sizeof(lanes));
+        memcpy(checks, &check, sizeof(checks));
+        for(size_t i = 0; i < LANES; i++){
+            if(lanes[i] && checks[i] && !same_code(group, offset + i, pc, code, step.length)){
+                lanes[i] = 0;
+            }
+        }
+        memcpy(&mask, lanes, sizeof(mask));
+    }
+    return mask;
+}
+
+// Index of the first lane set in a mask that has one
+static size_t first_lane(lane_t mask){
+    uint8_t lanes[LANES];
+    size_t i = 0;
+    memcpy(lanes, &mask, sizeof(lanes));
+    while(!lanes[i]){
+        i++;
+    }
+    return i;
+}
+
+// Folds the PCs of the lanes at `offset` with steps left into the highest seen per lane
+// position, compared a byte at a time
+static inline void track_highest(const lockstep_t *group, size_t offset, lane_t left, lane_t *found,
+                                 lane_t *high, lane_t *low){
+    lane_t active = ~LANE_EQ(left, broadcast(0));
+    lane_t h = load(group->PC[0], offset);
+    lane_t l = load(group->PC[1], offset);
+    lane_t better = active & (~*found | LANE_LT(*high, h) | (LANE_EQ(h, *high) & LANE_LT(*low, l)));
+    *high = (*high & ~better) | (h & better);
+    *low = (*low & ~better) | (l & better);
+    *found |= active;
+}
+
+// The highest of what track_highest() gathered, false if no lane has steps left
+static bool highest_of(lane_t found, lane_t high, lane_t low, uint16_t *pc){
+    uint8_t founds[LANES], highs[LANES], lows[LANES];
+    bool any_found = false;
+    memcpy(founds, &found, sizeof(founds));
+    memcpy(highs, &high, sizeof(highs));
+    memcpy(lows, &low, sizeof(lows));
+    for(size_t i = 0; i < LANES; i++){
+        uint16_t candidate = TO16BIT(highs[i], lows[i]);
+        if(founds[i] && (!any_found || candidate > *pc)){
+            *pc = candidate;
+            any_found = true;
+        }
+    }
+    return any_found;
+}
+
+static bool highest_pc(const lockstep_t *group, uint16_t *pc){
+    lane_t found = broadcast(0), high = broadcast(0), low = broadcast(0);
+    for(size_t offset = 0; offset < group->padded; offset += LANES){
+        track_highest(group, offset, load(group->left, offset), &found, &high, &low);
+    }
+    return highest_of(found, high, low, pc);
+}
+
+// Steps every lane at `pc` that has steps left once: those the lead's instruction can be
+// vectorised for together, the rest one at a time. The same pass finds the highest PC left,
+// returning false when no lane has steps left.
+static bool step_pc(lockstep_t *group, uint16_t pc, uint16_t *highest){
+    size_t lead = group->count;
+    bool shared = false;
+    uint8_t code[3];
+    step_t step = STEP(STEP_SCALAR, 1, 0);
+    lane_t found = broadcast(0), high = broadcast(0), low = broadcast(0);
+
+    for(size_t offset = 0; offset < group->padded; offset += LANES){
+        lane_t left = load(group->left, offset);
+        lane_t mask = ~LANE_EQ(left, broadcast(0)) &
+                      LANE_EQ(load(group->PC[0], offset), broadcast(pc >> 8)) &
+                      LANE_EQ(load(group->PC[1], offset), broadcast(pc & 0xFF));
+
+        if(any(mask)){
+            lane_t vector = broadcast(0);
+            uint8_t lanes[LANES];
+            if(lead == group->count){
+                lead = offset + first_lane(mask);
+                shared = group->shared[lead];
+                if(fetch(group->machines[lead], pc, &code[0]) && fetch(group->machines[lead], pc + 2, &code[2])){
+                    fetch(group->machines[lead], pc + 1, &code[1]);
+                    step = classify(code[0]);
+                }
+            }
+            if(step.kind != STEP_SCALAR){
+                vector = match(group, shared, offset, mask, pc, code, step);
+            }
+            if(any(vector) && step.kind >= STEP_LOAD){
+                vector = memory_kernel(group, step, code[0], pc, TO16BIT(code[2], code[1]), offset, vector);
+            }
+            else if(any(vector)){
+                execute_kernel(group, step, code[0], code[1], code[2], offset, vector);
+            }
+            if(any(vector)){
+                lane_t empty = vector & LANE_EQ(left, broadcast(1));
+                finish_kernel(group, step, code[0], pc, TO16BIT(code[2], code[1]), offset, vector);
+                store(group->left, offset, left - 1, vector);
+                group->vector_steps += count_lanes(vector);
+                if(any(empty)){
+                    memcpy(lanes, &empty, sizeof(lanes));
+                    for(size_t i = 0; i < LANES; i++){
+                        if(lanes[i]){
+                            refill(group, offset + i);
+                        }
+                    }
+                }
+            }
+            if(any(mask & ~vector)){
+                lane_t scalar = mask & ~vector;
+                memcpy(lanes, &scalar, sizeof(lanes));
+                for(size_t i = 0; i < LANES; i++){
+                    if(lanes[i]){
+                        scalar_run(group, offset + i);
+                    }
+                }
+            }
+            left = load(group->left, offset);
+        }
+        track_highest(group, offset, left, &found, &high, &low);
+    }
+    return highest_of(found, high, low, highest);
+}
+
+bool lockstep_init(lockstep_t *group, i8080_t **machines, size_t count){
+    uint8_t *bytes;
+    if(group == NULL || machines == NULL || count == 0){
+        return false;
+    }
+    memset(group, 0, sizeof(*group));
+    group->padded = (count + LOCKSTEP_WIDTH - 1) / LOCKSTEP_WIDTH * LOCKSTEP_WIDTH;
+    group->machines = (i8080_t**)malloc(count * sizeof(i8080_t*));
+    // The 64-bit counters go last so every byte array starts on a multiple of LOCKSTEP_WIDTH
+    bytes = (uint8_t*)calloc(group->padded, 17 + 2 * sizeof(uint64_t));
+    if(group->machines == NULL || bytes == NULL){
+        free(group->machines);
+        free(bytes);
+        return false;
+    }
+    memcpy(group->machines, machines, count * sizeof(i8080_t*));
+    group->count = count;
+    for(int r = 0; r < 8; r++){
+        group->registers[r] = bytes + r * group->padded;
+    }
+    group->F = bytes + 8 * group->padded;
+    group->plain = group->registers[REG_M]; // The unused M slot
+    group->left = bytes + 9 * group->padded;
+    group->shared = bytes + 10 * group->padded;
+    group->SP[0] = bytes + 11 * group->padded;
+    group->SP[1] = bytes + 12 * group->padded;
+    group->PC[0] = bytes + 13 * group->padded;
+    group->PC[1] = bytes + 14 * group->padded;
+    group->elapsed = bytes + 15 * group->padded;
+    group->slack = bytes + 16 * group->padded;
+    group->cycles = (uint64_t*)(bytes + 17 * group->padded);
+    group->remaining = group->cycles + group->padded;
+    group->registers[REG_M] = NULL;
+    return true;
+}
+
+void lockstep_release(lockstep_t *group){
+    if(group != NULL){
+        free(group->registers[0]);
+        free(group->machines);
+        memset(group, 0, sizeof(*group));
+    }
+}
+
+void lockstep_run(lockstep_t *group, uint64_t steps){
+    uint16_t pc = 0;
+    if(group == NULL || group->count == 0){
+        return;
+    }
+    memcpy(group->reference, group->machines[0]->map.read, sizeof(group->reference));
+    for(size_t i = 0; i < group->count; i++){
+        load_lane(group, i);
+        group->remaining[i] = steps;
+        refill(group, i);
+    }
+    if(highest_pc(group, &pc)){
+        while(step_pc(group, pc, &pc)){
+        }
+    }
+    for(size_t i = 0; i < group->count; i++){
+        store_lane(group, i);
+    }
+}
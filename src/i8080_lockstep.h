@@ -0,0 +1,59 @@
+//
+// Created by leonv on 5/27/2024.
+//
+
+#ifndef INTEL8080_I8080_LOCKSTEP_H
+#define INTEL8080_I8080_LOCKSTEP_H
+
+#include "i8080_cpu.h"
+
+#define LOCKSTEP_WIDTH 32 // Lanes per vector; register arrays are padded to a multiple of it
+#define LOCKSTEP_SLACK 0xEE // Cap on a lane's slack, leaving its elapsed cycles room for one more CALL
+
+// Steps a group of machines side by side. Registers are kept in structure-of-arrays form so
+// that when machines sit at the same PC on the same code, the instruction is decoded once and
+// executed for every one of them by vector kernels. Register, branch, memory and stack
+// instructions run this way, the memory accesses themselves made a lane at a time through
+// the page tables; MMIO, watched or not yet copied pages, I/O and interrupts are stepped one
+// machine at a time with emulate_cycle(). Either way each machine ends up exactly where
+// emulate_cycle() would have taken it.
+// Machines are independent, so they need not step in unison: the machines at the highest PC
+// go first, and those that branched back to a loop head wait there for the rest of the loop
+// to catch up. Machines that took different paths through an iteration so step together again
+// from the next one on, where stepping everything once a round would leave them a few
+// instructions apart for good.
+// Every array the kernels touch holds bytes: cycles are counted down against each machine's
+// next event in a byte, and lanes whose page is the same as in `reference` are known to share
+// code without comparing it.
+typedef struct {
+    i8080_t **machines;
+    size_t count;
+    size_t padded; // count rounded up to LOCKSTEP_WIDTH
+
+    // Indexed by the 8080 register encoding, B C D E H L - A. Index 6 (M) is unused.
+    uint8_t *registers[8];
+    uint8_t *F;
+    uint8_t *SP[2]; // High and low bytes, like the register pairs
+    uint8_t *PC[2];
+    uint64_t *cycles; // As of the last time the lane was loaded or refreshed
+    uint8_t *elapsed; // Cycles spent in vector steps since then
+    uint8_t *slack; // Cycles left before the next event, capped at LOCKSTEP_SLACK
+    uint8_t *plain; // Not halted, no interrupt pending, no EI shadow and nothing to trace
+    uint8_t *left; // Instructions the lane may run before taking more from `remaining`
+    uint64_t *remaining;
+    uint8_t *shared; // 0xFF if the page holding PC is the one in `reference`
+    uint8_t *reference[PAGE_COUNT]; // First machine's read pages when the group was loaded
+
+    uint64_t vector_steps; // Instructions executed by the kernels, counted per machine
+    uint64_t scalar_steps;
+} lockstep_t;
+
+// The machines stay owned by the caller, who may use them freely between lockstep_run() calls
+bool lockstep_init(lockstep_t *group, i8080_t **machines, size_t count);
+void lockstep_release(lockstep_t *group);
+
+// Equivalent to calling emulate_cycle() `steps` times on every machine. Device callbacks run
+// during the scalar steps and must only touch their own machine.
+void lockstep_run(lockstep_t *group, uint64_t steps);
+
+#endif //INTEL8080_I8080_LOCKSTEP_H
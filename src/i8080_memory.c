@@ -0,0 +1,201 @@
+//
+// Created by leonv on 5/2/2024.
+//
+
+#include "i8080_memory.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static bool is_page_range(uint16_t start, uint32_t length){
+    return PAGE_OFFSET(start) == 0 && PAGE_OFFSET(length) == 0 && length > 0 && start + length <= MEMORY_SIZE;
+}
+
+// Give a cache holding code from the page a chance to drop it before the page is remapped
+static void unmap_page(memory_map_t *map, uint8_t page){
+    if((map->attributes[page] & PAGE_CODE) && map->code_write != NULL){
+        map->code_write(map->code_context, page * PAGE_SIZE, PAGE_SIZE);
+    }
+}
+
+// Park the page's pointers so the core takes the slow paths, after the page was (re)mapped
+static void hide_page(memory_map_t *map, uint8_t page){
+    if(map->attributes[page] & PAGE_WATCH){
+        map->watched[page] = map->read[page];
+        map->read[page] = NULL;
+        map->write[page] = NULL;
+    }
+}
+
+// Undo hide_page() for the duration of an access, so the regular slow paths can handle it
+static void show_page(memory_map_t *map, uint8_t page){
+    uint8_t attributes = map->attributes[page] & ~PAGE_WATCH;
+    map->attributes[page] = attributes;
+    map->read[page] = map->watched[page];
+    map->write[page] = attributes == 0 ? map->read[page] : NULL;
+}
+
+void memory_map_init(memory_map_t *map, uint8_t *ram){
+    map->ram = ram;
+    map->code_write = NULL;
+    map->code_context = NULL;
+    map->watch = NULL;
+    map->watch_context = NULL;
+    memset(map->attributes, 0, sizeof(map->attributes));
+    memory_map_ram(map, 0, MEMORY_SIZE, ram);
+}
+
+bool memory_map_ram(memory_map_t *map, uint16_t start, uint32_t length, uint8_t *backing){
+    if(map == NULL || backing == NULL || !is_page_range(start, length)){
+        return false;
+    }
+    for(uint32_t offset = 0; offset < length; offset += PAGE_SIZE){
+        uint8_t page = PAGE_OF(start + offset);
+        unmap_page(map, page);
+        map->read[page] = backing + offset;
+        map->write[page] = backing + offset;
+        map->attributes[page] &= PAGE_WATCH;
+        map->handlers[page] = (mmio_handler_t){ NULL, NULL, NULL };
+        hide_page(map, page);
+    }
+    return true;
+}
+
+bool memory_map_rom(memory_map_t *map, uint16_t start, uint32_t length, const uint8_t *backing){
+    if(map == NULL || backing == NULL || !is_page_range(start, length)){
+        return false;
+    }
+    for(uint32_t offset = 0; offset < length; offset += PAGE_SIZE){
+        uint8_t page = PAGE_OF(start + offset);
+        unmap_page(map, page);
+        map->read[page] = (uint8_t*)backing + offset;
+        map->write[page] = NULL;
+        map->attributes[page] = PAGE_ROM | (map->attributes[page] & PAGE_WATCH);
+        map->handlers[page] = (mmio_handler_t){ NULL, NULL, NULL };
+        hide_page(map, page);
+    }
+    return true;
+}
+
+bool memory_map_mmio(memory_map_t *map, uint16_t start, uint32_t length,
+                     mmio_read_fn read, mmio_write_fn write, void *context){
+    if(map == NULL || !is_page_range(start, length)){
+        return false;
+    }
+    for(uint32_t offset = 0; offset < length; offset += PAGE_SIZE){
+        uint8_t page = PAGE_OF(start + offset);
+        unmap_page(map, page);
+        map->read[page] = NULL;
+        map->write[page] = NULL;
+        map->attributes[page] = PAGE_MMIO | (map->attributes[page] & PAGE_WATCH);
+        map->handlers[page] = (mmio_handler_t){ read, write, context };
+        hide_page(map, page);
+    }
+    return true;
+}
+
+void memory_map_share(memory_map_t *map, uint8_t page, const uint8_t *data){
+    unmap_page(map, page);
+    map->read[page] = (uint8_t*)data;
+    map->write[page] = NULL;
+    map->attributes[page] = PAGE_SHARED | (map->attributes[page] & PAGE_WATCH);
+    map->handlers[page] = (mmio_handler_t){ NULL, NULL, NULL };
+    hide_page(map, page);
+}
+
+bool memory_map_is_ram(const memory_map_t *map, uint8_t page){
+    uint8_t attributes = map->attributes[page] & ~(PAGE_CODE | PAGE_WATCH);
+    return attributes == PAGE_SHARED || (attributes == 0 && memory_map_page(map, page) == map->ram + page * PAGE_SIZE);
+}
+
+void memory_map_watch(memory_map_t *map, uint8_t page){
+    if(!(map->attributes[page] & PAGE_WATCH)){
+        if(map->attributes[page] & PAGE_CODE){
+            // Code cached from the page would run without fetching through the slow path
+            map->code_write(map->code_context, page * PAGE_SIZE, PAGE_SIZE);
+        }
+        map->attributes[page] |= PAGE_WATCH;
+        hide_page(map, page);
+    }
+}
+
+void memory_map_unwatch(memory_map_t *map, uint8_t page){
+    if(map->attributes[page] & PAGE_WATCH){
+        show_page(map, page);
+    }
+}
+
+const uint8_t *memory_map_page(const memory_map_t *map, uint8_t page){
+    return map->attributes[page] & PAGE_WATCH ? map->watched[page] : map->read[page];
+}
+
+void memory_map_mark_code(memory_map_t *map, uint8_t page){
+    map->attributes[page] |= PAGE_CODE;
+    map->write[page] = NULL;
+}
+
+void memory_map_clear_code(memory_map_t *map, uint8_t page){
+    map->attributes[page] &= ~PAGE_CODE;
+    if(map->attributes[page] == 0){
+        map->write[page] = map->read[page];
+    }
+}
+
+uint8_t memory_map_read(memory_map_t *map, uint16_t address){
+    uint8_t page = PAGE_OF(address);
+    uint8_t value = 0xFF; // Open bus
+    if(map->attributes[page] & PAGE_WATCH){
+        show_page(map, page);
+        value = memory_map_read(map, address);
+        map->attributes[page] |= PAGE_WATCH;
+        hide_page(map, page);
+        if(map->watch != NULL){
+            map->watch(map->watch_context, address, value, false);
+        }
+    }
+    else if(map->read[page] != NULL){
+        value = map->read[page][PAGE_OFFSET(address)];
+    }
+    else if(map->handlers[page].read != NULL){
+        value = map->handlers[page].read(map->handlers[page].context, address);
+    }
+    return value;
+}
+
+void memory_map_write(memory_map_t *map, uint16_t address, uint8_t value){
+    uint8_t page = PAGE_OF(address);
+    if(map->attributes[page] & PAGE_WATCH){
+        if(map->watch != NULL){
+            map->watch(map->watch_context, address, value, true);
+        }
+        // The write may copy a shared page or drop cached code, which moves the page's pointers
+        show_page(map, page);
+        memory_map_write(map, address, value);
+        map->attributes[page] |= PAGE_WATCH;
+        hide_page(map, page);
+        return;
+    }
+    if((map->attributes[page] & (PAGE_CODE | PAGE_ROM)) == PAGE_CODE){
+        // Lets the block cache drop code decoded from this byte; it may clear PAGE_CODE
+        map->code_write(map->code_context, address, 1);
+    }
+    if(map->attributes[page] & PAGE_MMIO){
+        if(map->handlers[page].write != NULL){
+            map->handlers[page].write(map->handlers[page].context, address, value);
+        }
+    }
+    else if(map->attributes[page] & PAGE_SHARED){
+        uint8_t *private_page = map->ram + page * PAGE_SIZE;
+        memcpy(private_page, map->read[page], PAGE_SIZE);
+        map->read[page] = private_page;
+        map->attributes[page] &= ~PAGE_SHARED;
+        map->write[page] = map->attributes[page] == 0 ? private_page : NULL;
+        private_page[PAGE_OFFSET(address)] = value;
+    }
+    else if(map->attributes[page] == PAGE_CODE){
+        map->read[page][PAGE_OFFSET(address)] = value;
+    }
+    else if(map->write[page] != NULL){
+        map->write[page][PAGE_OFFSET(address)] = value;
+    }
+}
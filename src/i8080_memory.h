@@ -0,0 +1,81 @@
+//
+// Created by leonv on 5/2/2024.
+//
+
+#ifndef INTEL8080_I8080_MEMORY_H
+#define INTEL8080_I8080_MEMORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MEMORY_SIZE 0x10000
+#define PAGE_SIZE 0x100
+#define PAGE_COUNT (MEMORY_SIZE / PAGE_SIZE)
+#define PAGE_OF(address) ((uint16_t)(address) >> 8)
+#define PAGE_OFFSET(address) ((address) & (PAGE_SIZE - 1))
+
+// Page attributes. A page with any attribute set takes the slow write path.
+#define PAGE_ROM 0x01 // Writes are ignored
+#define PAGE_MMIO 0x02 // Reads and writes go to the page's handler
+#define PAGE_SHARED 0x04 // Read-only view of a snapshot page, copied into RAM on the first write
+#define PAGE_CODE 0x08 // Instructions on this page are cached; writes and remapping report to code_write
+#define PAGE_WATCH 0x10 // Every access reports to watch first; the page's own pointers are parked in `watched`
+
+typedef uint8_t (*mmio_read_fn)(void *context, uint16_t address);
+typedef void (*mmio_write_fn)(void *context, uint16_t address, uint8_t value);
+// Bytes [address, address + length) of a PAGE_CODE page are about to change
+typedef void (*code_write_fn)(void *context, uint16_t address, uint16_t length);
+// An access to a PAGE_WATCH page, reported before a write and after a read
+typedef void (*watch_fn)(void *context, uint16_t address, uint8_t value, bool write);
+
+typedef struct {
+    mmio_read_fn read;
+    mmio_write_fn write;
+    void *context;
+} mmio_handler_t;
+
+// One entry per 256-byte page. `read`/`write` point at the backing storage of the page, or are
+// NULL when the access has to go through memory_map_read()/memory_map_write().
+typedef struct {
+    uint8_t *ram; // RAM the map was initialised with; shared pages are copied back into it
+    uint8_t *read[PAGE_COUNT];
+    uint8_t *write[PAGE_COUNT];
+    uint8_t attributes[PAGE_COUNT];
+    mmio_handler_t handlers[PAGE_COUNT];
+    code_write_fn code_write;
+    void *code_context;
+    uint8_t *watched[PAGE_COUNT]; // Read pointer of a PAGE_WATCH page, whose `read` entry is NULL
+    watch_fn watch;
+    void *watch_context;
+} memory_map_t;
+
+void memory_map_init(memory_map_t *map, uint8_t *ram);
+
+// Regions are given in whole pages: `start` and `length` must be multiples of PAGE_SIZE.
+// `backing` may point into another region to mirror it.
+bool memory_map_ram(memory_map_t *map, uint16_t start, uint32_t length, uint8_t *backing);
+bool memory_map_rom(memory_map_t *map, uint16_t start, uint32_t length, const uint8_t *backing);
+bool memory_map_mmio(memory_map_t *map, uint16_t start, uint32_t length,
+                     mmio_read_fn read, mmio_write_fn write, void *context);
+
+// Map one page to `data` until the first write to it, which copies it to the page's RAM
+void memory_map_share(memory_map_t *map, uint8_t page, const uint8_t *data);
+// True for pages backed 1:1 by the map's own RAM, whether private or still shared
+bool memory_map_is_ram(const memory_map_t *map, uint8_t page);
+
+// Route writes to a RAM or ROM page through code_write, or back to the fast path
+void memory_map_mark_code(memory_map_t *map, uint8_t page);
+void memory_map_clear_code(memory_map_t *map, uint8_t page);
+
+// Send every access to the page through the slow paths and `watch`, or stop doing so. The
+// watch outlives remapping the page; memory_map_init() clears it.
+void memory_map_watch(memory_map_t *map, uint8_t page);
+void memory_map_unwatch(memory_map_t *map, uint8_t page);
+// Storage the page reads from, whether or not it is watched; NULL for MMIO
+const uint8_t *memory_map_page(const memory_map_t *map, uint8_t page);
+
+// Slow paths, taken when the page table has no direct pointer for the page
+uint8_t memory_map_read(memory_map_t *map, uint16_t address);
+void memory_map_write(memory_map_t *map, uint16_t address, uint8_t value);
+
+#endif //INTEL8080_I8080_MEMORY_H
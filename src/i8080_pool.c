@@ -0,0 +1,101 @@
+//
+// Created by leonv on 5/14/2024.
+//
+
+#include "i8080_pool.h"
+
+#include <string.h>
+
+#define ALIGN_UP(size, alignment) (((size) + (alignment) - 1) & ~(size_t)((alignment) - 1))
+
+static void *aligned_arena(size_t size){
+#ifdef _WIN32
+    return _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+    return aligned_alloc(CACHE_LINE_SIZE, ALIGN_UP(size, CACHE_LINE_SIZE));
+#endif
+}
+
+static void free_arena(void *arena){
+#ifdef _WIN32
+    _aligned_free(arena);
+#else
+    free(arena);
+#endif
+}
+
+static i8080_t *slot_cpu(machine_pool_t *pool, size_t slot){
+    return (i8080_t*)(pool->arena + slot * pool->slot_size);
+}
+
+static uint8_t *slot_memory(machine_pool_t *pool, size_t slot){
+    return pool->arena + slot * pool->slot_size + ALIGN_UP(sizeof(i8080_t), CACHE_LINE_SIZE);
+}
+
+bool machine_pool_init(machine_pool_t *pool, size_t capacity){
+    pool->slot_size = ALIGN_UP(sizeof(i8080_t), CACHE_LINE_SIZE) + MEMORY_SIZE;
+    pool->capacity = capacity;
+    pool->arena = (uint8_t*)aligned_arena(pool->slot_size * capacity);
+    pool->free_slots = (size_t*)malloc(capacity * sizeof(size_t));
+    pool->free_count = 0;
+    if(pool->arena == NULL || pool->free_slots == NULL || capacity == 0){
+        free_arena(pool->arena);
+        free(pool->free_slots);
+        pool->arena = NULL;
+        pool->free_slots = NULL;
+        return false;
+    }
+
+    // Touch the whole arena once now so machines never take page faults on their memory later
+    memset(pool->arena, 0, pool->slot_size * capacity);
+    for(size_t slot = 0; slot < capacity; slot++){
+        init_i8080_in(slot_cpu(pool, slot), slot_memory(pool, slot));
+        pool->free_slots[pool->free_count++] = capacity - 1 - slot;
+    }
+    return true;
+}
+
+void machine_pool_release(machine_pool_t *pool){
+    if(pool->arena != NULL){
+        for(size_t slot = 0; slot < pool->capacity; slot++){
+            release_i8080(slot_cpu(pool, slot));
+        }
+    }
+    free_arena(pool->arena);
+    free(pool->free_slots);
+    pool->arena = NULL;
+    pool->free_slots = NULL;
+    pool->capacity = 0;
+    pool->free_count = 0;
+}
+
+i8080_t *machine_pool_acquire(machine_pool_t *pool){
+    i8080_t *cpu = NULL;
+    if(pool->free_count > 0){
+        cpu = slot_cpu(pool, pool->free_slots[--pool->free_count]);
+        reset_i8080(cpu);
+    }
+    return cpu;
+}
+
+void machine_pool_return(machine_pool_t *pool, i8080_t *cpu){
+    size_t slot;
+    if(cpu == NULL){
+        return;
+    }
+    slot = ((uint8_t*)cpu - pool->arena) / pool->slot_size;
+    // Deliver buffered output while the previous user's device contexts are still alive;
+    // everything else is cleared when the slot is next acquired
+    io_bus_release(&cpu->io);
+    pool->free_slots[pool->free_count++] = slot;
+}
+
+bool reset_to_image(i8080_t *cpu, const uint8_t *image, size_t size, uint16_t origin){
+    if(cpu == NULL || size > (size_t)(MEMORY_SIZE - origin)){
+        return false;
+    }
+    reset_i8080(cpu);
+    memcpy(cpu->memory + origin, image, size);
+    cpu->PC = origin;
+    return true;
+}
@@ -0,0 +1,33 @@
+//
+// Created by leonv on 5/14/2024.
+//
+
+#ifndef INTEL8080_I8080_POOL_H
+#define INTEL8080_I8080_POOL_H
+
+#include "i8080_cpu.h"
+
+#define CACHE_LINE_SIZE 64
+
+// Fixed set of machines carved out of one cache-line aligned arena. Each slot holds the CPU
+// state followed by its 64 KiB of memory. Slots are recycled; the arena is only returned to
+// the OS by machine_pool_release(). Not thread-safe: share out machines before starting threads.
+typedef struct {
+    uint8_t *arena;
+    size_t slot_size;
+    size_t capacity;
+    size_t *free_slots;
+    size_t free_count;
+} machine_pool_t;
+
+bool machine_pool_init(machine_pool_t *pool, size_t capacity);
+void machine_pool_release(machine_pool_t *pool);
+
+// Returns a machine in its power-on state, or NULL when every slot is in use
+i8080_t *machine_pool_acquire(machine_pool_t *pool);
+void machine_pool_return(machine_pool_t *pool, i8080_t *cpu);
+
+// reset_i8080() followed by loading `image` at `origin` and pointing PC at it
+bool reset_to_image(i8080_t *cpu, const uint8_t *image, size_t size, uint16_t origin);
+
+#endif //INTEL8080_I8080_POOL_H
@@ -0,0 +1,231 @@
+//
+// Created by leonv on 5/23/2024.
+//
+
+#include "i8080_profile.h"
+
+#ifdef I8080_PROFILE
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_INITIAL_NODES 256
+
+typedef struct {
+    uint16_t key; // Opcode, address or routine entry point
+    uint64_t count;
+    uint64_t cycles;
+} profile_row_t;
+
+profile_t *enable_profiler(i8080_t *cpu){
+    profile_t *profile;
+    if(cpu == NULL){
+        return NULL;
+    }
+    if(cpu->profile != NULL){
+        return cpu->profile;
+    }
+    profile = (profile_t*)calloc(1, sizeof(profile_t));
+    if(profile == NULL){
+        return NULL;
+    }
+    profile->nodes = (profile_node_t*)malloc(PROFILE_INITIAL_NODES * sizeof(profile_node_t));
+    if(profile->nodes == NULL){
+        free(profile);
+        return NULL;
+    }
+    profile->node_capacity = PROFILE_INITIAL_NODES;
+    reset_profile(profile);
+    cpu->profile = profile;
+    return profile;
+}
+
+void disable_profiler(i8080_t *cpu){
+    if(cpu != NULL && cpu->profile != NULL){
+        free(cpu->profile->nodes);
+        free(cpu->profile);
+        cpu->profile = NULL;
+    }
+}
+
+void reset_profile(profile_t *profile){
+    if(profile != NULL){
+        memset(profile->opcode_count, 0, sizeof(profile->opcode_count));
+        memset(profile->opcode_cycles, 0, sizeof(profile->opcode_cycles));
+        memset(profile->pc_count, 0, sizeof(profile->pc_count));
+        memset(profile->pc_cycles, 0, sizeof(profile->pc_cycles));
+        memset(&profile->nodes[0], 0, sizeof(profile_node_t));
+        profile->node_count = 1;
+        profile->current = 0;
+        profile->depth = 0;
+    }
+}
+
+// Callee of `parent` entered at `address`, created on first use. Returns `parent` itself when
+// the tree is full.
+static uint32_t child_node(profile_t *profile, uint32_t parent, uint16_t address){
+    uint32_t node = profile->nodes[parent].child;
+    while(node != 0){
+        if(profile->nodes[node].address == address){
+            return node;
+        }
+        node = profile->nodes[node].sibling;
+    }
+    if(profile->node_count == profile->node_capacity){
+        size_t capacity = profile->node_capacity * 2;
+        profile_node_t *nodes;
+        if(capacity > PROFILE_MAX_NODES){
+            return parent;
+        }
+        nodes = (profile_node_t*)realloc(profile->nodes, capacity * sizeof(profile_node_t));
+        if(nodes == NULL){
+            return parent;
+        }
+        profile->nodes = nodes;
+        profile->node_capacity = capacity;
+    }
+    node = (uint32_t)profile->node_count++;
+    profile->nodes[node].address = address;
+    profile->nodes[node].parent = parent;
+    profile->nodes[node].child = 0;
+    profile->nodes[node].sibling = profile->nodes[parent].child;
+    profile->nodes[node].calls = 0;
+    profile->nodes[node].cycles = 0;
+    profile->nodes[parent].child = node;
+    return node;
+}
+
+void profile_call(profile_t *profile, uint16_t address, uint16_t sp){
+    uint32_t node;
+    if(profile->depth == PROFILE_MAX_DEPTH){
+        return;
+    }
+    node = child_node(profile, profile->current, address);
+    profile->nodes[node].calls++;
+    profile->frames[profile->depth].node = node;
+    profile->frames[profile->depth].sp = sp;
+    profile->depth++;
+    profile->current = node;
+}
+
+void profile_return(profile_t *profile, uint16_t sp){
+    // A frame is still live while SP is below where it was before the call. Comparing the
+    // distance rather than the addresses copes with stacks that wrap around 0x0000, and popping
+    // every dead frame copes with code that discards return addresses instead of returning.
+    while(profile->depth > 0 && (int16_t)(profile->frames[profile->depth - 1].sp - sp) <= 0){
+        profile->depth--;
+    }
+    profile->current = profile->depth > 0 ? profile->frames[profile->depth - 1].node : 0;
+}
+
+static int compare_rows(const void *a, const void *b){
+    const profile_row_t *first = (const profile_row_t*)a;
+    const profile_row_t *second = (const profile_row_t*)b;
+    if(first->cycles != second->cycles){
+        return first->cycles < second->cycles ? 1 : -1;
+    }
+    return (int)first->key - (int)second->key;
+}
+
+// Gathers the non-empty counters into `rows`, hottest first. Returns the number of rows.
+static size_t collect_rows(profile_row_t *rows, const uint64_t *count, const uint64_t *cycles, size_t size){
+    size_t used = 0;
+    for(size_t i = 0; i < size; i++){
+        if(count[i] != 0){
+            rows[used].key = (uint16_t)i;
+            rows[used].count = count[i];
+            rows[used].cycles = cycles[i];
+            used++;
+        }
+    }
+    qsort(rows, used, sizeof(profile_row_t), compare_rows);
+    return used;
+}
+
+static double percent(uint64_t part, uint64_t total){
+    return total != 0 ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+bool write_profile(FILE *stream, const profile_t *profile, size_t top){
+    uint64_t instructions = 0, cycles = 0;
+    uint64_t *routine_calls, *routine_cycles;
+    profile_row_t *rows;
+    size_t used;
+
+    if(stream == NULL || profile == NULL){
+        return false;
+    }
+    rows = (profile_row_t*)malloc(MEMORY_SIZE * sizeof(profile_row_t));
+    routine_calls = (uint64_t*)calloc(MEMORY_SIZE, sizeof(uint64_t));
+    routine_cycles = (uint64_t*)calloc(MEMORY_SIZE, sizeof(uint64_t));
+    if(rows == NULL || routine_calls == NULL || routine_cycles == NULL){
+        free(rows);
+        free(routine_calls);
+        free(routine_cycles);
+        return false;
+    }
+
+    for(size_t i = 0; i < 256; i++){
+        instructions += profile->opcode_count[i];
+        cycles += profile->opcode_cycles[i];
+    }
+    fprintf(stream, "instructions: %llu\ncycles: %llu\n", (unsigned long long)instructions, (unsigned long long)cycles);
+
+    fprintf(stream, "\nopcode  executions        cycles   %%cycles\n");
+    used = collect_rows(rows, profile->opcode_count, profile->opcode_cycles, 256);
+    for(size_t i = 0; i < used; i++){
+        fprintf(stream, "0x%02X    %10llu  %12llu  %7.2f\n", rows[i].key, (unsigned long long)rows[i].count,
+                (unsigned long long)rows[i].cycles, percent(rows[i].cycles, cycles));
+    }
+
+    fprintf(stream, "\naddress executions        cycles   %%cycles\n");
+    used = collect_rows(rows, profile->pc_count, profile->pc_cycles, MEMORY_SIZE);
+    for(size_t i = 0; i < used && i < top; i++){
+        fprintf(stream, "0x%04X  %10llu  %12llu  %7.2f\n", rows[i].key, (unsigned long long)rows[i].count,
+                (unsigned long long)rows[i].cycles, percent(rows[i].cycles, cycles));
+    }
+
+    // Routines are summed over every path they were reached by
+    for(size_t i = 1; i < profile->node_count; i++){
+        routine_calls[profile->nodes[i].address] += profile->nodes[i].calls;
+        routine_cycles[profile->nodes[i].address] += profile->nodes[i].cycles;
+    }
+    fprintf(stream, "\nroutine      calls   self cycles   %%cycles\n");
+    fprintf(stream, "top     %10s  %12llu  %7.2f\n", "-", (unsigned long long)profile->nodes[0].cycles,
+            percent(profile->nodes[0].cycles, cycles));
+    used = collect_rows(rows, routine_calls, routine_cycles, MEMORY_SIZE);
+    for(size_t i = 0; i < used && i < top; i++){
+        fprintf(stream, "0x%04X  %10llu  %12llu  %7.2f\n", rows[i].key, (unsigned long long)rows[i].count,
+                (unsigned long long)rows[i].cycles, percent(rows[i].cycles, cycles));
+    }
+
+    free(rows);
+    free(routine_calls);
+    free(routine_cycles);
+    return !ferror(stream);
+}
+
+bool write_folded_stacks(FILE *stream, const profile_t *profile){
+    uint16_t path[PROFILE_MAX_DEPTH];
+
+    if(stream == NULL || profile == NULL){
+        return false;
+    }
+    for(size_t i = 0; i < profile->node_count; i++){
+        size_t depth = 0;
+        if(profile->nodes[i].cycles == 0){
+            continue;
+        }
+        for(uint32_t node = (uint32_t)i; node != 0; node = profile->nodes[node].parent){
+            path[depth++] = profile->nodes[node].address;
+        }
+        fputs("guest", stream);
+        while(depth > 0){
+            fprintf(stream, ";0x%04X", path[--depth]);
+        }
+        fprintf(stream, " %llu\n", (unsigned long long)profile->nodes[i].cycles);
+    }
+    return !ferror(stream);
+}
+
+#endif
@@ -0,0 +1,80 @@
+//
+// Created by leonv on 5/23/2024.
+//
+
+#ifndef INTEL8080_I8080_PROFILE_H
+#define INTEL8080_I8080_PROFILE_H
+
+#include <stdio.h>
+
+#include "i8080_cpu.h"
+
+// Guest profiler, only compiled in with I8080_PROFILE. While a profile is attached the core
+// counts executions and cycles per opcode and per PC, and follows CALL/RST/RET to build a call
+// tree of guest routines.
+
+#define PROFILE_MAX_DEPTH 256 // Tracked call depth; deeper calls are charged to the deepest frame
+#define PROFILE_MAX_NODES (1 << 20) // Call tree paths; further new paths are charged to their caller
+
+// One path through the call tree. Node 0 is the top level, outside any tracked call.
+typedef struct {
+    uint16_t address; // Entry point of the routine
+    uint32_t parent;
+    uint32_t child; // First callee, 0 for none
+    uint32_t sibling; // Next callee of the parent, 0 for none
+    uint64_t calls;
+    uint64_t cycles; // Spent in the routine itself, not in its callees
+} profile_node_t;
+
+typedef struct {
+    uint32_t node;
+    uint16_t sp; // SP before the call pushed its return address
+} profile_frame_t;
+
+typedef struct i8080_profile {
+    uint64_t opcode_count[256];
+    uint64_t opcode_cycles[256];
+    uint64_t pc_count[MEMORY_SIZE];
+    uint64_t pc_cycles[MEMORY_SIZE];
+
+    profile_node_t *nodes;
+    size_t node_count;
+    size_t node_capacity;
+    uint32_t current;
+    profile_frame_t frames[PROFILE_MAX_DEPTH];
+    size_t depth;
+} profile_t;
+
+// Attach a profile to the machine (or return the one already attached); NULL on allocation failure
+profile_t *enable_profiler(i8080_t *cpu);
+void disable_profiler(i8080_t *cpu);
+// Zero every counter and forget the call stack
+void reset_profile(profile_t *profile);
+
+// Enter the routine at `address`. `sp` is SP before the return address was pushed.
+void profile_call(profile_t *profile, uint16_t address, uint16_t sp);
+// Leave every routine whose frame lies at or below `sp`, i.e. that has returned
+void profile_return(profile_t *profile, uint16_t sp);
+
+// Called by the core after each instruction with the PC and SP it started with
+static inline void profile_instruction(profile_t *profile, const i8080_t *cpu, uint16_t pc, uint16_t sp,
+                                       uint8_t opcode, uint8_t cycles){
+    profile->opcode_count[opcode]++;
+    profile->opcode_cycles[opcode] += cycles;
+    profile->pc_count[pc]++;
+    profile->pc_cycles[pc] += cycles;
+    profile->nodes[profile->current].cycles += cycles;
+    if(cpu->SP == (uint16_t)(sp - 2) && ((opcode & 0xC7) == 0xC4 || (opcode & 0xCF) == 0xCD || (opcode & 0xC7) == 0xC7)){
+        profile_call(profile, cpu->PC, sp); // CALL, taken Ccc, RST
+    }
+    else if(cpu->SP == (uint16_t)(sp + 2) && ((opcode & 0xC7) == 0xC0 || (opcode & 0xEF) == 0xC9)){
+        profile_return(profile, cpu->SP); // RET, taken Rcc
+    }
+}
+
+// Text report: totals, opcodes and the `top` hottest addresses by cycles, and cycles per routine
+bool write_profile(FILE *stream, const profile_t *profile, size_t top);
+// One line per call path, "guest;0x0100;0x0A12 <cycles>", as read by flamegraph.pl and speedscope
+bool write_folded_stacks(FILE *stream, const profile_t *profile);
+
+#endif //INTEL8080_I8080_PROFILE_H
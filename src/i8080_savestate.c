@@ -0,0 +1,480 @@
+//
+// Created by leonv on 5/18/2024.
+//
+
+#include "i8080_savestate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADER_SIZE 28
+
+// Interrupt flags byte
+#define STATE_INTE 0x01
+#define STATE_EI_PENDING 0x02
+#define STATE_HALTED 0x04
+#define STATE_INTERRUPT_PENDING 0x08
+
+static void put16(uint8_t *out, uint16_t value){
+    out[0] = LOW_BYTE(value);
+    out[1] = HIGH_BYTE(value);
+}
+
+static uint16_t get16(const uint8_t *in){
+    return TO16BIT(in[1], in[0]);
+}
+
+static void put32(uint8_t *out, uint32_t value){
+    for(int i = 0; i < 4; i++){
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint32_t get32(const uint8_t *in){
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static void put64(uint8_t *out, uint64_t value){
+    for(int i = 0; i < 8; i++){
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint64_t get64(const uint8_t *in){
+    uint64_t value = 0;
+    for(int i = 7; i >= 0; i--){
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+bool register_device(i8080_t *cpu, uint32_t id, device_save_fn save, device_load_fn load, event_fn event, void *context){
+    state_device_t *devices;
+
+    if(cpu == NULL || save == NULL || load == NULL){
+        return false;
+    }
+    for(size_t i = 0; i < cpu->device_count; i++){
+        if(cpu->devices[i].id == id){
+            return false;
+        }
+    }
+    devices = (state_device_t*)realloc(cpu->devices, (cpu->device_count + 1) * sizeof(state_device_t));
+    if(devices == NULL){
+        return false;
+    }
+    devices[cpu->device_count++] = (state_device_t){ id, save, load, event, context };
+    cpu->devices = devices;
+    return true;
+}
+
+void unregister_device(i8080_t *cpu, uint32_t id){
+    for(size_t i = 0; cpu != NULL && i < cpu->device_count; i++){
+        if(cpu->devices[i].id == id){
+            cpu->device_count--;
+            memmove(&cpu->devices[i], &cpu->devices[i + 1], (cpu->device_count - i) * sizeof(state_device_t));
+            return;
+        }
+    }
+}
+
+static const state_device_t *find_device(const i8080_t *cpu, uint32_t id){
+    for(size_t i = 0; i < cpu->device_count; i++){
+        if(cpu->devices[i].id == id){
+            return &cpu->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static const state_device_t *event_owner(const i8080_t *cpu, const event_t *event){
+    for(size_t i = 0; i < cpu->device_count; i++){
+        if(cpu->devices[i].event == event->fn && cpu->devices[i].context == event->context){
+            return &cpu->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static int compare_events(const void *a, const void *b){
+    const event_t *first = (const event_t*)a;
+    const event_t *second = (const event_t*)b;
+    if(first->when != second->when){
+        return first->when < second->when ? -1 : 1;
+    }
+    return first->sequence < second->sequence ? -1 : first->sequence > second->sequence;
+}
+
+// Lays out the event and device sections of a record, so checkpoints can be written long after
+// the machine has moved on
+static bool capture_devices(i8080_t *cpu, i8080_snapshot_t *snapshot){
+    const scheduler_t *scheduler = &cpu->scheduler;
+    event_t *events = NULL;
+    size_t count = 0;
+    uint8_t *out;
+
+    if(cpu->device_count > UINT16_MAX){
+        return false;
+    }
+    snapshot->devices = (uint8_t*)malloc(4 + scheduler->count * 12 + cpu->device_count * (6 + SAVESTATE_DEVICE_MAX));
+    if(snapshot->devices == NULL){
+        return false;
+    }
+    if(scheduler->count > 0){
+        events = (event_t*)malloc(scheduler->count * sizeof(event_t));
+        if(events == NULL){
+            return false;
+        }
+    }
+    // The heap is only partly ordered; sorting keeps same-cycle events in the order they fire
+    for(size_t i = 0; i < scheduler->count; i++){
+        if(event_owner(cpu, &scheduler->events[i]) != NULL){
+            events[count++] = scheduler->events[i];
+        }
+    }
+    if(count > UINT16_MAX){
+        free(events);
+        return false;
+    }
+    qsort(events, count, sizeof(event_t), compare_events);
+
+    out = snapshot->devices;
+    put16(out, (uint16_t)count);
+    out += 2;
+    for(size_t i = 0; i < count; i++){
+        put32(out, event_owner(cpu, &events[i])->id);
+        put64(out + 4, events[i].when);
+        out += 12;
+    }
+    free(events);
+
+    put16(out, (uint16_t)cpu->device_count);
+    out += 2;
+    for(size_t i = 0; i < cpu->device_count; i++){
+        const state_device_t *device = &cpu->devices[i];
+        size_t size = device->save(device->context, out + 6, SAVESTATE_DEVICE_MAX);
+        if(size > SAVESTATE_DEVICE_MAX){
+            return false;
+        }
+        put32(out, device->id);
+        put16(out + 4, (uint16_t)size);
+        out += 6 + size;
+    }
+    snapshot->devices_size = (size_t)(out - snapshot->devices);
+    return true;
+}
+
+i8080_snapshot_t *capture_state(i8080_t *cpu){
+    i8080_snapshot_t *snapshot;
+
+    if(cpu == NULL){
+        return NULL;
+    }
+    io_bus_flush(&cpu->io);
+    snapshot = snapshot_i8080(cpu);
+    if(snapshot != NULL && !capture_devices(cpu, snapshot)){
+        release_snapshot(snapshot);
+        snapshot = NULL;
+    }
+    return snapshot;
+}
+
+static bool changed(const i8080_snapshot_t *snapshot, const i8080_snapshot_t *previous, int page){
+    // Snapshots share every page that was not written in between, so comparing the page
+    // pointers is enough to find the dirty ones
+    return snapshot->pages[page] != NULL && (previous == NULL || snapshot->pages[page] != previous->pages[page]);
+}
+
+bool write_state(FILE *stream, const i8080_snapshot_t *snapshot, const i8080_snapshot_t *previous){
+    uint8_t header[HEADER_SIZE];
+    uint16_t count = 0;
+
+    if(stream == NULL || snapshot == NULL){
+        return false;
+    }
+    for(int page = 0; page < PAGE_COUNT; page++){
+        count += changed(snapshot, previous, page);
+    }
+
+    memcpy(header, SAVESTATE_MAGIC, 4);
+    header[4] = SAVESTATE_VERSION;
+    header[5] = previous != NULL ? SAVESTATE_DELTA : SAVESTATE_FULL;
+    header[6] = snapshot->A;
+    header[7] = snapshot->F;
+    header[8] = snapshot->B;
+    header[9] = snapshot->C;
+    header[10] = snapshot->D;
+    header[11] = snapshot->E;
+    header[12] = snapshot->H;
+    header[13] = snapshot->L;
+    header[14] = (snapshot->interrupts_enabled ? STATE_INTE : 0) |
+                 (snapshot->ei_pending ? STATE_EI_PENDING : 0) |
+                 (snapshot->halted ? STATE_HALTED : 0) |
+                 (snapshot->interrupt_pending ? STATE_INTERRUPT_PENDING : 0);
+    header[15] = snapshot->interrupt_opcode;
+    put16(&header[16], snapshot->SP);
+    put16(&header[18], snapshot->PC);
+    put64(&header[20], snapshot->cycles);
+    if(fwrite(header, HEADER_SIZE, 1, stream) != 1){
+        return false;
+    }
+    put16(header, count);
+    if(fwrite(header, 2, 1, stream) != 1){
+        return false;
+    }
+
+    for(int page = 0; page < PAGE_COUNT; page++){
+        if(changed(snapshot, previous, page)){
+            uint8_t number = (uint8_t)page;
+            if(fwrite(&number, 1, 1, stream) != 1 || fwrite(snapshot->pages[page], PAGE_SIZE, 1, stream) != 1){
+                return false;
+            }
+        }
+    }
+
+    if(snapshot->devices == NULL){
+        memset(header, 0, 4);
+        return fwrite(header, 4, 1, stream) == 1;
+    }
+    return fwrite(snapshot->devices, snapshot->devices_size, 1, stream) == 1;
+}
+
+static bool read_devices(FILE *stream, i8080_t *cpu){
+    uint8_t buffer[SAVESTATE_DEVICE_MAX];
+    uint16_t count;
+
+    if(fread(buffer, 2, 1, stream) != 1){
+        return false;
+    }
+    count = get16(buffer);
+    for(size_t i = 0; i < cpu->device_count; i++){
+        if(cpu->devices[i].event != NULL){
+            cancel_event(cpu, cpu->devices[i].event, cpu->devices[i].context);
+        }
+    }
+    for(uint16_t i = 0; i < count; i++){
+        const state_device_t *device;
+        if(fread(buffer, 12, 1, stream) != 1){
+            return false;
+        }
+        device = find_device(cpu, get32(buffer));
+        if(device != NULL && device->event != NULL &&
+           !schedule_event(cpu, get64(&buffer[4]), device->event, device->context)){
+            return false;
+        }
+    }
+
+    if(fread(buffer, 2, 1, stream) != 1){
+        return false;
+    }
+    count = get16(buffer);
+    for(uint16_t i = 0; i < count; i++){
+        const state_device_t *device;
+        uint16_t size;
+        if(fread(buffer, 6, 1, stream) != 1){
+            return false;
+        }
+        device = find_device(cpu, get32(buffer));
+        size = get16(&buffer[4]);
+        if(size > SAVESTATE_DEVICE_MAX || (size > 0 && fread(buffer, size, 1, stream) != 1)){
+            return false;
+        }
+        if(device != NULL && !device->load(device->context, buffer, size)){
+            return false;
+        }
+    }
+    return true;
+}
+
+state_read_t read_state(FILE *stream, i8080_t *cpu){
+    uint8_t header[HEADER_SIZE];
+    uint16_t count;
+    size_t got;
+
+    if(stream == NULL || cpu == NULL){
+        return STATE_MALFORMED;
+    }
+    // Only running out before the first byte of a record is the end of the stream
+    got = fread(header, 1, HEADER_SIZE, stream);
+    if(got == 0 && feof(stream)){
+        return STATE_END;
+    }
+    if(got != HEADER_SIZE){
+        return STATE_MALFORMED;
+    }
+    if(memcmp(header, SAVESTATE_MAGIC, 4) != 0 || header[4] != SAVESTATE_VERSION ||
+       (header[5] != SAVESTATE_FULL && header[5] != SAVESTATE_DELTA)){
+        return STATE_MALFORMED;
+    }
+    cpu->A = header[6];
+    cpu->F = header[7];
+    CLEAR_PENDING_FLAGS(cpu);
+    cpu->B = header[8];
+    cpu->C = header[9];
+    cpu->D = header[10];
+    cpu->E = header[11];
+    cpu->H = header[12];
+    cpu->L = header[13];
+    cpu->interrupts_enabled = (header[14] & STATE_INTE) != 0;
+    cpu->ei_pending = (header[14] & STATE_EI_PENDING) != 0;
+    cpu->halted = (header[14] & STATE_HALTED) != 0;
+    cpu->interrupt_pending = (header[14] & STATE_INTERRUPT_PENDING) != 0;
+    cpu->interrupt_opcode = header[15];
+    cpu->SP = get16(&header[16]);
+    cpu->PC = get16(&header[18]);
+    cpu->cycles = get64(&header[20]);
+    cpu->deadline = 0;
+
+    if(fread(header, 2, 1, stream) != 1){
+        return STATE_MALFORMED;
+    }
+    count = get16(header);
+    if(count > PAGE_COUNT){
+        return STATE_MALFORMED;
+    }
+    for(uint16_t i = 0; i < count; i++){
+        uint8_t page;
+        uint8_t *backing;
+        if(fread(&page, 1, 1, stream) != 1){
+            return STATE_MALFORMED;
+        }
+        if(memory_map_is_ram(&cpu->map, page)){
+            // Take the page back from any snapshot it is shared with before overwriting it
+            backing = cpu->memory + page * PAGE_SIZE;
+            memory_map_ram(&cpu->map, page * PAGE_SIZE, PAGE_SIZE, backing);
+            if(fread(backing, PAGE_SIZE, 1, stream) != 1){
+                return STATE_MALFORMED;
+            }
+        }
+        else if(fseek(stream, PAGE_SIZE, SEEK_CUR) != 0){
+            return STATE_MALFORMED;
+        }
+    }
+    return read_devices(stream, cpu) ? STATE_APPLIED : STATE_MALFORMED;
+}
+
+bool save_state(i8080_t *cpu, const char *path){
+    i8080_snapshot_t *snapshot = capture_state(cpu);
+    FILE *stream;
+    bool saved = false;
+
+    if(snapshot == NULL){
+        return false;
+    }
+    stream = fopen(path, "wb");
+    if(stream != NULL){
+        saved = write_state(stream, snapshot, NULL);
+        saved = fclose(stream) == 0 && saved;
+    }
+    release_snapshot(snapshot);
+    return saved;
+}
+
+bool load_state(i8080_t *cpu, const char *path){
+    FILE *stream = fopen(path, "rb");
+    size_t records = 0;
+    state_read_t status;
+
+    if(stream == NULL){
+        return false;
+    }
+    while((status = read_state(stream, cpu)) == STATE_APPLIED){
+        records++;
+    }
+    fclose(stream);
+    return records > 0 && status == STATE_END;
+}
+
+static void *checkpoint_thread(void *argument){
+    checkpoint_writer_t *writer = (checkpoint_writer_t*)argument;
+
+    pthread_mutex_lock(&writer->lock);
+    for(;;){
+        while(writer->pending == NULL && !writer->closing){
+            pthread_cond_wait(&writer->ready, &writer->lock);
+        }
+        if(writer->pending == NULL){
+            break;
+        }
+        i8080_snapshot_t *snapshot = writer->pending;
+        writer->pending = NULL;
+        pthread_mutex_unlock(&writer->lock);
+
+        // Snapshots are immutable, so this runs alongside the machine without holding the lock
+        bool written = write_state(writer->stream, snapshot, writer->written) && fflush(writer->stream) == 0;
+        release_snapshot(writer->written);
+        writer->written = snapshot;
+
+        pthread_mutex_lock(&writer->lock);
+        writer->records += written;
+        writer->failed |= !written;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+bool checkpoint_writer_open(checkpoint_writer_t *writer, const char *path){
+    writer->stream = fopen(path, "wb");
+    if(writer->stream == NULL){
+        return false;
+    }
+    writer->pending = NULL;
+    writer->written = NULL;
+    writer->records = 0;
+    writer->dropped = 0;
+    writer->closing = false;
+    writer->failed = false;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->ready, NULL);
+    if(pthread_create(&writer->thread, NULL, checkpoint_thread, writer) != 0){
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->ready);
+        fclose(writer->stream);
+        writer->stream = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool checkpoint(checkpoint_writer_t *writer, i8080_t *cpu){
+    i8080_snapshot_t *snapshot = capture_state(cpu);
+    i8080_snapshot_t *stale;
+    bool failed;
+
+    if(snapshot == NULL){
+        return false;
+    }
+    pthread_mutex_lock(&writer->lock);
+    // Deltas are taken against the last record written, so an unwritten checkpoint can be
+    // replaced without breaking the stream
+    stale = writer->pending;
+    writer->pending = snapshot;
+    writer->dropped += stale != NULL;
+    failed = writer->failed;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+
+    release_snapshot(stale);
+    return !failed;
+}
+
+bool checkpoint_writer_close(checkpoint_writer_t *writer){
+    bool closed;
+
+    if(writer->stream == NULL){
+        return false;
+    }
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = true;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    release_snapshot(writer->written);
+    writer->written = NULL;
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->ready);
+    closed = fclose(writer->stream) == 0 && !writer->failed;
+    writer->stream = NULL;
+    return closed;
+}
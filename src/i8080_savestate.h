@@ -0,0 +1,111 @@
+//
+// Created by leonv on 5/18/2024.
+//
+
+#ifndef INTEL8080_I8080_SAVESTATE_H
+#define INTEL8080_I8080_SAVESTATE_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "i8080_snapshot.h"
+
+// A save-state stream is a sequence of records, each one machine state:
+//
+//   "I80S"  magic
+//   u8      format version (SAVESTATE_VERSION)
+//   u8      SAVESTATE_FULL or SAVESTATE_DELTA
+//   u8[10]  A F B C D E H L, then the interrupt flags and RST opcode
+//   u16     SP, PC
+//   u64     cycles
+//   u16     number of pages that follow
+//   pages   u8 page number, then its 256 bytes
+//   u16     number of events that follow
+//   events  u32 device id, then the u64 cycle the event is due
+//   u16     number of devices that follow
+//   devices u32 device id, u16 size, then that many bytes of device state
+//
+// Multi-byte fields are little-endian. A full record holds every RAM page. A delta record
+// only holds the pages that changed since the record before it, so it is only meaningful
+// when replayed on top of the stream up to that point. Events and device state are always
+// written in full. ROM/MMIO pages, ports, and events or state of devices that did not register
+// belong to the host and are not saved; buffered port output is flushed when the state is
+// captured.
+#define SAVESTATE_MAGIC "I80S"
+#define SAVESTATE_VERSION 2
+#define SAVESTATE_FULL 0
+#define SAVESTATE_DELTA 1
+#define SAVESTATE_DEVICE_MAX 4096 // Largest state a device may save
+
+// Devices with state of their own (timers, UARTs, ...) register hooks so it is saved with the
+// machine. `save` writes the state to `out` and returns its size, at most `capacity`; `load`
+// is handed the same bytes back and returns false if it cannot use them. Events scheduled with
+// `event` as the callback and `context` as its context are saved with the cycle they are due
+// and rescheduled on load; `event` may be NULL for a device without events. The id names the
+// device in the stream, so it has to stay the same from one run to the next.
+typedef size_t (*device_save_fn)(void *context, uint8_t *out, size_t capacity);
+typedef bool (*device_load_fn)(void *context, const uint8_t *in, size_t size);
+
+typedef struct state_device {
+    uint32_t id;
+    device_save_fn save;
+    device_load_fn load;
+    event_fn event;
+    void *context;
+} state_device_t;
+
+// Returns false if the id is taken or out of memory. Devices are dropped by reset_i8080().
+bool register_device(i8080_t *cpu, uint32_t id, device_save_fn save, device_load_fn load, event_fn event, void *context);
+void unregister_device(i8080_t *cpu, uint32_t id);
+
+// Snapshot the machine together with its events and registered devices, ready for
+// write_state(). Returns NULL when out of memory or a device's state is too large.
+i8080_snapshot_t *capture_state(i8080_t *cpu);
+
+// Append one record for `snapshot`: a delta against `previous`, or a full record when it is
+// NULL. `previous` has to be an earlier snapshot of the same machine for the delta to be small.
+// A snapshot not taken by capture_state() is written without events or devices.
+bool write_state(FILE *stream, const i8080_snapshot_t *snapshot, const i8080_snapshot_t *previous);
+typedef enum {
+    STATE_APPLIED, // A whole record was read and applied
+    STATE_END, // The stream ended where a record would start
+    STATE_MALFORMED // Truncated or corrupt record; the machine may have been partly updated
+} state_read_t;
+
+// Read the next record and apply it to the machine. The events of registered devices are
+// replaced by the record's, and each device in the record that is registered gets its state
+// back; devices the machine does not know are skipped.
+state_read_t read_state(FILE *stream, i8080_t *cpu);
+
+// Single full state in a file of its own. Saving rebases the machine onto a snapshot
+// (see snapshot_i8080()).
+bool save_state(i8080_t *cpu, const char *path);
+// Replays every record in the file. Fails if any record, the last one included, is truncated
+// or corrupt.
+bool load_state(i8080_t *cpu, const char *path);
+
+// Streams checkpoints of a running machine to a file from a background thread. Taking a
+// checkpoint only captures the machine; the writer turns it into a delta against the last
+// record it wrote. If the writer falls behind, older pending checkpoints are dropped in favour
+// of the newest, so the emulator never waits on the disk.
+typedef struct {
+    FILE *stream;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    i8080_snapshot_t *pending; // Newest checkpoint not yet picked up by the writer
+    i8080_snapshot_t *written; // Last snapshot written, the base for the next delta
+    size_t records;
+    size_t dropped;
+    bool closing;
+    bool failed;
+} checkpoint_writer_t;
+
+bool checkpoint_writer_open(checkpoint_writer_t *writer, const char *path);
+// Returns false if the machine could not be snapshotted or an earlier write failed
+bool checkpoint(checkpoint_writer_t *writer, i8080_t *cpu);
+// Writes out the last pending checkpoint, then stops the thread and closes the file.
+// Returns false if any write failed.
+bool checkpoint_writer_close(checkpoint_writer_t *writer);
+
+#endif //INTEL8080_I8080_SAVESTATE_H
@@ -0,0 +1,114 @@
+//
+// Created by leonv on 5/7/2024.
+//
+
+#include "i8080_scheduler.h"
+
+#include <stdlib.h>
+
+static bool earlier(const event_t *a, const event_t *b){
+    return a->when < b->when || (a->when == b->when && a->sequence < b->sequence);
+}
+
+static void sift_up(scheduler_t *scheduler, size_t index){
+    event_t *events = scheduler->events;
+    event_t event = events[index];
+    while(index > 0){
+        size_t parent = (index - 1) / 2;
+        if(!earlier(&event, &events[parent])){
+            break;
+        }
+        events[index] = events[parent];
+        index = parent;
+    }
+    events[index] = event;
+}
+
+static void sift_down(scheduler_t *scheduler, size_t index){
+    event_t *events = scheduler->events;
+    event_t event = events[index];
+    for(;;){
+        size_t child = index * 2 + 1;
+        if(child >= scheduler->count){
+            break;
+        }
+        if(child + 1 < scheduler->count && earlier(&events[child + 1], &events[child])){
+            child++;
+        }
+        if(!earlier(&events[child], &event)){
+            break;
+        }
+        events[index] = events[child];
+        index = child;
+    }
+    events[index] = event;
+}
+
+static void remove_at(scheduler_t *scheduler, size_t index){
+    scheduler->count--;
+    if(index < scheduler->count){
+        scheduler->events[index] = scheduler->events[scheduler->count];
+        sift_down(scheduler, index);
+        sift_up(scheduler, index);
+    }
+}
+
+void scheduler_init(scheduler_t *scheduler){
+    scheduler->events = NULL;
+    scheduler->count = 0;
+    scheduler->capacity = 0;
+    scheduler->sequence = 0;
+}
+
+void scheduler_release(scheduler_t *scheduler){
+    free(scheduler->events);
+    scheduler_init(scheduler);
+}
+
+bool scheduler_push(scheduler_t *scheduler, uint64_t when, event_fn fn, void *context){
+    if(fn == NULL){
+        return false;
+    }
+    if(scheduler->count == scheduler->capacity){
+        size_t capacity = scheduler->capacity > 0 ? scheduler->capacity * 2 : 16;
+        event_t *events = (event_t*)realloc(scheduler->events, capacity * sizeof(event_t));
+        if(events == NULL){
+            return false;
+        }
+        scheduler->events = events;
+        scheduler->capacity = capacity;
+    }
+    scheduler->events[scheduler->count] = (event_t){ when, scheduler->sequence++, fn, context };
+    scheduler->count++;
+    sift_up(scheduler, scheduler->count - 1);
+    return true;
+}
+
+size_t scheduler_cancel(scheduler_t *scheduler, event_fn fn, void *context){
+    size_t kept = 0;
+    size_t removed = 0;
+    for(size_t index = 0; index < scheduler->count; index++){
+        if(scheduler->events[index].fn == fn && scheduler->events[index].context == context){
+            removed++;
+        }
+        else{
+            scheduler->events[kept++] = scheduler->events[index];
+        }
+    }
+    scheduler->count = kept;
+    if(removed > 0){
+        for(size_t index = kept / 2; index-- > 0;){
+            sift_down(scheduler, index);
+        }
+    }
+    return removed;
+}
+
+bool scheduler_pop_due(scheduler_t *scheduler, uint64_t now, event_t *event){
+    if(scheduler->count == 0 || scheduler->events[0].when > now){
+        return false;
+    }
+    *event = scheduler->events[0];
+    remove_at(scheduler, 0);
+    return true;
+}
@@ -0,0 +1,46 @@
+//
+// Created by leonv on 5/7/2024.
+//
+
+#ifndef INTEL8080_I8080_SCHEDULER_H
+#define INTEL8080_I8080_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SCHEDULER_IDLE UINT64_MAX // scheduler_next() of an empty scheduler
+
+// `when` is the cycle the event was scheduled for, so periodic devices can reschedule
+// relative to it without accumulating drift.
+typedef void (*event_fn)(void *context, uint64_t when);
+
+typedef struct {
+    uint64_t when;
+    uint64_t sequence; // Keeps events scheduled for the same cycle in FIFO order
+    event_fn fn;
+    void *context;
+} event_t;
+
+// Binary min-heap of events ordered by (when, sequence)
+typedef struct {
+    event_t *events;
+    size_t count;
+    size_t capacity;
+    uint64_t sequence;
+} scheduler_t;
+
+void scheduler_init(scheduler_t *scheduler);
+void scheduler_release(scheduler_t *scheduler);
+
+bool scheduler_push(scheduler_t *scheduler, uint64_t when, event_fn fn, void *context);
+// Removes every event matching fn and context. Returns the number removed.
+size_t scheduler_cancel(scheduler_t *scheduler, event_fn fn, void *context);
+// Removes the earliest event into `event` if it is due at or before `now`.
+bool scheduler_pop_due(scheduler_t *scheduler, uint64_t now, event_t *event);
+
+static inline uint64_t scheduler_next(const scheduler_t *scheduler){
+    return scheduler->count > 0 ? scheduler->events[0].when : SCHEDULER_IDLE;
+}
+
+#endif //INTEL8080_I8080_SCHEDULER_H
@@ -0,0 +1,162 @@
+//
+// Created by leonv on 5/16/2024.
+//
+
+#include "i8080_snapshot.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Attributes that say nothing about who owns the page's contents
+#define PAGE_TRANSPARENT (PAGE_CODE | PAGE_WATCH)
+
+// A page copied out of a machine. Every snapshot holding it and every machine sharing it (via
+// its base snapshot) counts as one reference; snapshot pages[] entries point at `data`.
+typedef struct {
+    atomic_size_t references;
+    uint8_t data[PAGE_SIZE];
+} snapshot_page_t;
+
+static snapshot_page_t *page_of(const uint8_t *data){
+    return (snapshot_page_t*)(data - offsetof(snapshot_page_t, data));
+}
+
+static void release_page(const uint8_t *data){
+    snapshot_page_t *page = page_of(data);
+    if(atomic_fetch_sub_explicit(&page->references, 1, memory_order_acq_rel) == 1){
+        free(page);
+    }
+}
+
+static bool is_shared(const i8080_t *cpu, uint8_t page){
+    return (cpu->map.attributes[page] & ~PAGE_TRANSPARENT) == PAGE_SHARED;
+}
+
+static bool is_dirty(const i8080_t *cpu, uint8_t page){
+    return (cpu->map.attributes[page] & ~PAGE_TRANSPARENT) == 0 && memory_map_is_ram(&cpu->map, page);
+}
+
+i8080_snapshot_t *snapshot_i8080(i8080_t *cpu){
+    i8080_snapshot_t *snapshot;
+
+    if(cpu == NULL){
+        return NULL;
+    }
+    snapshot = (i8080_snapshot_t*)calloc(1, sizeof(i8080_snapshot_t));
+    if(snapshot == NULL){
+        return NULL;
+    }
+    atomic_init(&snapshot->references, 1);
+    for(int page = 0; page < PAGE_COUNT; page++){
+        if(is_dirty(cpu, page)){
+            snapshot_page_t *copy = (snapshot_page_t*)malloc(sizeof(snapshot_page_t));
+            if(copy == NULL){
+                release_snapshot(snapshot);
+                return NULL;
+            }
+            atomic_init(&copy->references, 1);
+            memcpy(copy->data, memory_map_page(&cpu->map, page), PAGE_SIZE);
+            snapshot->pages[page] = copy->data;
+        }
+        else if(is_shared(cpu, page)){
+            // Copied by an earlier snapshot and not written since; this one holds it too
+            snapshot->pages[page] = memory_map_page(&cpu->map, page);
+            atomic_fetch_add_explicit(&page_of(snapshot->pages[page])->references, 1, memory_order_relaxed);
+        }
+    }
+
+    SYNC_FLAGS(cpu);
+    snapshot->PSW = cpu->PSW;
+    snapshot->BC = cpu->BC;
+    snapshot->DE = cpu->DE;
+    snapshot->HL = cpu->HL;
+    snapshot->SP = cpu->SP;
+    snapshot->PC = cpu->PC;
+    snapshot->interrupts_enabled = cpu->interrupts_enabled;
+    snapshot->ei_pending = cpu->ei_pending;
+    snapshot->halted = cpu->halted;
+    snapshot->interrupt_pending = cpu->interrupt_pending;
+    snapshot->interrupt_opcode = cpu->interrupt_opcode;
+    snapshot->cycles = cpu->cycles;
+
+    restore_i8080(cpu, snapshot);
+    return snapshot;
+}
+
+bool restore_i8080(i8080_t *cpu, i8080_snapshot_t *snapshot){
+    if(cpu == NULL || snapshot == NULL){
+        return false;
+    }
+    cpu->PSW = snapshot->PSW;
+    CLEAR_PENDING_FLAGS(cpu);
+    cpu->BC = snapshot->BC;
+    cpu->DE = snapshot->DE;
+    cpu->HL = snapshot->HL;
+    cpu->SP = snapshot->SP;
+    cpu->PC = snapshot->PC;
+    cpu->interrupts_enabled = snapshot->interrupts_enabled;
+    cpu->ei_pending = snapshot->ei_pending;
+    cpu->halted = snapshot->halted;
+    cpu->interrupt_pending = snapshot->interrupt_pending;
+    cpu->interrupt_opcode = snapshot->interrupt_opcode;
+    cpu->cycles = snapshot->cycles;
+    cpu->deadline = 0;
+
+    for(int page = 0; page < PAGE_COUNT; page++){
+        // Pages untouched since they were last shared are left alone, which keeps restoring
+        // cheap and leaves any code decoded from them cached
+        if(snapshot->pages[page] != NULL && memory_map_page(&cpu->map, page) != snapshot->pages[page] &&
+           memory_map_is_ram(&cpu->map, page)){
+            memory_map_share(&cpu->map, page, snapshot->pages[page]);
+        }
+        else if(snapshot->pages[page] == NULL && is_shared(cpu, page)){
+            // Only the base about to be released holds this page, so take it back into RAM
+            uint8_t *backing = cpu->map.ram + page * PAGE_SIZE;
+            memcpy(backing, memory_map_page(&cpu->map, page), PAGE_SIZE);
+            memory_map_ram(&cpu->map, page * PAGE_SIZE, PAGE_SIZE, backing);
+        }
+    }
+    // Retain first: the machine may already be based on this snapshot
+    retain_snapshot(snapshot);
+    release_snapshot(cpu->base);
+    cpu->base = snapshot;
+    return true;
+}
+
+i8080_t *fork_i8080(i8080_t *cpu){
+    i8080_snapshot_t *snapshot;
+    i8080_t *fork;
+
+    if(cpu == NULL){
+        return NULL;
+    }
+    fork = init_i8080();
+    snapshot = snapshot_i8080(cpu);
+    if(fork == NULL || snapshot == NULL){
+        destroy_i8080(fork);
+        release_snapshot(snapshot);
+        return NULL;
+    }
+    restore_i8080(fork, snapshot);
+    release_snapshot(snapshot); // Both machines now hold it
+    return fork;
+}
+
+void retain_snapshot(i8080_snapshot_t *snapshot){
+    if(snapshot != NULL){
+        atomic_fetch_add_explicit(&snapshot->references, 1, memory_order_relaxed);
+    }
+}
+
+void release_snapshot(i8080_snapshot_t *snapshot){
+    if(snapshot != NULL && atomic_fetch_sub_explicit(&snapshot->references, 1, memory_order_acq_rel) == 1){
+        for(int page = 0; page < PAGE_COUNT; page++){
+            if(snapshot->pages[page] != NULL){
+                release_page(snapshot->pages[page]);
+            }
+        }
+        free(snapshot->devices);
+        free(snapshot);
+    }
+}
@@ -0,0 +1,57 @@
+//
+// Created by leonv on 5/16/2024.
+//
+
+#ifndef INTEL8080_I8080_SNAPSHOT_H
+#define INTEL8080_I8080_SNAPSHOT_H
+
+#include "i8080_cpu.h"
+
+#include <stdatomic.h>
+
+// Immutable copy of a machine's registers and RAM. Pages that were still shared with an older
+// snapshot when this one was taken are referenced rather than copied, so a snapshot only costs
+// the pages written since the machine was last snapshotted or restored. Snapshots and each of
+// their pages are reference counted, so a snapshot keeps alive the pages it holds and nothing
+// of the snapshots it was taken after. They may be restored from several threads at once.
+//
+// ROM, MMIO and mirrored pages are not part of a snapshot, and neither are scheduled events or
+// registered ports: those belong to whoever set up the machine. Save states add the state of
+// devices registered with register_device() (see i8080_savestate.h).
+typedef struct i8080_snapshot {
+    atomic_size_t references;
+
+    REGISTER_PAIR(A, F, PSW);
+    REGISTER_PAIR(B, C, BC);
+    REGISTER_PAIR(D, E, DE);
+    REGISTER_PAIR(H, L, HL);
+    uint16_t SP;
+    uint16_t PC;
+    bool interrupts_enabled;
+    bool ei_pending;
+    bool halted;
+    bool interrupt_pending;
+    uint8_t interrupt_opcode;
+    uint64_t cycles;
+
+    const uint8_t *pages[PAGE_COUNT]; // NULL for pages outside the snapshot, see snapshot_page_t
+    uint8_t *devices; // Event and device sections of a save state, NULL unless taken for one
+    size_t devices_size;
+} i8080_snapshot_t;
+
+// Snapshot the machine and rebase it onto the snapshot, so its RAM becomes copy-on-write and
+// the next snapshot only copies what changed in between. Returns NULL when out of memory.
+i8080_snapshot_t *snapshot_i8080(i8080_t *cpu);
+
+// Put the machine in the snapshotted state. Its RAM pages are shared with the snapshot until
+// written; its devices, events and non-RAM pages are left as they are.
+bool restore_i8080(i8080_t *cpu, i8080_snapshot_t *snapshot);
+
+// New machine in the same state as `cpu`, sharing all of its RAM. Ports and events are not
+// carried over. Release with destroy_i8080().
+i8080_t *fork_i8080(i8080_t *cpu);
+
+void retain_snapshot(i8080_snapshot_t *snapshot);
+void release_snapshot(i8080_snapshot_t *snapshot);
+
+#endif //INTEL8080_I8080_SNAPSHOT_H
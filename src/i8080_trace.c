@@ -0,0 +1,294 @@
+//
+// Created by leonv on 5/29/2024.
+//
+
+#include "i8080_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void put16(uint8_t *out, uint16_t value){
+    out[0] = LOW_BYTE(value);
+    out[1] = HIGH_BYTE(value);
+}
+
+static uint16_t get16(const uint8_t *in){
+    return TO16BIT(in[1], in[0]);
+}
+
+static void put32(uint8_t *out, uint32_t value){
+    put16(out, value & 0xFFFF);
+    put16(out + 2, value >> 16);
+}
+
+static uint32_t get32(const uint8_t *in){
+    return get16(in) | ((uint32_t)get16(in + 2) << 16);
+}
+
+static void pack(uint8_t *out, const trace_record_t *record){
+    put16(out, record->pc);
+    out[2] = record->opcode;
+    out[3] = record->flags;
+    put16(out + 4, record->write_address);
+    out[6] = record->written[0];
+    out[7] = record->written[1];
+    put16(out + 8, record->psw);
+    put16(out + 10, record->bc);
+    put16(out + 12, record->de);
+    put16(out + 14, record->hl);
+    put16(out + 16, record->sp);
+    put32(out + 18, record->cycles);
+    put16(out + 22, 0);
+}
+
+static void unpack(const uint8_t *in, trace_record_t *record){
+    record->pc = get16(in);
+    record->opcode = in[2];
+    record->flags = in[3];
+    record->write_address = get16(in + 4);
+    record->written[0] = in[6];
+    record->written[1] = in[7];
+    record->psw = get16(in + 8);
+    record->bc = get16(in + 10);
+    record->de = get16(in + 12);
+    record->hl = get16(in + 14);
+    record->sp = get16(in + 16);
+    record->cycles = get32(in + 18);
+}
+
+// Bytes of `current` that differ from `last`, after a mask of which ones they are
+static size_t encode_packed(uint8_t *out, const uint8_t *current, const uint8_t *last){
+    uint32_t mask = 0;
+    size_t size = TRACE_MASK_SIZE;
+    for(size_t i = 0; i < TRACE_RECORD_SIZE; i++){
+        out[size] = current[i];
+        mask |= (uint32_t)(current[i] != last[i]) << i;
+        size += current[i] != last[i];
+    }
+    out[0] = mask & 0xFF;
+    out[1] = (mask >> 8) & 0xFF;
+    out[2] = mask >> 16;
+    return size;
+}
+
+size_t trace_encode(uint8_t *out, const trace_record_t *record, const trace_record_t *previous){
+    uint8_t current[TRACE_RECORD_SIZE], last[TRACE_RECORD_SIZE] = { 0 };
+    pack(current, record);
+    if(previous != NULL){
+        pack(last, previous);
+    }
+    return encode_packed(out, current, last);
+}
+
+size_t trace_decode(const uint8_t *in, size_t size, trace_record_t *record, const trace_record_t *previous){
+    uint8_t current[TRACE_RECORD_SIZE] = { 0 };
+    uint32_t mask;
+    size_t used = TRACE_MASK_SIZE;
+
+    if(size < TRACE_MASK_SIZE){
+        return 0;
+    }
+    if(previous != NULL){
+        pack(current, previous);
+    }
+    mask = in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16);
+    for(size_t i = 0; i < TRACE_RECORD_SIZE; i++){
+        if(mask & (1u << i)){
+            if(used == size){
+                return 0;
+            }
+            current[i] = in[used++];
+        }
+    }
+    unpack(current, record);
+    return used;
+}
+
+#ifdef I8080_TRACE
+
+#define TRACE_BLOCK_SIZE (8 + TRACE_CHUNK * (TRACE_MASK_SIZE + TRACE_RECORD_SIZE))
+
+// Records [start, end) of the ring as blocks of at most TRACE_CHUNK records, each block
+// delta-encoded from scratch so it can be decoded on its own
+static bool write_records(FILE *stream, const trace_t *trace, uint64_t start, uint64_t end, uint8_t *buffer){
+    bool ok = buffer != NULL;
+    while(ok && start < end){
+        size_t first = start & trace->mask;
+        size_t count = end - start;
+        size_t size = 8;
+        uint8_t packed[2][TRACE_RECORD_SIZE] = { { 0 } };
+        if(count > TRACE_CHUNK){
+            count = TRACE_CHUNK;
+        }
+        if(count > trace->mask + 1 - first){
+            count = trace->mask + 1 - first; // Up to where the ring wraps
+        }
+        for(size_t i = 0; i < count; i++){
+            pack(packed[i & 1], &trace->records[first + i]);
+            size += encode_packed(buffer + size, packed[i & 1], packed[(i & 1) ^ 1]);
+        }
+        put32(buffer, (uint32_t)count);
+        put32(buffer + 4, (uint32_t)(size - 8));
+        ok = fwrite(buffer, 1, size, stream) == size;
+        start += count;
+    }
+    return ok;
+}
+
+static bool write_header(FILE *stream){
+    uint8_t header[TRACE_HEADER_SIZE] = { 0 };
+    memcpy(header, TRACE_MAGIC, 4);
+    header[4] = TRACE_VERSION;
+    put32(header + 8, TRACE_RECORD_SIZE);
+    return fwrite(header, TRACE_HEADER_SIZE, 1, stream) == 1;
+}
+
+trace_t *enable_trace(i8080_t *cpu, size_t records){
+    trace_t *trace;
+    size_t capacity = 2 * TRACE_CHUNK; // So the machine can fill one chunk while the other is written
+
+    if(cpu == NULL){
+        return NULL;
+    }
+    if(cpu->trace != NULL){
+        return cpu->trace;
+    }
+    while(capacity < records){
+        capacity *= 2;
+    }
+    trace = (trace_t*)calloc(1, sizeof(trace_t));
+    if(trace == NULL){
+        return NULL;
+    }
+    trace->records = (trace_record_t*)calloc(capacity, sizeof(trace_record_t));
+    if(trace->records == NULL){
+        free(trace);
+        return NULL;
+    }
+    trace->mask = capacity - 1;
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->changed, NULL);
+    cpu->trace = trace;
+    return trace;
+}
+
+void disable_trace(i8080_t *cpu){
+    if(cpu != NULL && cpu->trace != NULL){
+        trace_stop_stream(cpu->trace);
+        pthread_mutex_destroy(&cpu->trace->lock);
+        pthread_cond_destroy(&cpu->trace->changed);
+        free(cpu->trace->records);
+        free(cpu->trace);
+        cpu->trace = NULL;
+    }
+}
+
+// Background writer: compresses whatever has been published until told to stop and drained
+static void *write_stream(void *argument){
+    trace_t *trace = (trace_t*)argument;
+    uint8_t *buffer = (uint8_t*)malloc(TRACE_BLOCK_SIZE);
+
+    pthread_mutex_lock(&trace->lock);
+    while(true){
+        uint64_t start, end;
+        bool ok;
+        while(trace->published == trace->written && !trace->stopping){
+            pthread_cond_wait(&trace->changed, &trace->lock);
+        }
+        if(trace->published == trace->written){
+            break;
+        }
+        start = trace->written;
+        end = trace->published;
+        pthread_mutex_unlock(&trace->lock);
+
+        ok = write_records(trace->stream, trace, start, end, buffer);
+
+        pthread_mutex_lock(&trace->lock);
+        trace->failed |= !ok;
+        trace->written = end;
+        pthread_cond_broadcast(&trace->changed);
+    }
+    pthread_mutex_unlock(&trace->lock);
+    free(buffer);
+    return NULL;
+}
+
+bool trace_stream(trace_t *trace, const char *path){
+    if(trace == NULL || path == NULL || trace->streaming){
+        return false;
+    }
+    trace->stream = fopen(path, "wb");
+    if(trace->stream == NULL){
+        return false;
+    }
+    trace->failed = !write_header(trace->stream);
+    trace->stopping = false;
+    trace->published = trace->head;
+    trace->written = trace->head;
+    if(pthread_create(&trace->writer, NULL, write_stream, trace) != 0){
+        fclose(trace->stream);
+        trace->stream = NULL;
+        return false;
+    }
+    trace->streaming = true;
+    return true;
+}
+
+bool trace_stop_stream(trace_t *trace){
+    bool ok;
+    if(trace == NULL || !trace->streaming){
+        return false;
+    }
+    pthread_mutex_lock(&trace->lock);
+    trace->published = trace->head;
+    trace->stopping = true;
+    pthread_cond_broadcast(&trace->changed);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->writer, NULL);
+
+    ok = !trace->failed;
+    if(fclose(trace->stream) != 0){
+        ok = false;
+    }
+    trace->stream = NULL;
+    trace->streaming = false;
+    return ok;
+}
+
+void trace_publish(trace_t *trace){
+    pthread_mutex_lock(&trace->lock);
+    trace->published = trace->head;
+    pthread_cond_broadcast(&trace->changed);
+    // The next chunk reuses the oldest records in the ring, which must have been written first
+    while(trace->head + TRACE_CHUNK - trace->written > trace->mask + 1){
+        pthread_cond_wait(&trace->changed, &trace->lock);
+    }
+    pthread_mutex_unlock(&trace->lock);
+}
+
+bool trace_save(const trace_t *trace, const char *path){
+    uint8_t *buffer;
+    uint64_t start = 0;
+    FILE *stream;
+    bool ok;
+
+    if(trace == NULL || path == NULL){
+        return false;
+    }
+    // The slot in progress has already overwritten the oldest record
+    if(trace->head > trace->mask){
+        start = trace->head - trace->mask;
+    }
+    stream = fopen(path, "wb");
+    buffer = (uint8_t*)malloc(TRACE_BLOCK_SIZE);
+    ok = stream != NULL && buffer != NULL && write_header(stream) &&
+         write_records(stream, trace, start, trace->head, buffer);
+    if(stream != NULL && fclose(stream) != 0){
+        ok = false;
+    }
+    free(buffer);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,152 @@
+//
+// Created by leonv on 5/29/2024.
+//
+
+#ifndef INTEL8080_I8080_TRACE_H
+#define INTEL8080_I8080_TRACE_H
+
+#include <stdio.h>
+
+#include "i8080_cpu.h"
+
+#ifdef I8080_TRACE
+#include <pthread.h>
+#endif
+
+// Execution trace. With I8080_TRACE, a trace attached to a machine gets one record per
+// instruction (and per interrupt taken) in a fixed-size ring, so the last `capacity`
+// instructions can be saved whenever something goes wrong. The ring can also be streamed to a
+// file as it fills, by a background thread that compresses each chunk; the machine only waits
+// for it when it falls a whole ring behind.
+//
+// Trace files start with a 16-byte header, "I80R", u8 version, 3 reserved bytes, u32 record
+// size, 4 reserved bytes. Blocks of records follow, each a u32 record count and a u32 byte
+// count, then the records delta-encoded: a 3-byte mask of the bytes that differ from the
+// previous record in the block (bit n for byte n), followed by those bytes. A record is
+// TRACE_RECORD_SIZE bytes, all little-endian:
+//
+//   u16     PC of the instruction
+//   u8      opcode (for an interrupt, the RST it executed)
+//   u8      flags: TRACE_WRITES, the number of bytes written, and TRACE_INTERRUPT
+//   u16     address of the lowest byte written
+//   u8[2]   bytes written there and at the next address
+//   u16     PSW (A << 8 | F), BC, DE, HL and SP after the instruction
+//   u32     low 32 bits of the cycle counter after the instruction
+//   u16     reserved
+
+#define TRACE_MAGIC "I80R"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RECORD_SIZE 24
+#define TRACE_MASK_SIZE 3
+#define TRACE_CHUNK 0x4000 // Records compressed and written at a time
+
+#define TRACE_WRITES 0x03
+#define TRACE_INTERRUPT 0x04
+
+typedef struct {
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t write_address;
+    uint8_t written[2];
+    uint16_t psw;
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+    uint16_t sp;
+    uint32_t cycles;
+} trace_record_t;
+
+// Delta coding of one record against the previous one, NULL for the first in a block. Encoding
+// returns the bytes written to `out`, at most TRACE_MASK_SIZE + TRACE_RECORD_SIZE; decoding
+// returns the bytes consumed, or 0 if `size` is too short.
+size_t trace_encode(uint8_t *out, const trace_record_t *record, const trace_record_t *previous);
+size_t trace_decode(const uint8_t *in, size_t size, trace_record_t *record, const trace_record_t *previous);
+
+#ifdef I8080_TRACE
+
+typedef struct i8080_trace {
+    trace_record_t *records;
+    size_t mask; // Capacity - 1
+    uint64_t head; // Records made since the trace was enabled; records[head & mask] is in progress
+
+    // Streaming, see trace_stream()
+    FILE *stream;
+    bool streaming;
+    bool stopping;
+    bool failed;
+    uint64_t published; // Records handed to the writer
+    uint64_t written; // Records the writer is done with
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} trace_t;
+
+// Attach a ring of at least `records` records (rounded up to a power of two of at least two
+// chunks), or return the trace already attached; NULL on allocation failure
+trace_t *enable_trace(i8080_t *cpu, size_t records);
+// Stops any streaming, flushing what is left, and frees the trace
+void disable_trace(i8080_t *cpu);
+
+// Write every record from now on to `path` on a background thread. Returns false if the file
+// cannot be created or the trace is streaming already.
+bool trace_stream(trace_t *trace, const char *path);
+// Flush the records made so far and close the file. Returns false if any write failed.
+bool trace_stop_stream(trace_t *trace);
+
+// Write the records still in the ring, oldest first
+bool trace_save(const trace_t *trace, const char *path);
+
+// Hands a completed chunk to the writer, waiting for it if the ring is full
+void trace_publish(trace_t *trace);
+
+// Called by the core for every byte an instruction writes
+static inline void trace_write(trace_t *trace, uint16_t address, uint8_t value){
+    trace_record_t *record = &trace->records[trace->head & trace->mask];
+    uint8_t count = record->flags & TRACE_WRITES;
+    if(count == 0){
+        record->write_address = address;
+        record->written[0] = value;
+    }
+    else if(address == (uint16_t)(record->write_address + 1)){
+        record->written[1] = value;
+    }
+    else{
+        // Stack pushes write downwards
+        record->written[1] = record->written[0];
+        record->written[0] = value;
+        record->write_address = address;
+    }
+    if(count < 2){
+        record->flags++;
+    }
+}
+
+// Called by the core before taking an interrupt, which is then recorded like an instruction
+static inline void trace_interrupt(trace_t *trace){
+    trace->records[trace->head & trace->mask].flags |= TRACE_INTERRUPT;
+}
+
+// Called by the core after each instruction with the PC it started at, before its cycles are
+// added to the counter
+static inline void trace_instruction(trace_t *trace, i8080_t *cpu, uint16_t pc, uint8_t opcode, uint8_t cycles){
+    trace_record_t *record = &trace->records[trace->head & trace->mask];
+    record->pc = pc;
+    record->opcode = opcode;
+    record->psw = TO16BIT(cpu->A, FLAGS(cpu));
+    record->bc = cpu->BC;
+    record->de = cpu->DE;
+    record->hl = cpu->HL;
+    record->sp = cpu->SP;
+    record->cycles = (uint32_t)(cpu->cycles + cycles);
+    trace->head++;
+    if((trace->head & (TRACE_CHUNK - 1)) == 0 && trace->streaming){
+        trace_publish(trace);
+    }
+    trace->records[trace->head & trace->mask].flags = 0;
+}
+
+#endif
+
+#endif //INTEL8080_I8080_TRACE_H
@@ -1,11 +1,108 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "i8080_cpu.h"
+#include "i8080_cpm.h"
+#include "file_reader.h"
+#include "i8080_profile.h"
+#include "i8080_trace.h"
 
-int main(){
+int main(int argc, char *argv[]){
 
     i8080_t *cpu = init_i8080();
+    // intel8080 [-cpm directory] [-profile file] [-trace file] <program> [arguments]
+    //   -cpm      BDOS calls are serviced natively, with files in `directory`, and the
+    //             arguments become the command tail
+    //   -profile  print the profile and write folded stacks to `file` (I8080_PROFILE builds)
+    //   -trace    save the last million instructions to `file` (I8080_TRACE builds)
+    const char *directory = NULL;
+    const char *profile_path = NULL;
+    const char *trace_path = NULL;
+    int arg = 1;
+    for(; arg + 1 < argc && argv[arg][0] == '-'; arg += 2){
+        if(strcmp(argv[arg], "-cpm") == 0){
+            directory = argv[arg + 1];
+        }
+        else if(strcmp(argv[arg], "-profile") == 0){
+            profile_path = argv[arg + 1];
+        }
+        else if(strcmp(argv[arg], "-trace") == 0){
+            trace_path = argv[arg + 1];
+        }
+        else{
+            break;
+        }
+    }
     if(cpu != NULL){
+        if(argc > arg){
+            cpm_t cpm;
+            if(load_file(cpu, argv[arg], COM_ORIGIN) < 0){
+                printf("Failed to load %s\n", argv[arg]);
+                destroy_i8080(cpu);
+                return 1;
+            }
+            if(directory != NULL){
+                char tail[128] = "";
+                for(int i = arg + 1; i < argc; i++){
+                    strncat(tail, argv[i], sizeof(tail) - strlen(tail) - 1);
+                    if(i + 1 < argc){
+                        strncat(tail, " ", sizeof(tail) - strlen(tail) - 1);
+                    }
+                }
+                if(!cpm_init(&cpm, cpu, directory)){
+                    printf("Failed to set up CP/M\n");
+                    destroy_i8080(cpu);
+                    return 1;
+                }
+                cpm_command_line(&cpm, tail);
+            }
+#ifdef I8080_PROFILE
+            if(profile_path != NULL){
+                enable_profiler(cpu);
+            }
+#else
+            if(profile_path != NULL){
+                printf("Profiling needs a build with I8080_PROFILE\n");
+            }
+#endif
+#ifdef I8080_TRACE
+            if(trace_path != NULL){
+                enable_trace(cpu, 1 << 20);
+            }
+#else
+            if(trace_path != NULL){
+                printf("Tracing needs a build with I8080_TRACE\n");
+            }
+#endif
+            while(!cpu->halted){
+                run_cycles(cpu, 1000000);
+            }
+            if(directory != NULL){
+                cpm_release(&cpm);
+            }
+            else{
+                print_state(cpu);
+            }
+#ifdef I8080_PROFILE
+            if(cpu->profile != NULL){
+                FILE *folded = fopen(profile_path, "w");
+                write_profile(stdout, cpu->profile, 20);
+                if(folded == NULL || !write_folded_stacks(folded, cpu->profile)){
+                    printf("Failed to write %s\n", profile_path);
+                }
+                if(folded != NULL){
+                    fclose(folded);
+                }
+            }
+#endif
+#ifdef I8080_TRACE
+            if(cpu->trace != NULL && !trace_save(cpu->trace, trace_path)){
+                printf("Failed to write %s\n", trace_path);
+            }
+#endif
+            destroy_i8080(cpu);
+            return 0;
+        }
         /*
                for(int i = 0; i < 0xFF; i++){
                    write_memory(cpu, 0x100, i);
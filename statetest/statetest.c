@@ -0,0 +1,272 @@
+//
+// Created by leonv on 5/28/2024.
+//
+
+// Regression tests for snapshots and save states, run by CTest.
+//
+//   statetest snapshots [rounds]
+//   statetest checkpoints <file> [checkpoints]
+//   statetest truncation <file>
+//
+// `snapshots` dirties a page and snapshots the machine over and over, releasing every snapshot
+// right away, and fails if the heap keeps growing: a snapshot may only keep alive the pages it
+// points at. It also checks that a snapshot held all along still restores what it captured.
+// `checkpoints` streams checkpoints of a program that keeps rewriting memory, then replays the
+// file with load_state() on a fresh machine and compares it with the machine as last
+// checkpointed; checkpoints the writer has finished with must be freed as well. `truncation`
+// writes a full record and a delta, and checks that load_state() takes the file cut after either
+// record but refuses it cut anywhere inside the delta. Exit status is 0 on success.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define HAVE_RUSAGE
+#endif
+
+#include "i8080_pool.h"
+#include "i8080_savestate.h"
+
+#define DEFAULT_ROUNDS 200000
+#define DEFAULT_CHECKPOINTS 2000
+#define GROWTH_LIMIT (32 * 1024 * 1024) // Bytes; the leak this guards against grew 117 MB per 50k rounds
+#define CHECKPOINT_CYCLES 20000
+
+// Rewrites one byte in each of pages 10-EF per pass, so every checkpoint has all of them to save
+static const uint8_t scribbler[] = {
+    0x21, 0x00, 0x10, // 0100 LXI H,1000
+    0x7D,             // 0103 MOV A,L
+    0xAC,             // 0104 XRA H
+    0x80,             // 0105 ADD B
+    0x77,             // 0106 MOV M,A
+    0x04,             // 0107 INR B
+    0x23,             // 0108 INX H
+    0x24,             // 0109 INR H
+    0x7C,             // 010A MOV A,H
+    0xFE, 0xF0,       // 010B CPI F0
+    0xC2, 0x03, 0x01, // 010D JNZ 0103
+    0x0C,             // 0110 INR C
+    0xC3, 0x00, 0x01, // 0111 JMP 0100
+};
+
+// Peak resident size in bytes, or 0 where it cannot be measured, which passes the growth checks
+static size_t peak_memory(void){
+#ifdef HAVE_RUSAGE
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+static bool same_machine(i8080_t *a, i8080_t *b){
+    if(a->PSW != b->PSW || a->BC != b->BC || a->DE != b->DE || a->HL != b->HL || a->SP != b->SP ||
+       a->PC != b->PC || a->cycles != b->cycles || a->halted != b->halted ||
+       a->interrupts_enabled != b->interrupts_enabled){
+        return false;
+    }
+    for(uint32_t address = 0; address < MEMORY_SIZE; address++){
+        if(read_memory(a, (uint16_t)address) != read_memory(b, (uint16_t)address)){
+            return false;
+        }
+    }
+    return true;
+}
+
+static int test_snapshots(unsigned long rounds){
+    i8080_t *cpu = init_i8080();
+    i8080_snapshot_t *held;
+    size_t start;
+    bool kept = true;
+
+    if(cpu == NULL){
+        printf("Out of memory\n");
+        return 1;
+    }
+    write_memory(cpu, 0x4000, 0xA5);
+    held = snapshot_i8080(cpu);
+    if(held == NULL){
+        printf("Out of memory\n");
+        destroy_i8080(cpu);
+        return 1;
+    }
+
+    // Warm up first, so the baseline includes the allocator's steady state
+    for(unsigned long i = 0; i < rounds / 10; i++){
+        write_memory(cpu, 0x4000, (uint8_t)i);
+        release_snapshot(snapshot_i8080(cpu));
+    }
+    start = peak_memory();
+    for(unsigned long i = 0; i < rounds; i++){
+        write_memory(cpu, 0x4000, (uint8_t)i);
+        write_memory(cpu, (uint16_t)(0x1000 + (i % 0x8000)), (uint8_t)i);
+        release_snapshot(snapshot_i8080(cpu));
+    }
+    size_t growth = peak_memory() - start;
+
+    restore_i8080(cpu, held);
+    kept = read_memory(cpu, 0x4000) == 0xA5 && read_memory(cpu, 0x1000) == 0;
+    release_snapshot(held);
+    destroy_i8080(cpu);
+
+    printf("%lu snapshots, peak memory grew by %zu KB\n", rounds, growth / 1024);
+    if(growth > GROWTH_LIMIT){
+        printf("FAIL: released snapshots are kept alive\n");
+        return 1;
+    }
+    if(!kept){
+        printf("FAIL: a held snapshot lost its contents\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int test_checkpoints(const char *path, unsigned long count){
+    i8080_t *cpu = init_i8080();
+    i8080_t *replay = init_i8080();
+    checkpoint_writer_t writer;
+    bool checked = true;
+    size_t start;
+    int status = 0;
+
+    if(cpu == NULL || replay == NULL || !reset_to_image(cpu, scribbler, sizeof(scribbler), 0x100)){
+        printf("Out of memory\n");
+        destroy_i8080(cpu);
+        destroy_i8080(replay);
+        return 1;
+    }
+    if(!checkpoint_writer_open(&writer, path)){
+        printf("Cannot create %s\n", path);
+        destroy_i8080(cpu);
+        destroy_i8080(replay);
+        return 1;
+    }
+    start = peak_memory();
+    for(unsigned long i = 0; i < count && checked; i++){
+        run_cycles(cpu, CHECKPOINT_CYCLES);
+        checked = checkpoint(&writer, cpu);
+    }
+    checked = checkpoint_writer_close(&writer) && checked;
+    size_t growth = peak_memory() - start;
+    printf("%lu checkpoints, %zu written, %zu dropped, peak memory grew by %zu KB\n",
+           count, writer.records, writer.dropped, growth / 1024);
+
+    if(!checked){
+        printf("FAIL: writing checkpoints failed\n");
+        status = 1;
+    }
+    else if(growth > GROWTH_LIMIT){
+        printf("FAIL: written checkpoints are kept alive\n");
+        status = 1;
+    }
+    else if(!load_state(replay, path)){
+        printf("FAIL: %s does not load\n", path);
+        status = 1;
+    }
+    else if(!same_machine(cpu, replay)){
+        printf("FAIL: the replayed machine differs from the last checkpoint\n");
+        status = 1;
+    }
+    remove(path);
+    destroy_i8080(cpu);
+    destroy_i8080(replay);
+    return status;
+}
+
+static bool write_file(const char *path, const uint8_t *data, size_t size){
+    FILE *stream = fopen(path, "wb");
+    bool written;
+    if(stream == NULL){
+        return false;
+    }
+    written = size == 0 || fwrite(data, size, 1, stream) == 1;
+    return fclose(stream) == 0 && written;
+}
+
+// Cuts inside the delta record: through its header, its page list, a page, and the device
+// section at the very end
+static int test_truncation(const char *path){
+    i8080_t *cpu = init_i8080();
+    i8080_t *replay = init_i8080();
+    i8080_snapshot_t *first = NULL, *second = NULL;
+    uint8_t *file = NULL;
+    long full_end = 0, end = 0;
+    FILE *stream;
+    int status = 0;
+
+    if(cpu == NULL || replay == NULL || !reset_to_image(cpu, scribbler, sizeof(scribbler), 0x100)){
+        printf("Out of memory\n");
+        destroy_i8080(cpu);
+        destroy_i8080(replay);
+        return 1;
+    }
+    stream = fopen(path, "wb+");
+    run_cycles(cpu, CHECKPOINT_CYCLES);
+    first = capture_state(cpu);
+    run_cycles(cpu, CHECKPOINT_CYCLES);
+    second = capture_state(cpu);
+    if(stream == NULL || first == NULL || second == NULL || !write_state(stream, first, NULL) ||
+       (full_end = ftell(stream)) <= 0 || !write_state(stream, second, first) || (end = ftell(stream)) <= full_end ||
+       (file = (uint8_t*)malloc((size_t)end)) == NULL || fseek(stream, 0, SEEK_SET) != 0 ||
+       fread(file, (size_t)end, 1, stream) != 1){
+        printf("FAIL: cannot write %s\n", path);
+        status = 1;
+    }
+    if(stream != NULL){
+        fclose(stream);
+    }
+
+    if(status == 0 && (!write_file(path, file, (size_t)end) || !load_state(replay, path) || !same_machine(cpu, replay))){
+        printf("FAIL: the whole file does not load\n");
+        status = 1;
+    }
+    if(status == 0 && (!write_file(path, file, (size_t)full_end) || !load_state(replay, path))){
+        printf("FAIL: the file cut after the full record does not load\n");
+        status = 1;
+    }
+    const long cuts[] = { 1, 10, 28, 29, 30, 31, 200, (end - full_end) / 2, end - full_end - 3, end - full_end - 1 };
+    for(size_t i = 0; status == 0 && i < sizeof(cuts) / sizeof(cuts[0]); i++){
+        if(!write_file(path, file, (size_t)(full_end + cuts[i]))){
+            printf("FAIL: cannot write %s\n", path);
+            status = 1;
+        }
+        else if(load_state(replay, path)){
+            printf("FAIL: the file cut %ld bytes into the delta record loads\n", cuts[i]);
+            status = 1;
+        }
+    }
+    if(status == 0){
+        printf("%zu truncated files refused\n", sizeof(cuts) / sizeof(cuts[0]));
+    }
+
+    remove(path);
+    free(file);
+    release_snapshot(first);
+    release_snapshot(second);
+    destroy_i8080(cpu);
+    destroy_i8080(replay);
+    return status;
+}
+
+int main(int argc, char *argv[]){
+    if(argc >= 2 && strcmp(argv[1], "snapshots") == 0){
+        return test_snapshots(argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_ROUNDS);
+    }
+    if(argc >= 3 && strcmp(argv[1], "checkpoints") == 0){
+        return test_checkpoints(argv[2], argc > 3 ? strtoul(argv[3], NULL, 0) : DEFAULT_CHECKPOINTS);
+    }
+    if(argc >= 3 && strcmp(argv[1], "truncation") == 0){
+        return test_truncation(argv[2]);
+    }
+    printf("Usage: %s snapshots [rounds]\n", argv[0]);
+    printf("       %s checkpoints <file> [checkpoints]\n", argv[0]);
+    printf("       %s truncation <file>\n", argv[0]);
+    return 2;
+}
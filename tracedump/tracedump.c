@@ -0,0 +1,161 @@
+//
+// Created by leonv on 5/29/2024.
+//
+
+// Offline decoder for execution traces written by trace_save() and trace_stream(), see
+// i8080_trace.h. Prints one line per record, or only the last `count` records:
+//
+//   tracedump <trace> [count]
+//
+// Each line gives the low 32 bits of the cycle counter after the instruction, its address,
+// opcode and mnemonic, the registers after it and the bytes it wrote. Mnemonics of
+// undocumented opcodes start with '*'. Operands are not in the trace, but follow from the
+// next record's PC and the registers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i8080_trace.h"
+
+static const char *mnemonics[256] = {
+    "NOP", "LXI B", "STAX B", "INX B", "INR B", "DCR B", "MVI B", "RLC",
+    "*NOP", "DAD B", "LDAX B", "DCX B", "INR C", "DCR C", "MVI C", "RRC",
+    "*NOP", "LXI D", "STAX D", "INX D", "INR D", "DCR D", "MVI D", "RAL",
+    "*NOP", "DAD D", "LDAX D", "DCX D", "INR E", "DCR E", "MVI E", "RAR",
+    "*NOP", "LXI H", "SHLD", "INX H", "INR H", "DCR H", "MVI H", "DAA",
+    "*NOP", "DAD H", "LHLD", "DCX H", "INR L", "DCR L", "MVI L", "CMA",
+    "*NOP", "LXI SP", "STA", "INX SP", "INR M", "DCR M", "MVI M", "STC",
+    "*NOP", "DAD SP", "LDA", "DCX SP", "INR A", "DCR A", "MVI A", "CMC",
+    "MOV B,B", "MOV B,C", "MOV B,D", "MOV B,E", "MOV B,H", "MOV B,L", "MOV B,M", "MOV B,A",
+    "MOV C,B", "MOV C,C", "MOV C,D", "MOV C,E", "MOV C,H", "MOV C,L", "MOV C,M", "MOV C,A",
+    "MOV D,B", "MOV D,C", "MOV D,D", "MOV D,E", "MOV D,H", "MOV D,L", "MOV D,M", "MOV D,A",
+    "MOV E,B", "MOV E,C", "MOV E,D", "MOV E,E", "MOV E,H", "MOV E,L", "MOV E,M", "MOV E,A",
+    "MOV H,B", "MOV H,C", "MOV H,D", "MOV H,E", "MOV H,H", "MOV H,L", "MOV H,M", "MOV H,A",
+    "MOV L,B", "MOV L,C", "MOV L,D", "MOV L,E", "MOV L,H", "MOV L,L", "MOV L,M", "MOV L,A",
+    "MOV M,B", "MOV M,C", "MOV M,D", "MOV M,E", "MOV M,H", "MOV M,L", "HLT", "MOV M,A",
+    "MOV A,B", "MOV A,C", "MOV A,D", "MOV A,E", "MOV A,H", "MOV A,L", "MOV A,M", "MOV A,A",
+    "ADD B", "ADD C", "ADD D", "ADD E", "ADD H", "ADD L", "ADD M", "ADD A",
+    "ADC B", "ADC C", "ADC D", "ADC E", "ADC H", "ADC L", "ADC M", "ADC A",
+    "SUB B", "SUB C", "SUB D", "SUB E", "SUB H", "SUB L", "SUB M", "SUB A",
+    "SBB B", "SBB C", "SBB D", "SBB E", "SBB H", "SBB L", "SBB M", "SBB A",
+    "ANA B", "ANA C", "ANA D", "ANA E", "ANA H", "ANA L", "ANA M", "ANA A",
+    "XRA B", "XRA C", "XRA D", "XRA E", "XRA H", "XRA L", "XRA M", "XRA A",
+    "ORA B", "ORA C", "ORA D", "ORA E", "ORA H", "ORA L", "ORA M", "ORA A",
+    "CMP B", "CMP C", "CMP D", "CMP E", "CMP H", "CMP L", "CMP M", "CMP A",
+    "RNZ", "POP B", "JNZ", "JMP", "CNZ", "PUSH B", "ADI", "RST 0",
+    "RZ", "RET", "JZ", "*JMP", "CZ", "CALL", "ACI", "RST 1",
+    "RNC", "POP D", "JNC", "OUT", "CNC", "PUSH D", "SUI", "RST 2",
+    "RC", "*RET", "JC", "IN", "CC", "*CALL", "SBI", "RST 3",
+    "RPO", "POP H", "JPO", "XTHL", "CPO", "PUSH H", "ANI", "RST 4",
+    "RPE", "PCHL", "JPE", "XCHG", "CPE", "*CALL", "XRI", "RST 5",
+    "RP", "POP PSW", "JP", "DI", "CP", "PUSH PSW", "ORI", "RST 6",
+    "RM", "SPHL", "JM", "EI", "CM", "*CALL", "CPI", "RST 7",
+};
+
+static uint32_t get32(const uint8_t *in){
+    return in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static void print_record(const trace_record_t *record){
+    printf("%10lu  %04X  %02X  %-9s  A %02X F %02X BC %04X DE %04X HL %04X SP %04X",
+           (unsigned long)record->cycles, record->pc, record->opcode, mnemonics[record->opcode],
+           record->psw >> 8, record->psw & 0xFF, record->bc, record->de, record->hl, record->sp);
+    switch(record->flags & TRACE_WRITES){
+        case 1:
+            printf("  [%04X] = %02X", record->write_address, record->written[0]);
+            break;
+        case 2:
+            printf("  [%04X] = %02X %02X", record->write_address, record->written[0], record->written[1]);
+            break;
+        default:
+            break;
+    }
+    if(record->flags & TRACE_INTERRUPT){
+        printf("  interrupt");
+    }
+    putchar('\n');
+}
+
+int main(int argc, char *argv[]){
+    uint8_t header[TRACE_HEADER_SIZE], size_fields[8];
+    uint8_t *block = NULL;
+    size_t block_capacity = 0;
+    trace_record_t *last = NULL; // Ring of the last `count` records, when given
+    size_t count = 0;
+    uint64_t records = 0;
+    FILE *stream;
+    bool ok = true;
+
+    if(argc < 2){
+        printf("Usage: %s <trace> [count]\n", argv[0]);
+        return 2;
+    }
+    if(argc > 2){
+        count = (size_t)strtoull(argv[2], NULL, 0);
+        last = count > 0 ? (trace_record_t*)malloc(count * sizeof(trace_record_t)) : NULL;
+        if(last == NULL){
+            printf("Usage: %s <trace> [count]\n", argv[0]);
+            return 2;
+        }
+    }
+    stream = fopen(argv[1], "rb");
+    if(stream == NULL || fread(header, TRACE_HEADER_SIZE, 1, stream) != 1 ||
+       memcmp(header, TRACE_MAGIC, 4) != 0 || header[4] != TRACE_VERSION || get32(header + 8) != TRACE_RECORD_SIZE){
+        printf("%s is not a trace\n", argv[1]);
+        if(stream != NULL){
+            fclose(stream);
+        }
+        free(last);
+        return 1;
+    }
+
+    while(ok && fread(size_fields, sizeof(size_fields), 1, stream) == 1){
+        uint32_t block_records = get32(size_fields);
+        size_t block_size = get32(size_fields + 4);
+        size_t offset = 0;
+        trace_record_t record, previous;
+
+        if(block_size > block_capacity){
+            uint8_t *grown = (uint8_t*)realloc(block, block_size);
+            if(grown == NULL){
+                ok = false;
+                break;
+            }
+            block = grown;
+            block_capacity = block_size;
+        }
+        if(fread(block, 1, block_size, stream) != block_size){
+            ok = false;
+            break;
+        }
+        for(uint32_t i = 0; i < block_records; i++){
+            size_t used = trace_decode(block + offset, block_size - offset, &record, i > 0 ? &previous : NULL);
+            if(used == 0){
+                ok = false;
+                break;
+            }
+            offset += used;
+            previous = record;
+            if(last != NULL){
+                last[records % count] = record;
+            }
+            else{
+                print_record(&record);
+            }
+            records++;
+        }
+    }
+    if(last != NULL){
+        for(uint64_t i = records > count ? records - count : 0; i < records; i++){
+            print_record(&last[i % count]);
+        }
+    }
+    if(!ok){
+        printf("%s is truncated or corrupt after %llu records\n", argv[1], (unsigned long long)records);
+    }
+    fclose(stream);
+    free(block);
+    free(last);
+    return ok ? 0 : 1;
+}